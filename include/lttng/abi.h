@@ -18,7 +18,7 @@
  * should be increased when an incompatible ABI change is done.
  */
 #define LTTNG_KERNEL_ABI_MAJOR_VERSION		2
-#define LTTNG_KERNEL_ABI_MINOR_VERSION		6
+#define LTTNG_KERNEL_ABI_MINOR_VERSION		7
 
 #define LTTNG_KERNEL_ABI_SYM_NAME_LEN		256
 #define LTTNG_KERNEL_ABI_SESSION_NAME_LEN	256
@@ -49,10 +49,55 @@ enum lttng_kernel_abi_output {
 	LTTNG_KERNEL_ABI_MMAP	= 1,
 };
 
+/*
+ * LTTng channel flags
+ */
+enum lttng_kernel_abi_channel_flags {
+	/* (1 << 0) is reserved, refused with -EINVAL. */
+	/*
+	 * Allocate per-cpu buffers when their cpu first records an
+	 * event. Only valid for per-cpu channels.
+	 */
+	LTTNG_KERNEL_ABI_CHANNEL_FLAG_LAZY_ALLOC	= (1 << 1),
+	/*
+	 * Shrink per-cpu buffers left mostly unused and grow them back,
+	 * up to the requested size, when they discard events. Only valid
+	 * for per-cpu discard mode channels read with splice, refused with
+	 * -EINVAL for mmap output.
+	 */
+	LTTNG_KERNEL_ABI_CHANNEL_FLAG_AUTO_RESIZE	= (1 << 2),
+	/*
+	 * Slow down the switch timer of buffers without new data since
+	 * their previous flush instead of flushing empty packets.
+	 */
+	LTTNG_KERNEL_ABI_CHANNEL_FLAG_ADAPTIVE_SWITCH_TIMER = (1 << 3),
+	/*
+	 * Map every buffer page when the stream is mmap'd instead of
+	 * faulting them in as sub-buffers are read. Only valid for
+	 * channels read with mmap.
+	 */
+	LTTNG_KERNEL_ABI_CHANNEL_FLAG_MMAP_PREFAULT	= (1 << 4),
+	/*
+	 * Record events with the variable width "tiny" event header,
+	 * down to 2 bytes for the 14 first event IDs when records are
+	 * close in time. Only valid for per-cpu channels on 64-bit
+	 * kernels.
+	 */
+	LTTNG_KERNEL_ABI_CHANNEL_FLAG_TINY_HEADER	= (1 << 5),
+	/*
+	 * Compress each sub-buffer when the reader gets it. Readers fetch
+	 * the compressed packet from the compressed area rather than from
+	 * the sub-buffer. Mutually exclusive, only valid for per-cpu
+	 * channels, and depend on the compressor being built in the kernel.
+	 */
+	LTTNG_KERNEL_ABI_CHANNEL_FLAG_COMPRESS_LZ4	= (1 << 6),
+	LTTNG_KERNEL_ABI_CHANNEL_FLAG_COMPRESS_ZSTD	= (1 << 7),
+};
+
 /*
  * LTTng DebugFS ABI structures.
  */
-#define LTTNG_KERNEL_ABI_CHANNEL_PADDING	LTTNG_KERNEL_ABI_SYM_NAME_LEN + 32
+#define LTTNG_KERNEL_ABI_CHANNEL_PADDING	LTTNG_KERNEL_ABI_SYM_NAME_LEN + 28
 struct lttng_kernel_abi_channel {
 	uint64_t subbuf_size;			/* in bytes */
 	uint64_t num_subbuf;
@@ -60,6 +105,7 @@ struct lttng_kernel_abi_channel {
 	unsigned int read_timer_interval;	/* usecs */
 	uint32_t output;			/* enum lttng_kernel_abi_output (splice, mmap) */
 	int overwrite;				/* 1: overwrite, 0: discard */
+	uint32_t flags;				/* enum lttng_kernel_abi_channel_flags */
 	char padding[LTTNG_KERNEL_ABI_CHANNEL_PADDING];
 } __attribute__((packed));
 
@@ -156,6 +202,15 @@ struct lttng_kernel_abi_event_ext {
 	uint32_t len;				/* length of this structure */
 
 	uint8_t match_check;			/* enum lttng_kernel_abi_match_check */
+	/*
+	 * Event ID ranking hint, 0 by default. Before the session first
+	 * starts, event IDs of each channel are handed out by decreasing
+	 * priority so the most frequent events fit the compact event
+	 * header. A channel with at most 31 prioritized events uses the
+	 * compact event header, other events then being recorded with
+	 * its extended form. Only used by event recorders.
+	 */
+	uint8_t priority;
 }  __attribute__((packed));
 
 /*
@@ -187,6 +242,16 @@ struct lttng_kernel_abi_event_notifier {
 	char padding[LTTNG_KERNEL_ABI_EVENT_NOTIFIER_PADDING];
 } __attribute__((packed));
 
+/*
+ * Coalesce notification reader wakeups: wake up once watermark sub-buffers
+ * are ready, or after at most max_latency. A watermark of 0 or 1 wakes up
+ * readers at each delivered sub-buffer.
+ */
+struct lttng_kernel_abi_notification_wakeup {
+	uint32_t watermark;		/* in sub-buffers */
+	uint32_t max_latency;		/* usecs */
+} __attribute__((packed));
+
 #define LTTNG_KERNEL_ABI_EVENT_NOTIFIER_NOTIFICATION_PADDING 32
 struct lttng_kernel_abi_event_notifier_notification {
 	uint64_t token;
@@ -548,6 +613,12 @@ struct lttng_kernel_abi_tracker_args {
 /* LTTNG_KERNEL_ABI_SYSCALL_MASK applies to both channel and counter fds. */
 #define LTTNG_KERNEL_ABI_SYSCALL_MASK		\
 	_IOWR(0xF6, 0x64, struct lttng_kernel_abi_syscall_mask)
+/*
+ * Returns a channel readiness file descriptor, readable when per-cpu buffers
+ * of the channel have data to deliver. read() returns the uint32_t ids of the
+ * cpus whose buffer became ready since the previous read.
+ */
+#define LTTNG_KERNEL_ABI_CHANNEL_READY		_IO(0xF6, 0x65)
 
 /* Event and Channel FD ioctl */
 /* lttng/abi-old.h reserve 0x70. */
@@ -583,6 +654,8 @@ struct lttng_kernel_abi_tracker_args {
 	_IOW(0xF6, 0xB0, struct lttng_kernel_abi_event_notifier)
 #define LTTNG_KERNEL_ABI_EVENT_NOTIFIER_GROUP_NOTIFICATION_FD \
 	_IO(0xF6, 0xB1)
+#define LTTNG_KERNEL_ABI_EVENT_NOTIFIER_GROUP_NOTIFICATION_WAKEUP \
+	_IOW(0xF6, 0xB2, struct lttng_kernel_abi_notification_wakeup)
 
 /* Event notifier file descriptor ioctl */
 #define LTTNG_KERNEL_ABI_CAPTURE			_IO(0xF6, 0xB8)
@@ -603,6 +676,47 @@ struct lttng_kernel_abi_tracker_args {
 #define LTTNG_KERNEL_ABI_COUNTER_CLEAR \
 	_IOW(0xF6, 0xC8, struct lttng_kernel_abi_counter_clear)
 
+/*
+ * Packet descriptor returned by LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF_BATCH.
+ * Sizes follow the units of the single sub-buffer ioctls.
+ */
+struct lttng_kernel_abi_ring_buffer_packet_desc {
+	uint64_t offset;		/* Offset from the consumed position (splice) */
+	uint64_t mmap_offset;		/* Read offset in the mmap'd buffer (mmap) */
+	uint64_t padded_size;		/* in bytes */
+	uint64_t content_size;		/* in bits */
+	uint64_t packet_size;		/* in bits */
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t seq_num;
+} __attribute__((packed));
+
+struct lttng_kernel_abi_ring_buffer_batch {
+	uint64_t packets;	/* Pointer to struct lttng_kernel_abi_ring_buffer_packet_desc array */
+	uint32_t max_count;	/* Number of entries in the packets array */
+	uint32_t count;		/* Output: number of sub-buffers held */
+} __attribute__((packed));
+
+/*
+ * Packet index record of the stream packet index, mapped with
+ * LTTNG_KERNEL_ABI_RING_BUFFER_GET_INDEX_MMAP_OFFSET. Fields follow the CTF
+ * packet index entry, in native byte order and without the file offset.
+ * "packet_seq_num" is ~0 while the record is updated: readers should read
+ * it before and after the other fields, and only use them if both reads
+ * match.
+ */
+struct lttng_kernel_abi_ring_buffer_packet_index {
+	uint64_t packet_size;		/* in bits */
+	uint64_t content_size;		/* in bits */
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t stream_id;
+	uint64_t stream_instance_id;
+	uint64_t packet_seq_num;
+} __attribute__((packed));
+
 /*
  * LTTng-specific ioctls for the lib ringbuffer.
  *
@@ -628,6 +742,14 @@ struct lttng_kernel_abi_tracker_args {
 #define LTTNG_KERNEL_ABI_RING_BUFFER_GET_SEQ_NUM		_IOR(0xF6, 0x27, uint64_t)
 /* returns the stream instance id (invariant for the stream) */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_INSTANCE_ID		_IOR(0xF6, 0x28, uint64_t)
+/*
+ * get the next ready sub-buffers, up to max_count, and their packet
+ * descriptors. Only discard-mode streams hand over more than one.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF_BATCH	\
+	_IOWR(0xF6, 0x29, struct lttng_kernel_abi_ring_buffer_batch)
+/* release all the sub-buffers held by GET_NEXT_SUBBUF_BATCH */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUF_BATCH	_IO(0xF6, 0x2A)
 
 /*
  * Those ioctl numbers use the wrong direction, but are kept for ABI backward
@@ -676,6 +798,12 @@ struct lttng_kernel_abi_tracker_args {
 /* returns the stream instance id (invariant for the stream) */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_INSTANCE_ID	\
 	LTTNG_KERNEL_ABI_RING_BUFFER_INSTANCE_ID
+/* get the next ready sub-buffers and their packet descriptors */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_NEXT_SUBBUF_BATCH \
+	LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF_BATCH
+/* release all the sub-buffers held by GET_NEXT_SUBBUF_BATCH */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_PUT_NEXT_SUBBUF_BATCH \
+	LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUF_BATCH
 #endif /* CONFIG_COMPAT */
 
 #endif /* _LTTNG_ABI_H */
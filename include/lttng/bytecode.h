@@ -185,6 +185,21 @@ enum bytecode_op {
 
 	BYTECODE_OP_RETURN_S64			= 99,
 
+	/*
+	 * Fused instructions, only generated by the specializer: load an
+	 * integer field or context and compare it against constants.
+	 */
+	BYTECODE_OP_CMP_FIELD_REF_S64_IMM	= 100,
+	BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM	= 101,
+	BYTECODE_OP_RANGE_FIELD_REF_S64		= 102,
+	BYTECODE_OP_RANGE_CONTEXT_REF_S64	= 103,
+
+	/*
+	 * Star globbing pattern compiled by the specializer, followed by
+	 * a get_index_u16 holding its offset in the runtime data.
+	 */
+	BYTECODE_OP_LOAD_STAR_GLOB_COMPILED	= 104,
+
 	NR_BYTECODE_OPS,
 };
 
@@ -218,4 +233,27 @@ struct return_op {
 	bytecode_opcode_t op;
 } __attribute__((packed));
 
+/*
+ * Fused instructions replace the instructions they fuse in place, "len"
+ * being the length of those instructions. "accept" holds the comparison
+ * outcomes which evaluate to true: bit 0 for less than, bit 1 for equal,
+ * bit 2 for greater than the immediate operand.
+ */
+struct cmp_imm_op {
+	bytecode_opcode_t op;
+	uint8_t len;
+	uint16_t index;		/* field offset or context index */
+	uint8_t accept;
+	int64_t imm;
+} __attribute__((packed));
+
+/* Both comparisons must evaluate to true. */
+struct range_op {
+	bytecode_opcode_t op;
+	uint8_t len;
+	uint16_t index;		/* field offset or context index */
+	uint8_t accept[2];
+	int64_t imm[2];
+} __attribute__((packed));
+
 #endif /* _FILTER_BYTECODE_H */
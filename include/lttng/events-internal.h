@@ -10,6 +10,7 @@
 
 #include <wrapper/compiler_attributes.h>
 #include <wrapper/uuid.h>
+#include <wrapper/timer.h>
 
 #include <lttng/events.h>
 
@@ -130,6 +131,7 @@ struct lttng_kernel_event_recorder_private {
 	struct lttng_kernel_event_session_common_private parent;
 
 	struct lttng_kernel_event_recorder *pub;	/* Public event interface */
+	unsigned int priority;				/* Event ID ranking hint */
 	unsigned int metadata_dumped:1;
 };
 
@@ -203,12 +205,13 @@ struct lttng_kernel_channel_buffer_private {
 
 	unsigned int id;			/* Channel ID */
 	unsigned int free_event_id;		/* Next event ID to allocate */
-	int header_type;			/* 0: unset, 1: compact, 2: large */
+	int header_type;			/* 0: unset, 1: compact, 2: large, 3: tiny */
 
 	enum channel_type channel_type;
 	struct lttng_kernel_ctx *ctx;
 	struct lttng_kernel_ring_buffer_channel *rb_chan;		/* Ring buffer channel */
 	unsigned int metadata_dumped:1;
+	unsigned int tiny_header:1;		/* Use the tiny event header */
 	struct lttng_transport *transport;
 };
 
@@ -320,6 +323,8 @@ struct lttng_kernel_bytecode_runtime {
 				struct lttng_kernel_probe_ctx *lttng_probe_ctx,
 				void *caller_ctx);
 	int link_failed;
+	int always_true;	/* Filter optimized to a constant true */
+	unsigned long fields;	/* Event fields read, LTTNG_KERNEL_FILTER_FIELD() */
 	struct list_head node;	/* list of bytecode runtime in event */
 	struct lttng_kernel_ctx *ctx;
 };
@@ -352,6 +357,7 @@ struct lttng_event_enabler_session_common {
 struct lttng_event_recorder_enabler {
 	struct lttng_event_enabler_session_common parent;
 	struct lttng_kernel_channel_buffer *chan;
+	unsigned int priority;			/* Event ID ranking hint */
 };
 
 struct lttng_event_counter_enabler {
@@ -459,7 +465,8 @@ struct lttng_kernel_channel_buffer_ops_private {
 				void *buf_addr,
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
-				unsigned int read_timer_interval);
+				unsigned int read_timer_interval,
+				unsigned int flags);
 	void (*channel_destroy)(struct lttng_kernel_ring_buffer_channel *chan);
 	struct lttng_kernel_ring_buffer *(*buffer_read_open)(struct lttng_kernel_ring_buffer_channel *chan);
 	int (*buffer_has_read_closed_stream)(struct lttng_kernel_ring_buffer_channel *chan);
@@ -501,6 +508,14 @@ struct lttng_kernel_channel_buffer_ops_private {
 	int (*instance_id) (const struct lttng_kernel_ring_buffer_config *config,
 			struct lttng_kernel_ring_buffer *bufb,
 			uint64_t *id);
+	/*
+	 * packet_desc fills the descriptor of the held sub-buffer starting
+	 * at buffer offset. Used by batched reads.
+	 */
+	int (*packet_desc) (const struct lttng_kernel_ring_buffer_config *config,
+			struct lttng_kernel_ring_buffer *bufb,
+			unsigned long offset,
+			struct lttng_kernel_abi_ring_buffer_packet_desc *desc);
 };
 
 #define LTTNG_EVENT_HT_BITS		12
@@ -523,6 +538,8 @@ struct lttng_event_notifier_group {
 	struct lttng_kernel_ring_buffer *buf;	/* Ring buffer for event notifier group. */
 	wait_queue_head_t read_wait;
 	struct irq_work wakeup_pending;	/* Pending wakeup irq work. */
+	struct timer_list wakeup_timer;	/* Wakeups held back by the watermark. */
+	int wakeup_timer_enabled;
 
 	struct lttng_kernel_syscall_table syscall_table;
 
@@ -1277,6 +1294,7 @@ struct lttng_kernel_channel_buffer *lttng_channel_buffer_create(struct lttng_ker
 				       size_t subbuf_size, size_t num_subbuf,
 				       unsigned int switch_timer_interval,
 				       unsigned int read_timer_interval,
+				       unsigned int flags,
 				       enum channel_type channel_type);
 struct lttng_kernel_channel_buffer *lttng_global_channel_create(struct lttng_kernel_session *session,
 				       int overwrite, void *buf_addr,
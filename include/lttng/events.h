@@ -343,6 +343,15 @@ struct lttng_kernel_probe_desc {
 enum lttng_kernel_event_filter_result {
 	LTTNG_KERNEL_EVENT_FILTER_ACCEPT = 0,
 	LTTNG_KERNEL_EVENT_FILTER_REJECT = 1,
+	/* A filter reads fields missing from the stack data. */
+	LTTNG_KERNEL_EVENT_FILTER_PREPARE = 2,
+};
+
+/*
+ * Filter context of the run_filter() callback.
+ */
+struct lttng_kernel_event_filter_ctx {
+	unsigned long fields;		/* Fields prepared in the stack data */
 };
 
 struct lttng_kernel_event_common_private;
@@ -353,6 +362,14 @@ enum lttng_kernel_event_type {
 	LTTNG_KERNEL_EVENT_TYPE_COUNTER = 2
 };
 
+/*
+ * Bit of the filterable event field @idx in a mask of fields the filters
+ * read. Fields past the last bit share it.
+ */
+#define LTTNG_KERNEL_FILTER_FIELD(idx)		\
+	(1UL << ((idx) < BITS_PER_LONG - 1 ? (idx) : BITS_PER_LONG - 1))
+#define LTTNG_KERNEL_FILTER_FIELDS_ALL		(~0UL)
+
 struct lttng_kernel_event_common {
 	struct lttng_kernel_event_common_private *priv;	/* Private event interface */
 
@@ -361,6 +378,7 @@ struct lttng_kernel_event_common {
 
 	int enabled;
 	int eval_filter;				/* Need to evaluate filters */
+	unsigned long filter_fields;			/* Fields read by enabled filters, hint */
 	int (*run_filter)(const struct lttng_kernel_event_common *event,
 		const char *stack_data,
 		struct lttng_kernel_probe_ctx *probe_ctx,
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng/loser_tree.h
+ *
+ * Tournament tree of losers for k-way merges. Each leaf holds a pointer
+ * (or NULL when the input is exhausted), each internal node the leaf which
+ * lost the match played there. Replaying the matches of the winner after its
+ * key changed takes a single comparison per tree level.
+ */
+
+#ifndef _LTTNG_LOSER_TREE_H
+#define _LTTNG_LOSER_TREE_H
+
+#include <linux/gfp.h>
+
+struct lttng_loser_tree {
+	size_t nr_leaves;		/* Leaves, padded to a power of two */
+	unsigned int *nodes;		/* nodes[0]: winner, others: losers */
+	unsigned int *winners;		/* Scratch space for rebuilds */
+	void **leaves;
+	int (*gt)(void *a, void *b);
+};
+
+/**
+ * lttng_loser_tree_init - initialize the tree
+ * @tree: the tree to initialize
+ * @nr_leaves: number of leaves (inputs)
+ * @gfpmask: allocation flags
+ * @gt: function to compare the elements
+ *
+ * All leaves are initially empty. Returns -ENOMEM if out of memory.
+ */
+extern int lttng_loser_tree_init(struct lttng_loser_tree *tree,
+		size_t nr_leaves, gfp_t gfpmask,
+		int gt(void *a, void *b));
+
+/**
+ * lttng_loser_tree_free - free the tree
+ * @tree: the tree to free
+ */
+extern void lttng_loser_tree_free(struct lttng_loser_tree *tree);
+
+/**
+ * lttng_loser_tree_winner - return the largest element of the tree
+ * @tree: the tree to be operated on
+ *
+ * Returns NULL if all leaves are empty.
+ */
+static inline void *lttng_loser_tree_winner(const struct lttng_loser_tree *tree)
+{
+	if (!tree->leaves)
+		return NULL;
+	return tree->leaves[tree->nodes[0]];
+}
+
+/**
+ * lttng_loser_tree_get - return the element of a leaf
+ * @tree: the tree to be operated on
+ * @leaf: leaf index
+ */
+static inline void *lttng_loser_tree_get(const struct lttng_loser_tree *tree,
+		size_t leaf)
+{
+	if (!tree->leaves)
+		return NULL;
+	return tree->leaves[leaf];
+}
+
+/**
+ * lttng_loser_tree_set - set the element of a leaf
+ * @tree: the tree to be operated on
+ * @leaf: leaf index
+ * @p: the element, NULL to empty the leaf
+ *
+ * Rebuilds the whole tree, with a complexity of O(n). Use
+ * lttng_loser_tree_replace_winner() to update the winner.
+ */
+extern void lttng_loser_tree_set(struct lttng_loser_tree *tree,
+		size_t leaf, void *p);
+
+/**
+ * lttng_loser_tree_replace_winner - update the winner leaf
+ * @tree: the tree to be operated on
+ * @p: the new element of the winner leaf, NULL to empty it
+ *
+ * Also used when the key of the winner element changed. Replays the matches
+ * of the winner leaf only, with a complexity of O(log(n)).
+ */
+extern void lttng_loser_tree_replace_winner(struct lttng_loser_tree *tree,
+		void *p);
+
+/**
+ * lttng_loser_tree_runner_up - return the second largest element
+ * @tree: the tree to be operated on
+ *
+ * Returns NULL if the tree holds less than two elements. The winner stays
+ * the largest element as long as it is not smaller than the runner-up, so
+ * callers can skip replays until then.
+ */
+extern void *lttng_loser_tree_runner_up(const struct lttng_loser_tree *tree);
+
+#endif /* _LTTNG_LOSER_TREE_H */
@@ -35,12 +35,77 @@ do {								\
 } while (0)
 #endif
 
+/* Comparison outcomes of fused instructions and compiled predicates */
+#define BYTECODE_CMP_LT		(1U << 0)
+#define BYTECODE_CMP_EQ		(1U << 1)
+#define BYTECODE_CMP_GT		(1U << 2)
+
+/*
+ * Return whether comparing @v against @imm gives one of the @accept
+ * outcomes, without branching on the comparison.
+ */
+static inline
+bool bytecode_cmp_accept(unsigned int accept, int64_t v, int64_t imm)
+{
+	/* Shift by 0, 1 or 2 for less than, equal or greater than. */
+	return (accept >> ((v > imm) - (v < imm) + 1)) & 1;
+}
+
+/* Integer comparison of a field against a constant. */
+struct bytecode_pred {
+	bool context;		/* Static context field, else event field */
+	uint8_t accept;		/* BYTECODE_CMP_* outcomes evaluating to true */
+	uint16_t offset;	/* Field offset in stack data, or context index */
+	int64_t imm;		/* Constant operand */
+};
+
+/* Filter compiled by lttng_bytecode_compile(). */
+struct bytecode_pred_prog {
+	bool is_or;		/* Predicates joined by "||", else by "&&" */
+	unsigned int nr_preds;
+	struct bytecode_pred preds[];
+};
+
+/* Maximum number of event fields keying the verdict of a shared filter. */
+#define BYTECODE_SHARED_MAX_FIELDS	4
+
+/* Last verdict of a shared filter on a CPU. */
+struct bytecode_shared_verdict {
+	unsigned int seq;	/* Odd while updated, 0 if empty */
+	int result;		/* LTTNG_KERNEL_BYTECODE_FILTER_* */
+	int64_t fields[BYTECODE_SHARED_MAX_FIELDS];
+};
+
+/*
+ * Filter bytecode linked with identical content to events of the same
+ * tracepoint, by any session or event notifier group.
+ */
+struct bytecode_shared {
+	struct hlist_node hlist;	/* Hash table of shared filters */
+	const struct lttng_kernel_event_desc *event_desc;
+	unsigned int refcount;
+	/*
+	 * Filters only reading integer event fields evaluate to the same
+	 * verdict for the same field values: their last verdict is kept per
+	 * CPU, keyed by the stack data of these fields.
+	 */
+	bool memoize;
+	unsigned int nr_fields;
+	uint16_t field_offsets[BYTECODE_SHARED_MAX_FIELDS];
+	struct bytecode_shared_verdict __percpu *verdict;
+	uint32_t len;			/* Original bytecode, with relocs */
+	uint32_t reloc_offset;
+	char data[];
+};
+
 /* Linked bytecode. Child of struct lttng_kernel_bytecode_runtime. */
 struct bytecode_runtime {
 	struct lttng_kernel_bytecode_runtime p;
 	size_t data_len;
 	size_t data_alloc_len;
 	char *data;
+	struct bytecode_pred_prog *pred;	/* Compiled filter, or NULL */
+	struct bytecode_shared *shared;		/* Shared filter, or NULL */
 	uint16_t len;
 	char code[];
 };
@@ -106,6 +171,22 @@ struct bytecode_get_index_data {
 	} elem;
 };
 
+/*
+ * Star globbing pattern compiled by the specializer, followed by its
+ * segments text and the original pattern. A pattern is made of the
+ * segments separated by stars, the first one anchored at the start of the
+ * candidate string and the last one at its end.
+ */
+struct bytecode_star_glob {
+	uint16_t insn_len;		/* Length of the original load */
+	uint16_t pattern_offset;	/* Original pattern, from struct start */
+	uint16_t nr_segments;		/* Number of stars, plus one */
+	struct {
+		uint16_t offset;	/* Unescaped text, from struct start */
+		uint16_t len;
+	} segments[];
+};
+
 /* Validation stack */
 struct vstack_load {
 	enum load_type type;
@@ -203,6 +284,8 @@ struct estack_entry {
 			size_t seq_len;
 			enum estack_string_literal_type literal_type;
 			bool user;		/* is string from userspace ? */
+			/* Compiled star globbing pattern, or NULL. */
+			const struct bytecode_star_glob *glob;
 		} s;
 		struct load_ptr ptr;
 	} u;
@@ -295,6 +378,12 @@ int lttng_bytecode_validate(struct bytecode_runtime *bytecode);
 int lttng_bytecode_validate_load(struct bytecode_runtime *bytecode);
 int lttng_bytecode_specialize(const struct lttng_kernel_event_desc *event_desc,
 		struct bytecode_runtime *bytecode);
+int lttng_bytecode_optimize(struct bytecode_runtime *bytecode);
+bool lttng_bytecode_is_always_true(const struct bytecode_runtime *bytecode);
+int lttng_bytecode_compile(struct bytecode_runtime *bytecode);
+int lttng_bytecode_share(const struct lttng_kernel_event_desc *event_desc,
+		struct bytecode_runtime *bytecode);
+void lttng_bytecode_unshare(struct bytecode_runtime *bytecode);
 
 int lttng_bytecode_interpret_error(struct lttng_kernel_bytecode_runtime *bytecode_runtime,
 		const char *stack_data,
@@ -306,4 +395,14 @@ int lttng_bytecode_interpret(struct lttng_kernel_bytecode_runtime *kernel_byteco
 		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
 		void *caller_ctx);
 
+int lttng_bytecode_interpret_pred(struct lttng_kernel_bytecode_runtime *kernel_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
+		void *caller_ctx);
+
+int lttng_bytecode_interpret_shared(struct lttng_kernel_bytecode_runtime *kernel_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
+		void *caller_ctx);
+
 #endif /* _LTTNG_FILTER_H */
@@ -522,7 +522,9 @@ error:									      \
  * Stage 4.1 of tracepoint event generation.
  *
  * Create static inline function that layout the filter stack data.
- * We make both write and nowrite data available to the filter.
+ * We make both write and nowrite data available to the filter. Only the
+ * fields selected by __stack_fields are copied, the slots of the other
+ * fields are skipped.
  */
 
 /* Reset all macros within TRACEPOINT_EVENT */
@@ -628,18 +630,26 @@ error:									      \
 
 #undef _ctf_integer_ext
 #define _ctf_integer_ext(_type, _item, _user_src, _byte_order, _base, _user, _nowrite) \
-	_ctf_integer_ext_isuser##_user(_type, _item, _user_src, _byte_order, _base, _nowrite)
+	if (__stack_fields & LTTNG_KERNEL_FILTER_FIELD(__stack_field_idx)) {   \
+		_ctf_integer_ext_isuser##_user(_type, _item, _user_src, _byte_order, _base, _nowrite) \
+	} else {							       \
+		__stack_data += sizeof(int64_t);			       \
+	}								       \
+	__stack_field_idx++;
 
 #undef _ctf_array_encoded
 #define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
-	{								       \
+	if (__stack_fields & LTTNG_KERNEL_FILTER_FIELD(__stack_field_idx)) {   \
 		unsigned long __ctf_tmp_ulong = (unsigned long) (_length);     \
 		const void *__ctf_tmp_ptr = (_src);			       \
 		memcpy(__stack_data, &__ctf_tmp_ulong, sizeof(unsigned long)); \
 		__stack_data += sizeof(unsigned long);			       \
 		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
 		__stack_data += sizeof(void *);				       \
-	}
+	} else {							       \
+		__stack_data += sizeof(unsigned long) + sizeof(void *);	       \
+	}								       \
+	__stack_field_idx++;
 
 #undef _ctf_array_bitfield
 #define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
@@ -648,14 +658,17 @@ error:									      \
 #undef _ctf_sequence_encoded
 #define _ctf_sequence_encoded(_type, _item, _src, _length_type,		       \
 			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
-	{								       \
+	if (__stack_fields & LTTNG_KERNEL_FILTER_FIELD(__stack_field_idx)) {   \
 		unsigned long __ctf_tmp_ulong = (unsigned long) (_src_length); \
 		const void *__ctf_tmp_ptr = (_src);			       \
 		memcpy(__stack_data, &__ctf_tmp_ulong, sizeof(unsigned long)); \
 		__stack_data += sizeof(unsigned long);			       \
 		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
 		__stack_data += sizeof(void *);				       \
-	}
+	} else {							       \
+		__stack_data += sizeof(unsigned long) + sizeof(void *);	       \
+	}								       \
+	__stack_field_idx++;
 
 #undef _ctf_sequence_bitfield
 #define _ctf_sequence_bitfield(_type, _item, _src,		\
@@ -666,12 +679,13 @@ error:									      \
 
 #undef _ctf_string
 #define _ctf_string(_item, _src, _user, _nowrite)			       \
-	{								       \
+	if (__stack_fields & LTTNG_KERNEL_FILTER_FIELD(__stack_field_idx)) {   \
 		const void *__ctf_tmp_ptr =				       \
 			((_src) ? (_src) : __LTTNG_NULL_STRING);	       \
 		memcpy(__stack_data, &__ctf_tmp_ptr, sizeof(void *));	       \
-		__stack_data += sizeof(void *);				       \
-	}
+	}								       \
+	__stack_data += sizeof(void *);					       \
+	__stack_field_idx++;
 
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		       \
@@ -690,9 +704,10 @@ error:									      \
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
 static inline								      \
 void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
-		void *__tp_locvar)					      \
+		unsigned long __stack_fields, void *__tp_locvar)		      \
 {									      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
+	unsigned int __stack_field_idx __attribute__((unused)) = 0;	      \
 									      \
 	_fields								      \
 }
@@ -701,9 +716,10 @@ void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
 static inline								      \
 void __event_prepare_interpreter_stack__##_name(char *__stack_data,		      \
-		void *__tp_locvar, _proto)				      \
+		unsigned long __stack_fields, void *__tp_locvar, _proto)	      \
 {									      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
+	unsigned int __stack_field_idx __attribute__((unused)) = 0;	      \
 									      \
 	_fields								      \
 }
@@ -1078,7 +1094,7 @@ static void __event_probe__##_name(_data_proto)						\
 	struct probe_local_vars __tp_locvar;						\
 	struct probe_local_vars *tp_locvar __attribute__((unused)) =			\
 			&__tp_locvar;							\
-	bool __interpreter_stack_prepared = false;					\
+	struct lttng_kernel_event_filter_ctx __filter_ctx = { .fields = 0 };		\
 											\
 	if (unlikely(!READ_ONCE(__event->enabled)))					\
 		return;									\
@@ -1120,11 +1136,23 @@ static void __event_probe__##_name(_data_proto)						\
 	__dynamic_len_idx = __orig_dynamic_len_offset;					\
 	_code_pre									\
 	if (unlikely(READ_ONCE(__event->eval_filter))) {				\
+		int __filter_ret;							\
+											\
+		/* Only prepare the fields the filters read. */				\
+		__filter_ctx.fields = READ_ONCE(__event->filter_fields);		\
 		__event_prepare_interpreter_stack__##_name(__stackvar.__interpreter_stack_data, \
-				_locvar_args);						\
-		__interpreter_stack_prepared = true;					\
-		if (likely(__event->run_filter(__event,			      		\
-				__stackvar.__interpreter_stack_data, &__lttng_probe_ctx, NULL) != LTTNG_KERNEL_EVENT_FILTER_ACCEPT)) \
+				__filter_ctx.fields, _locvar_args);			\
+		__filter_ret = __event->run_filter(__event,				\
+				__stackvar.__interpreter_stack_data, &__lttng_probe_ctx, &__filter_ctx); \
+		if (unlikely(__filter_ret == LTTNG_KERNEL_EVENT_FILTER_PREPARE)) {	\
+			__filter_ctx.fields = LTTNG_KERNEL_FILTER_FIELDS_ALL;		\
+			__event_prepare_interpreter_stack__##_name(			\
+					__stackvar.__interpreter_stack_data,		\
+					__filter_ctx.fields, _locvar_args);		\
+			__filter_ret = __event->run_filter(__event,			\
+					__stackvar.__interpreter_stack_data, &__lttng_probe_ctx, &__filter_ctx); \
+		}									\
+		if (likely(__filter_ret != LTTNG_KERNEL_EVENT_FILTER_ACCEPT))		\
 			goto __post;							\
 	}										\
 	switch (__event->type) {							\
@@ -1160,10 +1188,11 @@ static void __event_probe__##_name(_data_proto)						\
 		struct lttng_kernel_notification_ctx __notif_ctx;			\
 											\
 		__notif_ctx.eval_capture = LTTNG_READ_ONCE(__event_notifier->eval_capture); \
-		if (unlikely(!__interpreter_stack_prepared && __notif_ctx.eval_capture)) \
+		if (unlikely(__filter_ctx.fields != LTTNG_KERNEL_FILTER_FIELDS_ALL	\
+				&& __notif_ctx.eval_capture))				\
 			__event_prepare_interpreter_stack__##_name(			\
 					__stackvar.__interpreter_stack_data,		\
-					_locvar_args);					\
+					LTTNG_KERNEL_FILTER_FIELDS_ALL, _locvar_args);	\
 											\
 		__event_notifier->notification_send(__event_notifier,			\
 				__stackvar.__interpreter_stack_data,			\
@@ -1178,10 +1207,11 @@ static void __event_probe__##_name(_data_proto)						\
 		struct lttng_kernel_event_counter_ctx __event_counter_ctx;		\
 											\
 		__event_counter_ctx.args_available = LTTNG_READ_ONCE(__event_counter->use_args); \
-		if (unlikely(!__interpreter_stack_prepared && __event_counter_ctx.args_available)) \
+		if (unlikely(__filter_ctx.fields != LTTNG_KERNEL_FILTER_FIELDS_ALL	\
+				&& __event_counter_ctx.args_available))			\
 			__event_prepare_interpreter_stack__##_name(			\
 					__stackvar.__interpreter_stack_data,		\
-					_locvar_args);					\
+					LTTNG_KERNEL_FILTER_FIELDS_ALL, _locvar_args);	\
 											\
 		(void) __event_counter->chan->ops->counter_hit(__event_counter,		\
 				__stackvar.__interpreter_stack_data,			\
@@ -63,6 +63,7 @@
 #define LTTNG_METADATA_TIMEOUT_MSEC	10000
 
 #define LTTNG_RFLAG_EXTENDED		RING_BUFFER_RFLAG_END
-#define LTTNG_RFLAG_END			(LTTNG_RFLAG_EXTENDED << 1)
+#define LTTNG_RFLAG_WIDE		(LTTNG_RFLAG_EXTENDED << 1)
+#define LTTNG_RFLAG_END			(LTTNG_RFLAG_WIDE << 1)
 
 #endif /* _LTTNG_TRACER_H */
@@ -69,7 +69,8 @@ lib_ring_buffer_read_offset_address(struct lttng_kernel_ring_buffer_backend *buf
  * This function copies "len" bytes of data from a source pointer to a buffer
  * backend, at the current context offset. This is more or less a buffer
  * backend-specific memcpy() operation. Calls the slow path (_ring_buffer_write)
- * if copy is crossing a page boundary.
+ * if copy is crossing a page boundary, which never happens with the
+ * RING_BUFFER_VMAP backend.
  */
 static inline __attribute__((always_inline))
 void lib_ring_buffer_write(const struct lttng_kernel_ring_buffer_config *config,
@@ -78,22 +79,19 @@ void lib_ring_buffer_write(const struct lttng_kernel_ring_buffer_config *config,
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
+	char *dest;
 
 	if (unlikely(!len))
 		return;
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(bytes_left_in_page == len))
-		lib_ring_buffer_do_copy(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len);
+	offset &= bufb->buf_size - 1;
+	dest = lib_ring_buffer_backend_write_address(config, chanb,
+				backend_pages, offset, len);
+	if (likely(dest))
+		lib_ring_buffer_do_copy(config, dest, src, len);
 	else
 		_lib_ring_buffer_write(bufb, offset, src, len);
 	ctx->priv.buf_offset += len;
@@ -118,21 +116,19 @@ void lib_ring_buffer_memset(const struct lttng_kernel_ring_buffer_config *config
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
+	char *dest;
 
 	if (unlikely(!len))
 		return;
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(bytes_left_in_page == len))
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					  + (offset & ~PAGE_MASK),
-					  c, len);
+	offset &= bufb->buf_size - 1;
+	dest = lib_ring_buffer_backend_write_address(config, chanb,
+				backend_pages, offset, len);
+	if (likely(dest))
+		lib_ring_buffer_do_memset(dest, c, len);
 	else
 		_lib_ring_buffer_memset(bufb, offset, c, len);
 	ctx->priv.buf_offset += len;
@@ -215,38 +211,31 @@ void lib_ring_buffer_strcpy(const struct lttng_kernel_ring_buffer_config *config
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
+	char *dest;
 
 	if (unlikely(!len))
 		return;
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(bytes_left_in_page == len)) {
+	offset &= bufb->buf_size - 1;
+	dest = lib_ring_buffer_backend_write_address(config, chanb,
+				backend_pages, offset, len);
+	if (likely(dest)) {
 		size_t count;
 
-		count = lib_ring_buffer_do_strcpy(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len - 1);
-		offset += count;
+		count = lib_ring_buffer_do_strcpy(config, dest, src, len - 1);
+		dest += count;
 		/* Padding */
 		if (unlikely(count < len - 1)) {
 			size_t pad_len = len - 1 - count;
 
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
+			lib_ring_buffer_do_memset(dest, pad, pad_len);
+			dest += pad_len;
 		}
 		/* Ending '\0' */
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					+ (offset & ~PAGE_MASK),
-				'\0', 1);
+		lib_ring_buffer_do_memset(dest, '\0', 1);
 	} else {
 		_lib_ring_buffer_strcpy(bufb, offset, src, len, pad);
 	}
@@ -281,33 +270,28 @@ void lib_ring_buffer_pstrcpy(const struct lttng_kernel_ring_buffer_config *confi
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
+	char *dest;
 
 	if (unlikely(!len))
 		return;
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(bytes_left_in_page == len)) {
+	offset &= bufb->buf_size - 1;
+	dest = lib_ring_buffer_backend_write_address(config, chanb,
+				backend_pages, offset, len);
+	if (likely(dest)) {
 		size_t count;
 
-		count = lib_ring_buffer_do_strcpy(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len);
-		offset += count;
+		count = lib_ring_buffer_do_strcpy(config, dest, src, len);
+		dest += count;
 		/* Padding */
 		if (unlikely(count < len)) {
 			size_t pad_len = len - count;
 
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
+			lib_ring_buffer_do_memset(dest, pad, pad_len);
+			dest += pad_len;
 		}
 	} else {
 		_lib_ring_buffer_pstrcpy(bufb, offset, src, len, pad);
@@ -335,27 +319,25 @@ void lib_ring_buffer_copy_from_user_inatomic(const struct lttng_kernel_ring_buff
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
+	char *dest;
 	unsigned long ret;
 
 	if (unlikely(!len))
 		return;
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	offset &= bufb->buf_size - 1;
+	dest = lib_ring_buffer_backend_write_address(config, chanb,
+				backend_pages, offset, len);
 
 	if (unlikely(!lttng_access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
 	pagefault_disable();
-	if (likely(bytes_left_in_page == len)) {
-		ret = lib_ring_buffer_do_copy_from_user_inatomic(
-			backend_pages->p[index].virt + (offset & ~PAGE_MASK),
-			src, len);
+	if (likely(dest)) {
+		ret = lib_ring_buffer_do_copy_from_user_inatomic(dest, src, len);
 		if (unlikely(ret > 0)) {
 			/* Copy failed. */
 			goto fill_buffer_enable_pf;
@@ -404,43 +386,37 @@ void lib_ring_buffer_strcpy_from_user_inatomic(const struct lttng_kernel_ring_bu
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
+	char *dest;
 
 	if (unlikely(!len))
 		return;
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	offset &= bufb->buf_size - 1;
+	dest = lib_ring_buffer_backend_write_address(config, chanb,
+				backend_pages, offset, len);
 
 	if (unlikely(!lttng_access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
 	pagefault_disable();
-	if (likely(bytes_left_in_page == len)) {
+	if (likely(dest)) {
 		size_t count;
 
 		count = lib_ring_buffer_do_strcpy_from_user_inatomic(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len - 1);
-		offset += count;
+					dest, src, len - 1);
+		dest += count;
 		/* Padding */
 		if (unlikely(count < len - 1)) {
 			size_t pad_len = len - 1 - count;
 
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
+			lib_ring_buffer_do_memset(dest, pad, pad_len);
+			dest += pad_len;
 		}
 		/* Ending '\0' */
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					+ (offset & ~PAGE_MASK),
-				'\0', 1);
+		lib_ring_buffer_do_memset(dest, '\0', 1);
 	} else {
 		_lib_ring_buffer_strcpy_from_user_inatomic(bufb, offset, src,
 					len, pad);
@@ -489,38 +465,34 @@ void lib_ring_buffer_pstrcpy_from_user_inatomic(const struct lttng_kernel_ring_b
 {
 	struct lttng_kernel_ring_buffer_backend *bufb = &ctx->priv.buf->backend;
 	struct channel_backend *chanb = &ctx->priv.chan->backend;
-	size_t index, bytes_left_in_page;
 	size_t offset = ctx->priv.buf_offset;
 	struct lttng_kernel_ring_buffer_backend_pages *backend_pages;
+	char *dest;
 
 	if (unlikely(!len))
 		return;
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	offset &= bufb->buf_size - 1;
+	dest = lib_ring_buffer_backend_write_address(config, chanb,
+				backend_pages, offset, len);
 
 	if (unlikely(!lttng_access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
 	pagefault_disable();
-	if (likely(bytes_left_in_page == len)) {
+	if (likely(dest)) {
 		size_t count;
 
 		count = lib_ring_buffer_do_strcpy_from_user_inatomic(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len);
-		offset += count;
+					dest, src, len);
+		dest += count;
 		/* Padding */
 		if (unlikely(count < len)) {
 			size_t pad_len = len - count;
 
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
+			lib_ring_buffer_do_memset(dest, pad, pad_len);
+			dest += pad_len;
 		}
 	} else {
 		_lib_ring_buffer_pstrcpy_from_user_inatomic(bufb, offset, src, len, pad);
@@ -554,7 +526,7 @@ unsigned long lib_ring_buffer_get_records_unread(
 	unsigned long records_unread = 0, sb_bindex, id;
 	unsigned int i;
 
-	for (i = 0; i < bufb->chan->backend.num_subbuf; i++) {
+	for (i = 0; i < bufb->num_subbuf; i++) {
 		id = bufb->buf_wsb[i].id;
 		sb_bindex = subbuffer_id_get_index(config, id);
 		pages = bufb->array[sb_bindex];
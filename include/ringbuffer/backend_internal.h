@@ -30,12 +30,36 @@ int channel_backend_init(struct channel_backend *chanb,
 			 const char *name,
 			 const struct lttng_kernel_ring_buffer_config *config,
 			 void *priv, size_t subbuf_size,
-			 size_t num_subbuf);
+			 size_t num_subbuf, unsigned int flags);
 void channel_backend_free(struct channel_backend *chanb);
 
 void lib_ring_buffer_backend_reset(struct lttng_kernel_ring_buffer_backend *bufb);
 void channel_backend_reset(struct channel_backend *chanb);
 
+/*
+ * Backend state of a buffer resize. Prepared with the new tables, which are
+ * exchanged with the buffer's tables on commit, so that release always frees
+ * whichever set is not in use.
+ */
+struct lttng_kernel_ring_buffer_backend_resize {
+	unsigned long num_subbuf;	/* Number of sub-buffers after resize */
+	struct lttng_kernel_ring_buffer_backend_pages **array;
+	struct lttng_kernel_ring_buffer_backend_subbuffer *buf_wsb;
+	struct lttng_kernel_ring_buffer_backend_counts *buf_cnt;
+	/* Sub-buffers added by a grow, or removed by a shrink. */
+	struct lttng_kernel_ring_buffer_backend_pages **spare;
+	unsigned long nr_spare;
+};
+
+int lib_ring_buffer_backend_resize_prepare(struct lttng_kernel_ring_buffer_backend *bufb,
+		struct lttng_kernel_ring_buffer_backend_resize *resize,
+		unsigned long num_subbuf);
+void lib_ring_buffer_backend_resize_commit(struct lttng_kernel_ring_buffer_backend *bufb,
+		struct lttng_kernel_ring_buffer_backend_resize *resize,
+		unsigned long consumed, unsigned long offset);
+void lib_ring_buffer_backend_resize_release(struct lttng_kernel_ring_buffer_backend *bufb,
+		struct lttng_kernel_ring_buffer_backend_resize *resize);
+
 int lib_ring_buffer_backend_init(void);
 void lib_ring_buffer_backend_exit(void);
 
@@ -200,7 +224,7 @@ void lib_ring_buffer_backend_get_pages(const struct lttng_kernel_ring_buffer_con
 	unsigned long sb_bindex, id;
 	struct lttng_kernel_ring_buffer_backend_pages *rpages;
 
-	offset &= chanb->buf_size - 1;
+	offset &= bufb->buf_size - 1;
 	sbidx = offset >> chanb->subbuf_size_order;
 	id = bufb->buf_wsb[sbidx].id;
 	sb_bindex = subbuffer_id_get_index(config, id);
@@ -220,6 +244,33 @@ struct lttng_kernel_ring_buffer_backend_pages *
 	return ctx->priv.backend_pages;
 }
 
+/*
+ * Get the kernel address where a write of @len bytes starting at @offset
+ * can be performed with a single contiguous copy, or NULL if the write
+ * needs to go through the page-by-page slow path.
+ *
+ * The RING_BUFFER_VMAP backend maps each sub-buffer contiguously, and
+ * records never cross a sub-buffer boundary, so the fast path is always
+ * taken. The RING_BUFFER_PAGE backend needs the write to fit within the
+ * current page.
+ */
+static inline __attribute__((always_inline))
+void *lib_ring_buffer_backend_write_address(const struct lttng_kernel_ring_buffer_config *config,
+		struct channel_backend *chanb,
+		struct lttng_kernel_ring_buffer_backend_pages *backend_pages,
+		size_t offset, size_t len)
+{
+	size_t index, bytes_left_in_page;
+
+	if (config->backend == RING_BUFFER_VMAP)
+		return backend_pages->vaddr + (offset & (chanb->subbuf_size - 1));
+	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
+	bytes_left_in_page = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	if (likely(bytes_left_in_page == len))
+		return backend_pages->p[index].virt + (offset & ~PAGE_MASK);
+	return NULL;
+}
+
 /*
  * The ring buffer can count events recorded and overwritten per buffer,
  * but it is disabled by default due to its performance overhead.
@@ -471,6 +522,27 @@ int update_read_sb_index(const struct lttng_kernel_ring_buffer_config *config,
 	return 0;
 }
 
+/**
+ * subbuffer_read_id - Sub-buffer id backing a read-side offset.
+ *
+ * In discard mode, the reader never exchanges sub-buffers with the writer
+ * and may hold several consecutive sub-buffers at once (see
+ * lib_ring_buffer_get_subbuf_batch()), so the offset is looked up in the
+ * writer table. In overwrite mode, the reader only ever owns its reader
+ * sub-buffer.
+ */
+static inline
+unsigned long subbuffer_read_id(const struct lttng_kernel_ring_buffer_config *config,
+				struct lttng_kernel_ring_buffer_backend *bufb,
+				size_t offset)
+{
+	if (config->mode == RING_BUFFER_DISCARD) {
+		offset &= bufb->buf_size - 1;
+		return bufb->buf_wsb[offset >> bufb->chan->backend.subbuf_size_order].id;
+	}
+	return bufb->buf_rsb.id;
+}
+
 static inline __attribute__((always_inline))
 void lttng_inline_memcpy(void *dest, const void *src,
 		unsigned long len)
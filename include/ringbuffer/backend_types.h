@@ -25,6 +25,7 @@ struct lttng_kernel_ring_buffer_backend_pages {
 	union v_atomic records_commit;	/* current records committed count */
 	union v_atomic records_unread;	/* records to read */
 	unsigned long data_size;	/* Amount of data to read from subbuf */
+	void *vaddr;			/* contiguous mapping (RING_BUFFER_VMAP) */
 	struct lttng_kernel_ring_buffer_backend_page p[];
 };
 
@@ -43,6 +44,13 @@ struct lttng_kernel_ring_buffer_backend_counts {
 	uint64_t seq_cnt;		/* packet sequence number */
 };
 
+/* Compression algorithm applied to sub-buffers handed to readers. */
+enum lttng_kernel_ring_buffer_compress {
+	RING_BUFFER_COMPRESS_NONE = 0,
+	RING_BUFFER_COMPRESS_LZ4,
+	RING_BUFFER_COMPRESS_ZSTD,
+};
+
 /*
  * Forward declaration of frontend-specific channel and ring_buffer.
  */
@@ -62,6 +70,15 @@ struct lttng_kernel_ring_buffer_backend {
 	 */
 	struct lttng_kernel_ring_buffer_backend_pages **array;
 	unsigned int num_pages_per_subbuf;
+	/*
+	 * Buffer geometry. The sub-buffer size is shared by the whole
+	 * channel, but the number of sub-buffers can be changed per buffer
+	 * by lib_ring_buffer_resize().
+	 */
+	unsigned long num_subbuf;	/* Number of sub-buffers for writer */
+	unsigned long buf_size;		/* Size of the buffer */
+	unsigned int num_subbuf_order;	/* Order of number of sub-buffers */
+	unsigned int buf_size_order;	/* Order of buffer size */
 
 	struct lttng_kernel_ring_buffer_channel *chan;		/* Associated channel */
 	int cpu;			/* This buffer's cpu. -1 if global. */
@@ -70,7 +87,7 @@ struct lttng_kernel_ring_buffer_backend {
 };
 
 struct channel_backend {
-	unsigned long buf_size;		/* Size of the buffer */
+	unsigned long buf_size;		/* Initial and maximum buffer size */
 	unsigned long subbuf_size;	/* Sub-buffer size */
 	unsigned int subbuf_size_order;	/* Order of sub-buffer size */
 	unsigned int num_subbuf_order;	/*
@@ -79,9 +96,17 @@ struct channel_backend {
 					 */
 	unsigned int buf_size_order;	/* Order of buffer size */
 	unsigned int extra_reader_sb:1;	/* has extra reader subbuffer ? */
+	unsigned int lazy_alloc:1;	/* allocate per-cpu buffers on first use ? */
+	unsigned int auto_resize:1;	/* resize buffers following their activity ? */
+	unsigned int adaptive_switch_timer:1;	/* back off switch timer of idle buffers ? */
+	unsigned int mmap_prefault:1;	/* populate buffer mappings at mmap time ? */
+	unsigned int compress:2;	/* enum lttng_kernel_ring_buffer_compress */
 	struct lttng_kernel_ring_buffer *buf;	/* Channel per-cpu buffers */
 
-	unsigned long num_subbuf;	/* Number of sub-buffers for writer */
+	unsigned long num_subbuf;	/*
+					 * Initial and maximum number of
+					 * sub-buffers per buffer for writer
+					 */
 	u64 start_timestamp;		/* Channel creation timestamp value */
 	void *priv;			/* Client-specific information */
 	void *priv_ops;			/* Client-specific ops pointer */
@@ -94,6 +94,17 @@ struct lttng_kernel_ring_buffer_client_cb {
  * RING_BUFFER_ALLOC_GLOBAL and RING_BUFFER_SYNC_GLOBAL :
  *   Global shared buffer with global synchronization.
  *
+ * backend:
+ *
+ * RING_BUFFER_PAGE keeps each sub-buffer as an array of order-0 pages. Writes
+ * crossing a page boundary go through a page-by-page slow path.
+ *
+ * RING_BUFFER_VMAP additionally maps the pages of each sub-buffer in a
+ * virtually contiguous kernel mapping, so every record write is a single
+ * copy. It consumes vmalloc address space equivalent to the buffer size,
+ * which makes it mostly suitable for 64-bit architectures. Pages handed to
+ * splice are copied rather than stolen from the buffer.
+ *
  * wakeup:
  *
  * RING_BUFFER_WAKEUP_BY_TIMER uses per-cpu timers to poll the
@@ -132,7 +143,7 @@ struct lttng_kernel_ring_buffer_config {
 	} output;
 	enum {
 		RING_BUFFER_PAGE,
-		RING_BUFFER_VMAP,		/* TODO */
+		RING_BUFFER_VMAP,
 		RING_BUFFER_STATIC,		/* TODO */
 	} backend;
 	enum {
@@ -155,6 +166,11 @@ struct lttng_kernel_ring_buffer_config {
 	 *   0 and 64 disable the timestamp compression scheme.
 	 */
 	unsigned int timestamp_bits;
+	/*
+	 * packet_index_size: size of the packet index record the client
+	 *   writes for each delivered packet. 0 disables the packet index.
+	 */
+	size_t packet_index_size;
 	struct lttng_kernel_ring_buffer_client_cb cb;
 };
 
@@ -198,6 +214,7 @@ struct lttng_kernel_ring_buffer_ctx_private {
 	unsigned long records_lost_full;
 	unsigned long records_lost_wrap;
 	unsigned long records_lost_big;
+	unsigned long records_lost_unavailable;
 };
 
 /*
@@ -49,7 +49,59 @@
  * buf_addr is a pointer the the beginning of the preallocated buffer contiguous
  * address mapping. It is used only by RING_BUFFER_STATIC configuration. It can
  * be set to NULL for other backends.
+ *
+ * flags is a mask of RING_BUFFER_CHANNEL_* channel creation flags.
+ */
+
+/* (1U << 0) is reserved. */
+
+/*
+ * Allocate per-cpu buffers when their CPU first reserves space rather than
+ * at channel creation. Events hitting a buffer before its allocation
+ * completes are discarded, and accounted in the records_lost_unavailable
+ * counter of the buffer. Buffers which stay quiescent while no reader has
+ * them open are freed after lib_ring_buffer_lazy_reclaim_ms milliseconds.
+ * Only valid for per-cpu buffers which are not read through iterators.
+ */
+#define RING_BUFFER_CHANNEL_LAZY_ALLOC		(1U << 1)
+
+/*
+ * Periodically resize per-cpu buffers following their activity, within the
+ * size given at channel creation: buffers which discard events for lack of
+ * space grow back, buffers mostly left unused shrink. Resizing is applied by
+ * a work every lib_ring_buffer_resize_interval_ms milliseconds, which
+ * discards the events written meanwhile and accounts them in the
+ * records_lost_unavailable counter of the buffer. Only valid for per-cpu
+ * discard mode buffers read through splice: channel creation fails with
+ * -EINVAL for mmap output, as readers would keep mappings on freed pages.
  */
+#define RING_BUFFER_CHANNEL_AUTO_RESIZE		(1U << 2)
+
+/*
+ * Back off the switch timer of buffers left idle since their previous flush,
+ * up to 2^switch_timer_max_backoff times the switch timer period, rather
+ * than producing empty packets. Idle buffers are not flushed.
+ */
+#define RING_BUFFER_CHANNEL_ADAPTIVE_SWITCH_TIMER	(1U << 3)
+
+/*
+ * Populate mmap'd buffer mappings with every buffer page at mmap time rather
+ * than faulting them in one page at a time. Sub-buffer exchanges only move
+ * the reader mmap offset, so the mapping never faults afterwards. The whole
+ * buffer, rather than only the sub-buffers held by the reader, is then
+ * visible to the reader. Only valid for buffers read through mmap.
+ */
+#define RING_BUFFER_CHANNEL_MMAP_PREFAULT	(1U << 4)
+
+/*
+ * Compress each sub-buffer with LZ4 or zstd when the user-space reader gets
+ * it, in the reader context. The reader then reads the compressed packet through
+ * splice, or by mapping the compressed area, rather than the raw
+ * sub-buffer. Only one sub-buffer is handed over at a time. Only valid for
+ * buffers read through splice or mmap, and only one algorithm may be set.
+ */
+#define RING_BUFFER_CHANNEL_COMPRESS_LZ4	(1U << 5)
+#define RING_BUFFER_CHANNEL_COMPRESS_ZSTD	(1U << 6)
 
 extern
 struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kernel_ring_buffer_config *config,
@@ -57,7 +109,8 @@ struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kerne
 			       void *buf_addr,
 			       size_t subbuf_size, size_t num_subbuf,
 			       unsigned int switch_timer_interval,
-			       unsigned int read_timer_interval);
+			       unsigned int read_timer_interval,
+			       unsigned int flags);
 
 /*
  * channel_destroy returns the private data pointer. It finalizes all channel's
@@ -87,6 +140,17 @@ extern struct lttng_kernel_ring_buffer *channel_get_ring_buffer(
 extern int lib_ring_buffer_open_read(struct lttng_kernel_ring_buffer *buf);
 extern void lib_ring_buffer_release_read(struct lttng_kernel_ring_buffer *buf);
 
+/*
+ * In-kernel writeout of delivered sub-buffers to a file, using the reader
+ * role of the caller.
+ */
+extern int lib_ring_buffer_set_writeout(struct lttng_kernel_ring_buffer *buf, int fd);
+extern int lib_ring_buffer_stop_writeout(struct lttng_kernel_ring_buffer *buf);
+
+struct lttng_kernel_abi_ring_buffer_stats;
+extern void lib_ring_buffer_get_stats(struct lttng_kernel_ring_buffer *buf,
+				      struct lttng_kernel_abi_ring_buffer_stats *stats);
+
 /*
  * Read sequence: snapshot, many get_subbuf/put_subbuf, move_consumer.
  */
@@ -97,13 +161,53 @@ extern int lib_ring_buffer_snapshot_sample_positions(
 				    struct lttng_kernel_ring_buffer *buf,
 				    unsigned long *consumed,
 				    unsigned long *produced);
+extern int lib_ring_buffer_snapshot_since(struct lttng_kernel_ring_buffer *buf,
+					  unsigned long since,
+					  unsigned long *consumed,
+					  unsigned long *produced);
 extern void lib_ring_buffer_move_consumer(struct lttng_kernel_ring_buffer *buf,
 					  unsigned long consumed_new);
 
 extern int lib_ring_buffer_get_subbuf(struct lttng_kernel_ring_buffer *buf,
 				      unsigned long consumed);
+extern int lib_ring_buffer_get_subbuf_batch(struct lttng_kernel_ring_buffer *buf,
+					    unsigned long consumed,
+					    unsigned long *nr);
+/* Compress a sub-buffer got for user-space, released on error. */
+extern int lib_ring_buffer_compress_subbuf(struct lttng_kernel_ring_buffer *buf);
 extern void lib_ring_buffer_put_subbuf(struct lttng_kernel_ring_buffer *buf);
 
+/*
+ * Resize a buffer to num_subbuf sub-buffers, keeping the data not consumed
+ * yet. Fails with -EBUSY while the reader holds a sub-buffer. Not supported
+ * for buffers read through mmap.
+ */
+extern int lib_ring_buffer_resize(struct lttng_kernel_ring_buffer *buf,
+				  unsigned long num_subbuf);
+extern void lib_ring_buffer_resize_pending(struct lttng_kernel_ring_buffer *buf);
+
+/*
+ * Fetch and clear the set of cpus whose buffer had deliverable data since
+ * the last call. Per-cpu channels only.
+ */
+extern int lib_ring_buffer_channel_read_ready(struct lttng_kernel_ring_buffer_channel *chan,
+					      struct cpumask *mask);
+
+/*
+ * Wake up readers of RING_BUFFER_WAKEUP_BY_WRITER channels once watermark
+ * sub-buffers are ready, or after at most max_latency us.
+ */
+extern int lib_ring_buffer_channel_set_wakeup_watermark(struct lttng_kernel_ring_buffer_channel *chan,
+							unsigned long watermark,
+							unsigned int max_latency);
+
+/*
+ * Whether the data written to buf reaches the channel wakeup watermark, for
+ * clients waking up their own readers after commit.
+ */
+extern bool lib_ring_buffer_wakeup_watermark_due(const struct lttng_kernel_ring_buffer_config *config,
+						 struct lttng_kernel_ring_buffer *buf);
+
 void lib_ring_buffer_set_quiescent_channel(struct lttng_kernel_ring_buffer_channel *chan);
 void lib_ring_buffer_clear_quiescent_channel(struct lttng_kernel_ring_buffer_channel *chan);
 
@@ -130,6 +234,33 @@ static inline void lib_ring_buffer_put_next_subbuf(struct lttng_kernel_ring_buff
 						    buf->backend.chan));
 }
 
+/*
+ * Batched variants: get up to *nr consecutive sub-buffers, and release all
+ * of them at once.
+ */
+static inline int lib_ring_buffer_get_next_subbuf_batch(struct lttng_kernel_ring_buffer *buf,
+							unsigned long *nr)
+{
+	int ret;
+
+	ret = lib_ring_buffer_snapshot(buf, &buf->cons_snapshot,
+				       &buf->prod_snapshot);
+	if (ret)
+		return ret;
+	ret = lib_ring_buffer_get_subbuf_batch(buf, buf->cons_snapshot, nr);
+	return ret;
+}
+
+static inline void lib_ring_buffer_put_next_subbuf_batch(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	unsigned long nr = buf->get_subbuf_nr;
+
+	lib_ring_buffer_put_subbuf(buf);
+	lib_ring_buffer_move_consumer(buf, subbuf_align(buf->cons_snapshot
+			+ ((nr - 1) << chan->backend.subbuf_size_order), chan));
+}
+
 extern void channel_reset(struct lttng_kernel_ring_buffer_channel *chan);
 extern void lib_ring_buffer_reset(struct lttng_kernel_ring_buffer *buf);
 
@@ -223,6 +354,14 @@ unsigned long lib_ring_buffer_get_records_lost_big(
 	return ctx->priv.records_lost_big;
 }
 
+static inline
+unsigned long lib_ring_buffer_get_records_lost_unavailable(
+				const struct lttng_kernel_ring_buffer_config *config __attribute__((unused)),
+				const struct lttng_kernel_ring_buffer_ctx *ctx)
+{
+	return ctx->priv.records_lost_unavailable;
+}
+
 static inline
 unsigned long lib_ring_buffer_get_records_read(
 				const struct lttng_kernel_ring_buffer_config *config,
@@ -231,4 +370,19 @@ unsigned long lib_ring_buffer_get_records_read(
 	return v_read(config, &buf->backend.records_read);
 }
 
+/*
+ * Packet index record of sub-buffer @subbuf_idx, NULL if the buffer has no
+ * packet index. Written by the client from the buffer_end callback, with
+ * exclusive access to the sub-buffer.
+ */
+static inline
+void *lib_ring_buffer_packet_index(const struct lttng_kernel_ring_buffer_config *config,
+				   struct lttng_kernel_ring_buffer *buf,
+				   unsigned int subbuf_idx)
+{
+	if (!buf->index)
+		return NULL;
+	return (char *) buf->index + subbuf_idx * config->packet_index_size;
+}
+
 #endif /* _LIB_RING_BUFFER_FRONTEND_H */
@@ -89,7 +89,7 @@ int lib_ring_buffer_try_reserve(const struct lttng_kernel_ring_buffer_config *co
 	 * commit counter to increment it and commit seq value to compare it to
 	 * the commit counter.
 	 */
-	prefetch(&buf->commit_hot[subbuf_index(*o_begin, chan)]);
+	prefetch(&buf->commit_hot[subbuf_index(*o_begin, buf)]);
 
 	if (last_timestamp_overflow(config, buf, ctx->priv.timestamp))
 		ctx->priv.rflags |= RING_BUFFER_RFLAG_FULL_TIMESTAMP;
@@ -156,8 +156,18 @@ int lib_ring_buffer_reserve(const struct lttng_kernel_ring_buffer_config *config
 		buf = per_cpu_ptr(chan->backend.buf, ctx->priv.reserve_cpu);
 	else
 		buf = chan->backend.buf;
-	if (unlikely(atomic_read(&buf->record_disabled)))
+	if (unlikely(atomic_read(&buf->record_disabled))) {
+		/* Lazily allocated buffer not populated yet. */
+		if (config->alloc == RING_BUFFER_ALLOC_PER_CPU
+		    && unlikely(!buf->backend.allocated)) {
+			lib_ring_buffer_lazy_alloc_request(chan,
+					ctx->priv.reserve_cpu);
+			atomic_long_inc(&buf->records_lost_unavailable);
+		} else if (READ_ONCE(buf->resizing)) {
+			atomic_long_inc(&buf->records_lost_unavailable);
+		}
 		return -EAGAIN;
+	}
 	ctx->priv.buf = buf;
 
 	/*
@@ -178,6 +188,7 @@ int lib_ring_buffer_reserve(const struct lttng_kernel_ring_buffer_config *config
 	 * full timestamp record header when it would be needed).
 	 */
 	save_last_timestamp(config, ctx->priv.buf, ctx->priv.timestamp);
+	v_inc(config, &ctx->priv.buf->stats.reserve_fast);
 
 	/*
 	 * Push the reader if necessary
@@ -188,7 +199,7 @@ int lib_ring_buffer_reserve(const struct lttng_kernel_ring_buffer_config *config
 	 * Clear noref flag for this subbuffer.
 	 */
 	lib_ring_buffer_clear_noref(config, &ctx->priv.buf->backend,
-				subbuf_index(o_end - 1, chan));
+				subbuf_index(o_end - 1, buf));
 
 	ctx->priv.pre_offset = o_begin;
 	ctx->priv.buf_offset = o_begin + before_hdr_pad;
@@ -235,7 +246,7 @@ void lib_ring_buffer_commit(const struct lttng_kernel_ring_buffer_config *config
 	struct lttng_kernel_ring_buffer_channel *chan = ctx->priv.chan;
 	struct lttng_kernel_ring_buffer *buf = ctx->priv.buf;
 	unsigned long offset_end = ctx->priv.buf_offset;
-	unsigned long endidx = subbuf_index(offset_end - 1, chan);
+	unsigned long endidx = subbuf_index(offset_end - 1, buf);
 	unsigned long commit_count;
 	struct commit_counters_hot *cc_hot = &buf->commit_hot[endidx];
 
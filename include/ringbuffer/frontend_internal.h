@@ -15,30 +15,30 @@
 #include <ringbuffer/config.h>
 #include <ringbuffer/backend_types.h>
 #include <ringbuffer/frontend_types.h>
-#include <lttng/prio_heap.h>	/* For per-CPU read-side iterator */
+#include <lttng/loser_tree.h>	/* For per-CPU read-side iterator */
 
 /* Buffer offset macros */
 
 /* buf_trunc mask selects only the buffer number. */
 static inline
-unsigned long buf_trunc(unsigned long offset, struct lttng_kernel_ring_buffer_channel *chan)
+unsigned long buf_trunc(unsigned long offset, struct lttng_kernel_ring_buffer *buf)
 {
-	return offset & ~(chan->backend.buf_size - 1);
+	return offset & ~(buf->backend.buf_size - 1);
 
 }
 
 /* Select the buffer number value (counter). */
 static inline
-unsigned long buf_trunc_val(unsigned long offset, struct lttng_kernel_ring_buffer_channel *chan)
+unsigned long buf_trunc_val(unsigned long offset, struct lttng_kernel_ring_buffer *buf)
 {
-	return buf_trunc(offset, chan) >> chan->backend.buf_size_order;
+	return buf_trunc(offset, buf) >> buf->backend.buf_size_order;
 }
 
 /* buf_offset mask selects only the offset within the current buffer. */
 static inline
-unsigned long buf_offset(unsigned long offset, struct lttng_kernel_ring_buffer_channel *chan)
+unsigned long buf_offset(unsigned long offset, struct lttng_kernel_ring_buffer *buf)
 {
-	return offset & (chan->backend.buf_size - 1);
+	return offset & (buf->backend.buf_size - 1);
 }
 
 /* subbuf_offset mask selects the offset within the current subbuffer. */
@@ -65,9 +65,9 @@ unsigned long subbuf_align(unsigned long offset, struct lttng_kernel_ring_buffer
 
 /* subbuf_index returns the index of the current subbuffer within the buffer. */
 static inline
-unsigned long subbuf_index(unsigned long offset, struct lttng_kernel_ring_buffer_channel *chan)
+unsigned long subbuf_index(unsigned long offset, struct lttng_kernel_ring_buffer *buf)
 {
-	return buf_offset(offset, chan) >> chan->backend.subbuf_size_order;
+	return buf_offset(offset, buf) >> buf->backend.chan->backend.subbuf_size_order;
 }
 
 /*
@@ -134,10 +134,46 @@ int last_timestamp_overflow(const struct lttng_kernel_ring_buffer_config *config
 }
 #endif
 
+/*
+ * Check whether the current timestamp is more than bits bits away from the
+ * last timestamp, for record headers saving fewer than timestamp_bits bits
+ * of time value. Only 64-bit architectures keep the whole last timestamp, an
+ * overflow is always reported otherwise.
+ */
+static inline
+int last_timestamp_overflow_bits(const struct lttng_kernel_ring_buffer_config *config,
+		      struct lttng_kernel_ring_buffer *buf, u64 timestamp,
+		      unsigned int bits)
+{
+#if (BITS_PER_LONG == 64)
+	/* The last timestamp is not tracked. */
+	if (config->timestamp_bits == 0 || config->timestamp_bits == 64)
+		return 1;
+
+	if (unlikely((timestamp - v_read(config, &buf->last_timestamp)) >> bits))
+		return 1;
+	else
+		return 0;
+#else
+	return 1;
+#endif
+}
+
+extern
+bool lib_ring_buffer_compress_supported(enum lttng_kernel_ring_buffer_compress compress);
+extern
+int lib_ring_buffer_compress_alloc(struct lttng_kernel_ring_buffer *buf);
+extern
+void lib_ring_buffer_compress_free(struct lttng_kernel_ring_buffer *buf);
+
 extern
 int lib_ring_buffer_reserve_slow(struct lttng_kernel_ring_buffer_ctx *ctx,
 		void *client_ctx);
 
+extern
+void lib_ring_buffer_lazy_alloc_request(struct lttng_kernel_ring_buffer_channel *chan,
+		int cpu);
+
 extern
 void lib_ring_buffer_switch_slow(struct lttng_kernel_ring_buffer *buf,
 				 enum switch_mode mode);
@@ -180,7 +216,7 @@ void lib_ring_buffer_reserve_push_reader(struct lttng_kernel_ring_buffer *buf,
 		 */
 		if (unlikely(subbuf_trunc(offset, chan)
 			      - subbuf_trunc(consumed_old, chan)
-			     >= chan->backend.buf_size))
+			     >= buf->backend.buf_size))
 			consumed_new = subbuf_align(consumed_old, chan);
 		else
 			return;
@@ -256,12 +292,12 @@ int lib_ring_buffer_reserve_committed(const struct lttng_kernel_ring_buffer_conf
 	 */
 	do {
 		offset = v_read(config, &buf->offset);
-		idx = subbuf_index(offset, chan);
+		idx = subbuf_index(offset, buf);
 		commit_count = v_read(config, &buf->commit_hot[idx].cc);
 	} while (offset != v_read(config, &buf->offset));
 
-	return ((buf_trunc(offset, chan) >> chan->backend.num_subbuf_order)
-		     - (commit_count & chan->commit_count_mask) == 0);
+	return ((buf_trunc(offset, buf) >> buf->backend.num_subbuf_order)
+		     - (commit_count & buf->commit_count_mask) == 0);
 }
 
 /*
@@ -284,8 +320,8 @@ void lib_ring_buffer_check_deliver(const struct lttng_kernel_ring_buffer_config
 					 - chan->backend.subbuf_size;
 
 	/* Check if all commits have been done */
-	if (unlikely((buf_trunc(offset, chan) >> chan->backend.num_subbuf_order)
-		     - (old_commit_count & chan->commit_count_mask) == 0))
+	if (unlikely((buf_trunc(offset, buf) >> buf->backend.num_subbuf_order)
+		     - (old_commit_count & buf->commit_count_mask) == 0))
 		lib_ring_buffer_check_deliver_slow(config, buf, chan, offset,
 			commit_count, idx, ctx);
 }
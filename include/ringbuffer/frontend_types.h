@@ -13,10 +13,12 @@
 #define _LIB_RING_BUFFER_FRONTEND_TYPES_H
 
 #include <linux/kref.h>
+#include <linux/mutex.h>
 #include <linux/irq_work.h>
+#include <linux/workqueue.h>
 #include <ringbuffer/config.h>
 #include <ringbuffer/backend_types.h>
-#include <lttng/prio_heap.h>	/* For per-CPU read-side iterator */
+#include <lttng/loser_tree.h>	/* For per-CPU read-side iterator */
 #include <lttng/cpuhotplug.h>
 
 /*
@@ -27,8 +29,11 @@ enum switch_mode { SWITCH_ACTIVE, SWITCH_FLUSH };
 
 /* channel-level read-side iterator */
 struct channel_iter {
-	/* Prio heap of buffers. Lowest timestamps at the top. */
-	struct lttng_ptr_heap heap;	/* Heap of struct lttng_kernel_ring_buffer ptrs */
+	/*
+	 * Loser tree of buffers, one leaf per cpu. Lowest timestamp wins.
+	 */
+	struct lttng_loser_tree tree;	/* Tree of struct lttng_kernel_ring_buffer ptrs */
+	u64 winner_limit;		/* Runner-up timestamp */
 	struct list_head empty_head;	/* Empty buffers linked-list head */
 	int read_open;			/* Opened for reading ? */
 	u64 last_qs;			/* Last quiescent state timestamp */
@@ -43,17 +48,13 @@ struct channel_iter {
 /* channel: collection of per-cpu ring buffers. */
 struct lttng_kernel_ring_buffer_channel {
 	atomic_t record_disabled;
-	unsigned long commit_count_mask;	/*
-						 * Commit count mask, removing
-						 * the MSBs corresponding to
-						 * bits used to represent the
-						 * subbuffer index.
-						 */
 
 	struct channel_backend backend;		/* Associated backend */
 
 	unsigned long switch_timer_interval;	/* Buffer flush (jiffies) */
 	unsigned long read_timer_interval;	/* Reader wakeup (jiffies) */
+	unsigned long wakeup_watermark;		/* Ready sub-buffers before writer wakeup */
+	struct mutex wakeup_mutex;		/* Serializes watermark updates and finalize */
 #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,10,0))
 	struct lttng_cpuhp_node cpuhp_prepare;
 	struct lttng_cpuhp_node cpuhp_online;
@@ -72,6 +73,17 @@ struct lttng_kernel_ring_buffer_channel {
 	struct channel_iter iter;		/* Channel read-side iterator */
 	struct kref ref;			/* Reference count */
 	int been_active;			/* Tracing was started at least once */
+	/* Lazy per-cpu buffer allocation (RING_BUFFER_CHANNEL_LAZY_ALLOC) */
+	cpumask_var_t lazy_alloc_pending;	/* Buffers requested by writers */
+	struct irq_work lazy_alloc_irq_work;	/* Leave the tracing context */
+	struct work_struct lazy_alloc_work;	/* Allocate requested buffers */
+	struct delayed_work lazy_reclaim_work;	/* Free quiescent buffers */
+	struct mutex lazy_mutex;		/* Serializes allocation and reclaim */
+	struct delayed_work resize_work;	/* Sample buffer activity */
+	/* Channel-level read readiness (per-cpu channels) */
+	cpumask_var_t read_ready;		/* Buffers with deliverable data */
+	atomic_t read_ready_count;		/* Buffers marked in read_ready */
+	wait_queue_head_t read_ready_wait;	/* Readiness wait queue */
 };
 
 /* Per-subbuffer commit counters used on the hot path */
@@ -103,6 +115,35 @@ struct lttng_kernel_ring_buffer_iter {
 	unsigned int read_open:1;	/* Opened for reading ? */
 };
 
+/*
+ * Per-buffer hot-path statistics, always maintained. Counters wrap around
+ * at the width of a long, times are in tracer clock units.
+ */
+struct lttng_kernel_ring_buffer_stats {
+	union v_atomic reserve_fast;	/* Reservations done by the fast path */
+	union v_atomic reserve_slow;	/* Reservations done by the slow path */
+	union v_atomic reserve_slow_time;	/* Time spent in reserve slow path */
+	union v_atomic switch_slow;	/* Sub-buffer switches (timer, flush) */
+	union v_atomic deliver;		/* Sub-buffers delivered */
+	union v_atomic deliver_latency;	/* Sum of last reserve to delivery */
+	union v_atomic deliver_latency_max;	/* Peak last reserve to delivery */
+	union v_atomic fill_max;	/* Peak unconsumed bytes at delivery */
+};
+
+/* Compressed copy of the sub-buffer held by the reader */
+struct lttng_kernel_ring_buffer_compress_area {
+	void *data;			/* Compressed packet, mapped by readers */
+	size_t len;			/* Length of the data area */
+	unsigned long size;		/* Compressed packet size */
+	unsigned long raw_size;		/* Uncompressed packet size */
+	void *src;			/* Linear copy of the packet (page backend) */
+	void *wrkmem;			/* Compressor workspace */
+	void *cctx;			/* Compressor context within wrkmem */
+};
+
+/* In-kernel writeout state, private to ring_buffer_writeout.c */
+struct lttng_kernel_ring_buffer_writeout;
+
 /* ring buffer state */
 struct lttng_kernel_ring_buffer {
 	/* First 32 bytes cache-hot cacheline */
@@ -118,6 +159,13 @@ struct lttng_kernel_ring_buffer {
 	union v_atomic last_timestamp;	/*
 					 * Last timestamp written in the buffer.
 					 */
+	unsigned long commit_count_mask;	/*
+						 * Commit count mask, removing
+						 * the MSBs corresponding to
+						 * bits used to represent the
+						 * subbuffer index. Follows the
+						 * buffer geometry.
+						 */
 
 	struct lttng_kernel_ring_buffer_backend backend;	/* Associated backend */
 
@@ -145,19 +193,45 @@ struct lttng_kernel_ring_buffer {
 	union v_atomic records_lost_full;	/* Buffer full */
 	union v_atomic records_lost_wrap;	/* Nested wrap-around */
 	union v_atomic records_lost_big;	/* Events too big */
+	atomic_long_t records_lost_unavailable;	/*
+					 * Buffer not allocated yet or
+					 * being resized, kept across
+					 * lazy (re)allocations
+					 */
 	union v_atomic records_count;	/* Number of records written */
 	union v_atomic records_overrun;	/* Number of overwritten records */
+	struct lttng_kernel_ring_buffer_stats stats;	/* Hot-path statistics */
 	wait_queue_head_t read_wait;	/* reader buffer-level wait queue */
 	wait_queue_head_t write_wait;	/* writer buffer-level wait queue (for metadata only) */
 	struct irq_work wakeup_pending;		/* Pending wakeup irq work */
 	int finalized;			/* buffer has been finalized */
 	struct timer_list switch_timer;	/* timer for periodical switch */
+	struct irq_work switch_timer_rearm;	/* Back to the switch timer base period */
 	struct timer_list read_timer;	/* timer for read poll */
 	raw_spinlock_t raw_tick_nohz_spinlock;	/* nohz entry lock/trylock */
 	struct lttng_kernel_ring_buffer_iter iter;	/* read-side iterator */
+	struct lttng_kernel_abi_ring_buffer_control *control;
+					/* Read-only area mapped by readers */
+	struct lttng_kernel_ring_buffer_compress_area *compress;
+					/* Compressed sub-buffer for readers */
+	void *index;			/* Packet index records, read-only for readers */
+	struct lttng_kernel_ring_buffer_writeout *writeout;
+					/* In-kernel writeout to a file */
 	unsigned long get_subbuf_consumed;	/* Read-side consumed */
+	unsigned long get_subbuf_nr;	/* Sub-buffers held by reader */
 	unsigned long prod_snapshot;	/* Producer count snapshot */
 	unsigned long cons_snapshot;	/* Consumer count snapshot */
+	struct mutex resize_mutex;	/*
+					 * Excludes resize from the reader
+					 * sub-buffer exchanges and remote
+					 * switches
+					 */
+	unsigned long lazy_reclaim_offset;	/* Offset at last reclaim scan */
+	unsigned long resize_lost_full;	/* Lost events at last resize sample */
+	unsigned long resize_offset;	/* Offset at last resize sample */
+	int resizing;			/* Writers held off by a resize */
+	unsigned long switch_timer_offset;	/* Offset at last adaptive flush */
+	unsigned int switch_timer_backoff;	/* Adaptive switch timer period shift */
 	unsigned int get_subbuf:1,	/* Sub-buffer being held by reader */
 		switch_timer_enabled:1,	/* Protected by ring_buffer_nohz_lock */
 		read_timer_enabled:1,	/* Protected by ring_buffer_nohz_lock */
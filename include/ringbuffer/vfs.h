@@ -12,6 +12,7 @@
 
 #include <linux/fs.h>
 #include <linux/poll.h>
+#include <linux/types.h>
 
 /* VFS API */
 
@@ -22,6 +23,7 @@ extern const struct file_operations lib_ring_buffer_file_operations;
  */
 
 struct lttng_kernel_ring_buffer;
+struct lttng_kernel_ring_buffer_channel;
 
 int lib_ring_buffer_open(struct inode *inode, struct file *file,
 		struct lttng_kernel_ring_buffer *buf);
@@ -34,6 +36,11 @@ ssize_t lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 		unsigned int flags, struct lttng_kernel_ring_buffer *buf);
 int lib_ring_buffer_mmap(struct file *filp, struct vm_area_struct *vma,
 		struct lttng_kernel_ring_buffer *buf);
+size_t lib_ring_buffer_control_len(struct lttng_kernel_ring_buffer_channel *chan);
+unsigned long lib_ring_buffer_control_mmap_offset(struct lttng_kernel_ring_buffer *buf);
+size_t lib_ring_buffer_index_len(struct lttng_kernel_ring_buffer_channel *chan);
+unsigned long lib_ring_buffer_index_mmap_offset(struct lttng_kernel_ring_buffer *buf);
+unsigned long lib_ring_buffer_compress_mmap_offset(struct lttng_kernel_ring_buffer *buf);
 
 /* Ring Buffer ioctl() and ioctl numbers */
 long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
@@ -68,7 +75,83 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
  *
  * Note that the "snapshot" API can be used to read the sub-buffer in reverse
  * order, which is useful for flight recorder snapshots.
+ *
+ * LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT_SINCE takes the produced position of
+ * a previous snapshot and narrows the range to the sub-buffers produced
+ * since then, for incremental flight recorder snapshots.
+ *
+ * The control area, mapped read-only at the offset returned by
+ * LTTNG_KERNEL_ABI_RING_BUFFER_GET_CONTROL_MMAP_OFFSET, describes delivered
+ * packets without system calls. Sub-buffer ownership is still taken and
+ * released with the ioctls above.
+ *
+ * Clients may also keep a packet index, mapped read-only at the offset
+ * returned by LTTNG_KERNEL_ABI_RING_BUFFER_GET_INDEX_MMAP_OFFSET. It holds
+ * one client-defined record per sub-buffer: the record of the packet
+ * beginning at position "pos" is the slot (pos / subbuf_size) % num_subbuf,
+ * num_subbuf being the current number of sub-buffers of the buffer.
+ */
+
+/*
+ * Delivered packet descriptor. The slot of the packet beginning at position
+ * "pos" is (pos / subbuf_size) % num_packets. "position" is ~0 while the
+ * slot is being updated: readers should read it before and after the other
+ * fields, and only use them if both reads match the position they expect.
+ * All fields are 64-bit so the layout is the same for 32-bit readers.
+ */
+struct lttng_kernel_abi_ring_buffer_packet {
+	uint64_t position;		/* Position of the packet start */
+	uint64_t data_size;		/* Data size, without padding */
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t seq_num;		/* Packet sequence number */
+};
+
+/*
+ * Control area header. The counters are advisory snapshots, not a
+ * consistent view: "produced" and the lost records counters are published
+ * by each delivery, and concurrent deliveries may publish them out of
+ * order, so "produced" can briefly go backwards. "consumed" is published by
+ * the reader as it releases sub-buffers, and never goes backwards, but does
+ * not follow a writer pushing the reader in overwrite mode. Readers which
+ * cannot load 64-bit fields atomically (32-bit readers of a 64-bit kernel)
+ * may observe torn values, and should read a counter until two consecutive
+ * loads match. LTTNG_KERNEL_ABI_RING_BUFFER_GET_STATS returns the lost records
+ * counters through a system call instead.
+ */
+struct lttng_kernel_abi_ring_buffer_control {
+	uint64_t produced;		/* Writer position at a recent delivery */
+	uint64_t consumed;		/* Consumer position */
+	uint64_t subbuf_size;
+	uint64_t num_packets;		/* Number of packet slots */
+	uint64_t records_lost_full;	/* Lost records, buffer full */
+	uint64_t records_lost_wrap;	/* Lost records, nested wrap-around */
+	uint64_t records_lost_big;	/* Lost records, too big */
+	uint64_t records_lost_unavailable;	/* Lost records, buffer not allocated or resized */
+	struct lttng_kernel_abi_ring_buffer_packet packets[];
+};
+
+/*
+ * Buffer statistics, cumulative since the buffer was created or last
+ * cleared. Counters wrap around at the kernel long width, times are in
+ * tracer clock units (nanoseconds for the default clock). The delivery
+ * latency is the time between the last reservation in a sub-buffer and its
+ * delivery to readers, which grows when writers are slow to commit.
  */
+struct lttng_kernel_abi_ring_buffer_stats {
+	uint64_t reserve_fast;		/* Reservations done by the fast path */
+	uint64_t reserve_slow;		/* Reservations done by the slow path */
+	uint64_t reserve_slow_time;	/* Time spent in the reserve slow path */
+	uint64_t switch_slow;		/* Sub-buffer switches (timer, flush) */
+	uint64_t deliver;		/* Sub-buffers delivered */
+	uint64_t deliver_latency;	/* Sum of delivery latencies */
+	uint64_t deliver_latency_max;	/* Largest delivery latency */
+	uint64_t fill_max;		/* Peak unconsumed bytes at delivery */
+	uint64_t records_lost_full;	/* Lost records, buffer full */
+	uint64_t records_lost_wrap;	/* Lost records, nested wrap-around */
+	uint64_t records_lost_big;	/* Lost records, too big */
+	uint64_t records_lost_unavailable;	/* Lost records, buffer not allocated or resized */
+};
 
 /* Get a snapshot of the current ring buffer producer and consumer positions */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT			_IO(0xF6, 0x00)
@@ -120,6 +203,41 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
  * sub-buffer (can be parsed).
  */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF_METADATA_CHECK	_IOR(0xF6, 0x12, uint32_t)
+/* returns the current number of sub-buffers of the buffer. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_NUM_SUBBUF		_IOR(0xF6, 0x13, unsigned long)
+/*
+ * Resize the buffer to the given number of sub-buffers, keeping unconsumed
+ * data. Only for splice readers not holding a sub-buffer.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_SET_NUM_SUBBUF		_IOW(0xF6, 0x14, unsigned long)
+/* returns the mmap offset of the read-only control area. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_CONTROL_MMAP_OFFSET	_IOR(0xF6, 0x15, unsigned long)
+/* returns the length of the control area to mmap. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_CONTROL_MMAP_LEN	_IOR(0xF6, 0x16, unsigned long)
+/* returns the size of the current compressed sub-buffer. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_SUBBUF_SIZE	_IOR(0xF6, 0x17, unsigned long)
+/* returns the mmap offset of the compressed sub-buffer area. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_MMAP_OFFSET	_IOR(0xF6, 0x18, unsigned long)
+/* returns the length of the compressed sub-buffer area to mmap. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_MMAP_LEN	_IOR(0xF6, 0x19, unsigned long)
+/* returns the mmap offset of the read-only packet index. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_INDEX_MMAP_OFFSET	_IOR(0xF6, 0x1A, unsigned long)
+/* returns the length of the packet index to mmap. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_INDEX_MMAP_LEN		_IOR(0xF6, 0x1B, unsigned long)
+/*
+ * Get a snapshot of the sub-buffers produced since the given produced
+ * position of a previous snapshot.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT_SINCE		_IOW(0xF6, 0x1C, unsigned long)
+/*
+ * Write delivered sub-buffers to the given file descriptor from the kernel,
+ * or stop doing so if the file descriptor is negative. Other reader ioctls
+ * fail with -EBUSY while writeout is set.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_SET_WRITEOUT_FD		_IOW(0xF6, 0x1D, int)
+/* Get the buffer statistics. Also allowed while writeout is set. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_GET_STATS			\
+	_IOR(0xF6, 0x1E, struct lttng_kernel_abi_ring_buffer_stats)
 
 #ifdef CONFIG_COMPAT
 /* Get a snapshot of the current ring buffer producer and consumer positions */
@@ -174,6 +292,43 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
  */
 #define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_NEXT_SUBBUF_METADATA_CHECK \
 	LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF_METADATA_CHECK
+/* returns the current number of sub-buffers of the buffer. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_NUM_SUBBUF	_IOR(0xF6, 0x13, compat_ulong_t)
+/* Resize the buffer to the given number of sub-buffers. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SET_NUM_SUBBUF	_IOW(0xF6, 0x14, compat_ulong_t)
+/* returns the mmap offset of the read-only control area. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_CONTROL_MMAP_OFFSET \
+	_IOR(0xF6, 0x15, compat_ulong_t)
+/* returns the length of the control area to mmap. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_CONTROL_MMAP_LEN \
+	_IOR(0xF6, 0x16, compat_ulong_t)
+/* returns the size of the current compressed sub-buffer. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_COMPRESSED_SUBBUF_SIZE \
+	_IOR(0xF6, 0x17, compat_ulong_t)
+/* returns the mmap offset of the compressed sub-buffer area. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_COMPRESSED_MMAP_OFFSET \
+	_IOR(0xF6, 0x18, compat_ulong_t)
+/* returns the length of the compressed sub-buffer area to mmap. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_COMPRESSED_MMAP_LEN \
+	_IOR(0xF6, 0x19, compat_ulong_t)
+/* returns the mmap offset of the read-only packet index. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_INDEX_MMAP_OFFSET \
+	_IOR(0xF6, 0x1A, compat_ulong_t)
+/* returns the length of the packet index to mmap. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_INDEX_MMAP_LEN \
+	_IOR(0xF6, 0x1B, compat_ulong_t)
+/*
+ * Get a snapshot of the sub-buffers produced since the given produced
+ * position of a previous snapshot.
+ */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SNAPSHOT_SINCE \
+	_IOW(0xF6, 0x1C, compat_ulong_t)
+/* Write delivered sub-buffers to the given file descriptor from the kernel. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SET_WRITEOUT_FD \
+	LTTNG_KERNEL_ABI_RING_BUFFER_SET_WRITEOUT_FD
+/* Get the buffer statistics. */
+#define LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_STATS \
+	LTTNG_KERNEL_ABI_RING_BUFFER_GET_STATS
 #endif /* CONFIG_COMPAT */
 
 #endif /* _LIB_LTTNG_KERNEL_ABI_RING_BUFFER_VFS_H */
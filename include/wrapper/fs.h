@@ -19,6 +19,12 @@ ssize_t lttng_kernel_read(struct file *file, void *buf, size_t count, loff_t *po
 	return kernel_read(file, buf, count, pos);
 }
 
+static inline
+ssize_t lttng_kernel_write(struct file *file, const void *buf, size_t count, loff_t *pos)
+{
+	return kernel_write(file, buf, count, pos);
+}
+
 #else /* LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,14,0) */
 
 static inline
@@ -38,6 +44,23 @@ ssize_t lttng_kernel_read(struct file *file, void *buf, size_t count, loff_t *po
 	return len;
 }
 
+static inline
+ssize_t lttng_kernel_write(struct file *file, const void *buf, size_t count, loff_t *pos)
+{
+	ssize_t len;
+
+	len = kernel_write(file, buf, count, *pos);
+
+	/*
+	 * Move 'pos' forward since it's passed by value in this
+	 * implementation of 'kernel_write'.
+	 */
+	if (len > 0)
+		(*pos) += len;
+
+	return len;
+}
+
 #endif /* LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,14,0) */
 
 #endif /* _LTTNG_WRAPPER_FS_H */
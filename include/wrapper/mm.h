@@ -21,6 +21,13 @@ void wrapper_vm_flags_set(struct vm_area_struct *vma,
 {
 	vm_flags_set(vma, flags);
 }
+
+static inline
+void wrapper_vm_flags_clear(struct vm_area_struct *vma,
+		vm_flags_t flags)
+{
+	vm_flags_clear(vma, flags);
+}
 #else
 static inline
 void wrapper_vm_flags_set(struct vm_area_struct *vma,
@@ -28,6 +35,13 @@ void wrapper_vm_flags_set(struct vm_area_struct *vma,
 {
 	vma->vm_flags |= flags;
 }
+
+static inline
+void wrapper_vm_flags_clear(struct vm_area_struct *vma,
+		vm_flags_t flags)
+{
+	vma->vm_flags &= ~flags;
+}
 #endif
 
 #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,6,0) \
@@ -57,4 +71,33 @@ bool wrapper_check_enough_free_pages(unsigned long num_pages)
 }
 #endif
 
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,8,0))
+static inline
+int wrapper_vm_insert_pages(struct vm_area_struct *vma, unsigned long addr,
+		struct page **pages, unsigned long *num)
+{
+	return vm_insert_pages(vma, addr, pages, num);
+}
+#else
+/*
+ * vm_insert_pages() is not available on this kernel, insert the pages one at
+ * a time. On return, *num holds the number of pages left to insert.
+ */
+static inline
+int wrapper_vm_insert_pages(struct vm_area_struct *vma, unsigned long addr,
+		struct page **pages, unsigned long *num)
+{
+	unsigned long i;
+	int ret = 0;
+
+	for (i = 0; i < *num; i++) {
+		ret = vm_insert_page(vma, addr + (i << PAGE_SHIFT), pages[i]);
+		if (ret)
+			break;
+	}
+	*num -= i;
+	return ret;
+}
+#endif
+
 #endif /* _LTTNG_WRAPPER_MM_H */
@@ -33,6 +33,9 @@
 #define lttng_mod_timer_pinned(timer, expires) \
 	mod_timer(timer, expires)
 
+#define lttng_mod_timer_pending_pinned(timer, expires) \
+	mod_timer_pending(timer, expires)
+
 #define lttng_from_timer(var, callback_timer, timer_fieldname) \
 	from_timer(var, callback_timer, timer_fieldname)
 
@@ -52,6 +55,9 @@
 #define lttng_mod_timer_pinned(timer, expires) \
 	mod_timer(timer, expires)
 
+#define lttng_mod_timer_pending_pinned(timer, expires) \
+	mod_timer_pending(timer, expires)
+
 # else /* LTTNG_RT_VERSION_CODE >= LTTNG_RT_KERNEL_VERSION(4,6,4,8) */
 
 #define lttng_init_timer_pinned(timer) \
@@ -60,6 +66,13 @@
 #define lttng_mod_timer_pinned(timer, expires) \
 	mod_timer_pinned(timer, expires)
 
+/*
+ * mod_timer_pending() does not keep timers pinned before 4.8: leave the
+ * timer to expire as planned.
+ */
+#define lttng_mod_timer_pending_pinned(timer, expires) \
+	({ (void) (timer); (void) (expires); 0; })
+
 # endif /* LTTNG_RT_VERSION_CODE >= LTTNG_RT_KERNEL_VERSION(4,6,4,8) */
 
 
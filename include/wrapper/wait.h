@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: (GPL-2.0-only or LGPL-2.1-only)
+ *
+ * wrapper/wait.h
+ */
+
+#ifndef _LTTNG_WRAPPER_WAIT_H
+#define _LTTNG_WRAPPER_WAIT_H
+
+#include <linux/wait.h>
+#include <lttng/kernel-version.h>
+
+/*
+ * wait_queue_t was renamed to struct wait_queue_entry in Linux 4.13.
+ */
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,13,0))
+typedef struct wait_queue_entry lttng_wait_queue_entry_t;
+#else
+typedef wait_queue_t lttng_wait_queue_entry_t;
+#endif
+
+#endif /* _LTTNG_WRAPPER_WAIT_H */
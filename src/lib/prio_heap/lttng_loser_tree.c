@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng_loser_tree.c
+ *
+ * Tournament tree of losers for k-way merges. Based on Knuth, TAOCP vol. 3,
+ * section 5.4.1.
+ *
+ * Leaf i is at position nr_leaves + i of the implicit tree, internal nodes
+ * at positions 1 to nr_leaves - 1, and the parent of position p is p / 2.
+ */
+
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <lttng/loser_tree.h>
+#include <wrapper/vmalloc.h>
+
+/*
+ * Empty leaves lose against any element.
+ */
+static
+bool leaf_beats(const struct lttng_loser_tree *tree, unsigned int a,
+		unsigned int b)
+{
+	void *pa = tree->leaves[a], *pb = tree->leaves[b];
+
+	if (!pa)
+		return false;
+	if (!pb)
+		return true;
+	return tree->gt(pa, pb);
+}
+
+static
+void loser_tree_rebuild(struct lttng_loser_tree *tree)
+{
+	size_t n = tree->nr_leaves, pos;
+
+	for (pos = n - 1; pos >= 1; pos--) {
+		size_t l = pos << 1, r = (pos << 1) + 1;
+		unsigned int wl, wr;
+
+		wl = l >= n ? l - n : tree->winners[l];
+		wr = r >= n ? r - n : tree->winners[r];
+		if (leaf_beats(tree, wr, wl)) {
+			tree->winners[pos] = wr;
+			tree->nodes[pos] = wl;
+		} else {
+			tree->winners[pos] = wl;
+			tree->nodes[pos] = wr;
+		}
+	}
+	tree->nodes[0] = n > 1 ? tree->winners[1] : 0;
+}
+
+int lttng_loser_tree_init(struct lttng_loser_tree *tree, size_t nr_leaves,
+		gfp_t gfpmask, int gt(void *a, void *b))
+{
+	memset(tree, 0, sizeof(*tree));
+	tree->nr_leaves = roundup_pow_of_two(max_t(size_t, nr_leaves, 1));
+	tree->gt = gt;
+	tree->leaves = lttng_kvzalloc(tree->nr_leaves * sizeof(void *), gfpmask);
+	tree->nodes = lttng_kvzalloc(tree->nr_leaves * sizeof(unsigned int), gfpmask);
+	tree->winners = lttng_kvzalloc(tree->nr_leaves * sizeof(unsigned int), gfpmask);
+	if (!tree->leaves || !tree->nodes || !tree->winners) {
+		lttng_loser_tree_free(tree);
+		return -ENOMEM;
+	}
+	loser_tree_rebuild(tree);
+	return 0;
+}
+
+void lttng_loser_tree_free(struct lttng_loser_tree *tree)
+{
+	lttng_kvfree(tree->leaves);
+	lttng_kvfree(tree->nodes);
+	lttng_kvfree(tree->winners);
+	memset(tree, 0, sizeof(*tree));
+}
+
+void lttng_loser_tree_set(struct lttng_loser_tree *tree, size_t leaf, void *p)
+{
+	WARN_ON_ONCE(leaf >= tree->nr_leaves);
+	tree->leaves[leaf] = p;
+	loser_tree_rebuild(tree);
+}
+
+void lttng_loser_tree_replace_winner(struct lttng_loser_tree *tree, void *p)
+{
+	unsigned int winner = tree->nodes[0];
+	size_t pos;
+
+	tree->leaves[winner] = p;
+	for (pos = (tree->nr_leaves + winner) >> 1; pos >= 1; pos >>= 1) {
+		unsigned int loser = tree->nodes[pos];
+
+		if (leaf_beats(tree, loser, winner)) {
+			tree->nodes[pos] = winner;
+			winner = loser;
+		}
+	}
+	tree->nodes[0] = winner;
+}
+
+void *lttng_loser_tree_runner_up(const struct lttng_loser_tree *tree)
+{
+	unsigned int winner = tree->nodes[0];
+	void *runner_up = NULL;
+	size_t pos;
+
+	/*
+	 * The runner-up only lost against the winner, which it met on the
+	 * winner path.
+	 */
+	for (pos = (tree->nr_leaves + winner) >> 1; pos >= 1; pos >>= 1) {
+		void *p = tree->leaves[tree->nodes[pos]];
+
+		if (p && (!runner_up || tree->gt(p, runner_up)))
+			runner_up = p;
+	}
+	return runner_up;
+}
@@ -22,28 +22,24 @@
 #include <ringbuffer/backend.h>
 #include <ringbuffer/frontend.h>
 
-/**
- * lib_ring_buffer_backend_allocate - allocate a channel buffer
- * @config: ring buffer instance configuration
- * @buf: the buffer struct
- * @size: total size of the buffer
- * @num_subbuf: number of subbuffers
- * @extra_reader_sb: need extra subbuffer for reader
+/*
+ * Allocate @count sub-buffers and their pages into @array, starting at index
+ * @first. In the mmap area, sub-buffers are laid out following their index.
  */
 static
-int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_config *config,
-				     struct lttng_kernel_ring_buffer_backend *bufb,
-				     size_t size, size_t num_subbuf,
-				     int extra_reader_sb)
+int lib_ring_buffer_backend_alloc_subbufs(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer_backend *bufb,
+		struct lttng_kernel_ring_buffer_backend_pages **array,
+		unsigned long first, unsigned long count)
 {
 	struct channel_backend *chanb = &bufb->chan->backend;
-	unsigned long j, num_pages, num_pages_per_subbuf, page_idx = 0;
-	unsigned long subbuf_size, mmap_offset = 0;
-	unsigned long num_subbuf_alloc;
+	unsigned long num_pages, num_pages_per_subbuf, page_idx = 0;
+	int node = cpu_to_node(max(bufb->cpu, 0));
 	struct page **pages;
-	unsigned long i;
+	unsigned long i, j;
 
-	num_pages = size >> PAGE_SHIFT;
+	num_pages_per_subbuf = chanb->subbuf_size >> PAGE_SHIFT;
+	num_pages = num_pages_per_subbuf * count;
 
 	/*
 	 * Verify that there is enough free pages available on the system for
@@ -63,51 +59,141 @@ int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_confi
 	 */
 	set_current_oom_origin();
 
-	num_pages_per_subbuf = num_pages >> get_count_order(num_subbuf);
-	subbuf_size = chanb->subbuf_size;
-	num_subbuf_alloc = num_subbuf;
-
-	if (extra_reader_sb) {
-		num_pages += num_pages_per_subbuf; /* Add pages for reader */
-		num_subbuf_alloc++;
-	}
-
-	pages = vmalloc_node(ALIGN(sizeof(*pages) * num_pages,
-				   1 << INTERNODE_CACHE_SHIFT),
-			cpu_to_node(max(bufb->cpu, 0)));
+	pages = vzalloc_node(ALIGN(sizeof(*pages) * num_pages,
+				   1 << INTERNODE_CACHE_SHIFT), node);
 	if (unlikely(!pages))
 		goto pages_error;
 
-	bufb->array = lttng_kvmalloc_node(ALIGN(sizeof(*bufb->array)
-					 * num_subbuf_alloc,
-				  1 << INTERNODE_CACHE_SHIFT),
-			GFP_KERNEL | __GFP_NOWARN,
-			cpu_to_node(max(bufb->cpu, 0)));
-	if (unlikely(!bufb->array))
-		goto array_error;
-
 	for (i = 0; i < num_pages; i++) {
-		pages[i] = alloc_pages_node(cpu_to_node(max(bufb->cpu, 0)),
+		pages[i] = alloc_pages_node(node,
 				GFP_KERNEL | __GFP_NOWARN | __GFP_ZERO, 0);
 		if (unlikely(!pages[i]))
 			goto depopulate;
 	}
-	bufb->num_pages_per_subbuf = num_pages_per_subbuf;
 
 	/* Allocate backend pages array elements */
-	for (i = 0; i < num_subbuf_alloc; i++) {
-		bufb->array[i] =
+	for (i = first; i < first + count; i++) {
+		array[i] =
 			lttng_kvzalloc_node(ALIGN(
 				sizeof(struct lttng_kernel_ring_buffer_backend_pages) +
 				sizeof(struct lttng_kernel_ring_buffer_backend_page)
 				* num_pages_per_subbuf,
 				1 << INTERNODE_CACHE_SHIFT),
-				GFP_KERNEL | __GFP_NOWARN,
-				cpu_to_node(max(bufb->cpu, 0)));
-		if (!bufb->array[i])
+				GFP_KERNEL | __GFP_NOWARN, node);
+		if (!array[i])
 			goto free_array;
 	}
 
+	/* Assign pages to page index */
+	for (i = first; i < first + count; i++) {
+		struct page **sb_pages = &pages[page_idx];
+
+		for (j = 0; j < num_pages_per_subbuf; j++) {
+			CHAN_WARN_ON(chanb, page_idx > num_pages);
+			array[i]->p[j].virt = page_address(pages[page_idx]);
+			array[i]->p[j].pfn = page_to_pfn(pages[page_idx]);
+			page_idx++;
+		}
+		if (config->output == RING_BUFFER_MMAP)
+			array[i]->mmap_offset = i * chanb->subbuf_size;
+		if (config->backend == RING_BUFFER_VMAP) {
+			/*
+			 * Map the sub-buffer pages contiguously so writers
+			 * never have to deal with page boundaries.
+			 */
+			array[i]->vaddr = vmap(sb_pages, num_pages_per_subbuf,
+					       VM_MAP, PAGE_KERNEL);
+			if (unlikely(!array[i]->vaddr))
+				goto free_vmap;
+		}
+	}
+
+	/*
+	 * If kmalloc ever uses vmalloc underneath, make sure the buffer pages
+	 * will not fault.
+	 */
+	wrapper_vmalloc_sync_mappings();
+	clear_current_oom_origin();
+	vfree(pages);
+	return 0;
+
+free_vmap:
+	for (i = first; i < first + count; i++) {
+		if (array[i]->vaddr)
+			vunmap(array[i]->vaddr);
+	}
+free_array:
+	for (i = first; (i < first + count && array[i]); i++)
+		lttng_kvfree(array[i]);
+depopulate:
+	/* Free all allocated pages */
+	for (i = 0; (i < num_pages && pages[i]); i++)
+		__free_page(pages[i]);
+	vfree(pages);
+pages_error:
+	clear_current_oom_origin();
+not_enough_pages:
+	return -ENOMEM;
+}
+
+static
+void lib_ring_buffer_backend_free_subbuf(struct lttng_kernel_ring_buffer_backend *bufb,
+		struct lttng_kernel_ring_buffer_backend_pages *pages)
+{
+	unsigned long j;
+
+	if (pages->vaddr)
+		vunmap(pages->vaddr);
+	for (j = 0; j < bufb->num_pages_per_subbuf; j++)
+		__free_page(pfn_to_page(pages->p[j].pfn));
+	lttng_kvfree(pages);
+}
+
+static
+void lib_ring_buffer_backend_set_geometry(struct lttng_kernel_ring_buffer_backend *bufb,
+		unsigned long num_subbuf)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+
+	bufb->num_subbuf = num_subbuf;
+	bufb->num_subbuf_order = get_count_order(num_subbuf);
+	bufb->buf_size = num_subbuf * chanb->subbuf_size;
+	bufb->buf_size_order = get_count_order(bufb->buf_size);
+}
+
+/**
+ * lib_ring_buffer_backend_allocate - allocate a channel buffer
+ * @config: ring buffer instance configuration
+ * @buf: the buffer struct
+ * @num_subbuf: number of subbuffers
+ * @extra_reader_sb: need extra subbuffer for reader
+ */
+static
+int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_config *config,
+				     struct lttng_kernel_ring_buffer_backend *bufb,
+				     size_t num_subbuf, int extra_reader_sb)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	unsigned long num_subbuf_alloc;
+	unsigned long i;
+
+	num_subbuf_alloc = num_subbuf;
+	if (extra_reader_sb)
+		num_subbuf_alloc++;	/* Add a sub-buffer for the reader */
+
+	bufb->array = lttng_kvmalloc_node(ALIGN(sizeof(*bufb->array)
+					 * num_subbuf_alloc,
+				  1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN,
+			cpu_to_node(max(bufb->cpu, 0)));
+	if (unlikely(!bufb->array))
+		goto array_error;
+
+	bufb->num_pages_per_subbuf = chanb->subbuf_size >> PAGE_SHIFT;
+	if (lib_ring_buffer_backend_alloc_subbufs(config, bufb, bufb->array,
+						  0, num_subbuf_alloc))
+		goto free_array;
+
 	/* Allocate write-side subbuffer table */
 	bufb->buf_wsb = lttng_kvzalloc_node(ALIGN(
 				sizeof(struct lttng_kernel_ring_buffer_backend_subbuffer)
@@ -116,7 +202,7 @@ int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_confi
 				GFP_KERNEL | __GFP_NOWARN,
 				cpu_to_node(max(bufb->cpu, 0)));
 	if (unlikely(!bufb->buf_wsb))
-		goto free_array;
+		goto free_subbufs;
 
 	for (i = 0; i < num_subbuf; i++)
 		bufb->buf_wsb[i].id = subbuffer_id(config, 0, 1, i);
@@ -138,44 +224,17 @@ int lib_ring_buffer_backend_allocate(const struct lttng_kernel_ring_buffer_confi
 	if (unlikely(!bufb->buf_cnt))
 		goto free_wsb;
 
-	/* Assign pages to page index */
-	for (i = 0; i < num_subbuf_alloc; i++) {
-		for (j = 0; j < num_pages_per_subbuf; j++) {
-			CHAN_WARN_ON(chanb, page_idx > num_pages);
-			bufb->array[i]->p[j].virt = page_address(pages[page_idx]);
-			bufb->array[i]->p[j].pfn = page_to_pfn(pages[page_idx]);
-			page_idx++;
-		}
-		if (config->output == RING_BUFFER_MMAP) {
-			bufb->array[i]->mmap_offset = mmap_offset;
-			mmap_offset += subbuf_size;
-		}
-	}
-
-	/*
-	 * If kmalloc ever uses vmalloc underneath, make sure the buffer pages
-	 * will not fault.
-	 */
-	wrapper_vmalloc_sync_mappings();
-	clear_current_oom_origin();
-	vfree(pages);
+	lib_ring_buffer_backend_set_geometry(bufb, num_subbuf);
 	return 0;
 
 free_wsb:
 	lttng_kvfree(bufb->buf_wsb);
+free_subbufs:
+	for (i = 0; i < num_subbuf_alloc; i++)
+		lib_ring_buffer_backend_free_subbuf(bufb, bufb->array[i]);
 free_array:
-	for (i = 0; (i < num_subbuf_alloc && bufb->array[i]); i++)
-		lttng_kvfree(bufb->array[i]);
-depopulate:
-	/* Free all allocated pages */
-	for (i = 0; (i < num_pages && pages[i]); i++)
-		__free_page(pages[i]);
 	lttng_kvfree(bufb->array);
 array_error:
-	vfree(pages);
-pages_error:
-	clear_current_oom_origin();
-not_enough_pages:
 	return -ENOMEM;
 }
 
@@ -187,27 +246,23 @@ int lib_ring_buffer_backend_create(struct lttng_kernel_ring_buffer_backend *bufb
 	bufb->chan = container_of(chanb, struct lttng_kernel_ring_buffer_channel, backend);
 	bufb->cpu = cpu;
 
-	return lib_ring_buffer_backend_allocate(config, bufb, chanb->buf_size,
-						chanb->num_subbuf,
+	return lib_ring_buffer_backend_allocate(config, bufb, chanb->num_subbuf,
 						chanb->extra_reader_sb);
 }
 
 void lib_ring_buffer_backend_free(struct lttng_kernel_ring_buffer_backend *bufb)
 {
 	struct channel_backend *chanb = &bufb->chan->backend;
-	unsigned long i, j, num_subbuf_alloc;
+	unsigned long i, num_subbuf_alloc;
 
-	num_subbuf_alloc = chanb->num_subbuf;
+	num_subbuf_alloc = bufb->num_subbuf;
 	if (chanb->extra_reader_sb)
 		num_subbuf_alloc++;
 
 	lttng_kvfree(bufb->buf_wsb);
 	lttng_kvfree(bufb->buf_cnt);
-	for (i = 0; i < num_subbuf_alloc; i++) {
-		for (j = 0; j < bufb->num_pages_per_subbuf; j++)
-			__free_page(pfn_to_page(bufb->array[i]->p[j].pfn));
-		lttng_kvfree(bufb->array[i]);
-	}
+	for (i = 0; i < num_subbuf_alloc; i++)
+		lib_ring_buffer_backend_free_subbuf(bufb, bufb->array[i]);
 	lttng_kvfree(bufb->array);
 	bufb->allocated = 0;
 }
@@ -219,11 +274,11 @@ void lib_ring_buffer_backend_reset(struct lttng_kernel_ring_buffer_backend *bufb
 	unsigned long num_subbuf_alloc;
 	unsigned int i;
 
-	num_subbuf_alloc = chanb->num_subbuf;
+	num_subbuf_alloc = bufb->num_subbuf;
 	if (chanb->extra_reader_sb)
 		num_subbuf_alloc++;
 
-	for (i = 0; i < chanb->num_subbuf; i++)
+	for (i = 0; i < bufb->num_subbuf; i++)
 		bufb->buf_wsb[i].id = subbuffer_id(config, 0, 1, i);
 	if (chanb->extra_reader_sb)
 		bufb->buf_rsb.id = subbuffer_id(config, 0, 1,
@@ -238,10 +293,173 @@ void lib_ring_buffer_backend_reset(struct lttng_kernel_ring_buffer_backend *bufb
 		bufb->array[i]->data_size = 0;
 		/* Don't reset backend page and virt addresses */
 	}
-	/* Don't reset num_pages_per_subbuf, cpu, allocated */
+	/* Don't reset num_pages_per_subbuf, geometry, cpu, allocated */
 	v_set(config, &bufb->records_read, 0);
 }
 
+/**
+ * lib_ring_buffer_backend_resize_prepare - allocate tables for a resize
+ * @bufb: buffer backend
+ * @resize: resize state, zeroed by the caller
+ * @num_subbuf: number of sub-buffers after resize
+ *
+ * Allocates the sub-buffer tables sized for @num_subbuf, and the sub-buffers
+ * added when growing. The buffer itself is left untouched. The state must be
+ * released with lib_ring_buffer_backend_resize_release().
+ */
+int lib_ring_buffer_backend_resize_prepare(struct lttng_kernel_ring_buffer_backend *bufb,
+		struct lttng_kernel_ring_buffer_backend_resize *resize,
+		unsigned long num_subbuf)
+{
+	const struct lttng_kernel_ring_buffer_config *config = &bufb->chan->backend.config;
+	int node = cpu_to_node(max(bufb->cpu, 0));
+	unsigned long nr_spare;
+
+	if (num_subbuf > bufb->num_subbuf)
+		nr_spare = num_subbuf - bufb->num_subbuf;
+	else
+		nr_spare = bufb->num_subbuf - num_subbuf;
+
+	resize->num_subbuf = num_subbuf;
+	resize->array = lttng_kvzalloc_node(ALIGN(sizeof(*resize->array)
+					* num_subbuf,
+				1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (unlikely(!resize->array))
+		goto error;
+	resize->buf_wsb = lttng_kvzalloc_node(ALIGN(sizeof(*resize->buf_wsb)
+					* num_subbuf,
+				1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (unlikely(!resize->buf_wsb))
+		goto error;
+	resize->buf_cnt = lttng_kvzalloc_node(ALIGN(sizeof(*resize->buf_cnt)
+					* num_subbuf,
+				1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (unlikely(!resize->buf_cnt))
+		goto error;
+	resize->spare = lttng_kvzalloc_node(ALIGN(sizeof(*resize->spare)
+					* nr_spare,
+				1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (unlikely(!resize->spare))
+		goto error;
+	if (num_subbuf > bufb->num_subbuf) {
+		if (lib_ring_buffer_backend_alloc_subbufs(config, bufb,
+				resize->spare, 0, nr_spare))
+			goto error;
+		resize->nr_spare = nr_spare;
+	}
+	return 0;
+
+error:
+	lib_ring_buffer_backend_resize_release(bufb, resize);
+	return -ENOMEM;
+}
+
+/**
+ * lib_ring_buffer_backend_resize_commit - switch a buffer to resized tables
+ * @bufb: buffer backend
+ * @resize: resize state prepared for this buffer
+ * @consumed: consumer position, at a sub-buffer boundary
+ * @offset: writer position
+ *
+ * Sub-buffers holding data between @consumed and @offset keep their pages
+ * and move to the index of their position within the resized buffer. The
+ * packet counters are recomputed so packet sequence numbers carry on
+ * contiguously. Only valid in discard mode, with no concurrent writer nor
+ * reader, when the data fits in the resized buffer.
+ */
+void lib_ring_buffer_backend_resize_commit(struct lttng_kernel_ring_buffer_backend *bufb,
+		struct lttng_kernel_ring_buffer_backend_resize *resize,
+		unsigned long consumed, unsigned long offset)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	const struct lttng_kernel_ring_buffer_config *config = &chanb->config;
+	unsigned long old_num = bufb->num_subbuf, new_num = resize->num_subbuf;
+	unsigned long first, cur, nr_live, i;
+	u64 cur_seq;
+
+	/* Positions, in sub-buffer units. */
+	first = consumed >> chanb->subbuf_size_order;
+	cur = offset >> chanb->subbuf_size_order;
+	/* The sub-buffer at the writer position is live once written to. */
+	nr_live = cur - first + !!(offset & (chanb->subbuf_size - 1));
+	CHAN_WARN_ON(chanb, nr_live > new_num);
+
+	/* Sequence number of the packet at the writer position. */
+	i = cur & (old_num - 1);
+	cur_seq = (u64) old_num * bufb->buf_cnt[i].seq_cnt + i;
+
+	for (i = 0; i < max(old_num, new_num); i++) {
+		struct lttng_kernel_ring_buffer_backend_pages *pages = NULL;
+		unsigned long pos = first + i;
+
+		if (i < old_num) {
+			unsigned long id = bufb->buf_wsb[pos & (old_num - 1)].id;
+
+			pages = bufb->array[subbuffer_id_get_index(config, id)];
+			if (i >= nr_live) {
+				v_set(config, &pages->records_commit, 0);
+				v_set(config, &pages->records_unread, 0);
+				pages->data_size = 0;
+			}
+		}
+		if (i >= new_num) {
+			/* Removed by a shrink. */
+			resize->spare[resize->nr_spare++] = pages;
+			continue;
+		}
+		if (!pages)
+			pages = resize->spare[--resize->nr_spare];
+		resize->array[pos & (new_num - 1)] = pages;
+	}
+
+	for (i = 0; i < new_num; i++) {
+		unsigned long pos = first + i, idx = pos & (new_num - 1);
+		u64 seq;
+
+		resize->buf_wsb[idx].id = subbuffer_id(config, 0, 1, idx);
+		/*
+		 * Count the packets delivered in this sub-buffer so the next
+		 * one gets the sequence number following its position.
+		 * Packets before the writer position are already delivered.
+		 */
+		seq = cur_seq + (long) (pos - cur);
+		if ((long) (pos - cur) < 0)
+			seq += new_num;
+		resize->buf_cnt[idx].seq_cnt = (seq - idx) >> get_count_order(new_num);
+	}
+	bufb->buf_rsb.id = subbuffer_id(config, 0, 1, 0);
+
+	swap(bufb->array, resize->array);
+	swap(bufb->buf_wsb, resize->buf_wsb);
+	swap(bufb->buf_cnt, resize->buf_cnt);
+	lib_ring_buffer_backend_set_geometry(bufb, new_num);
+}
+
+/**
+ * lib_ring_buffer_backend_resize_release - free resize state
+ * @bufb: buffer backend
+ * @resize: resize state
+ *
+ * Frees the tables not used by the buffer and the spare sub-buffers, whether
+ * or not the resize was committed.
+ */
+void lib_ring_buffer_backend_resize_release(struct lttng_kernel_ring_buffer_backend *bufb,
+		struct lttng_kernel_ring_buffer_backend_resize *resize)
+{
+	unsigned long i;
+
+	for (i = 0; i < resize->nr_spare; i++)
+		lib_ring_buffer_backend_free_subbuf(bufb, resize->spare[i]);
+	lttng_kvfree(resize->spare);
+	lttng_kvfree(resize->buf_cnt);
+	lttng_kvfree(resize->buf_wsb);
+	lttng_kvfree(resize->array);
+}
+
 /*
  * The frontend is responsible for also calling ring_buffer_backend_reset for
  * each buffer when calling channel_backend_reset.
@@ -279,6 +497,10 @@ int lttng_cpuhp_rb_backend_prepare(unsigned int cpu,
 
 	CHAN_WARN_ON(chanb, config->alloc == RING_BUFFER_ALLOC_GLOBAL);
 
+	/* Lazily allocated buffers are created by their first writer. */
+	if (chanb->lazy_alloc)
+		return 0;
+
 	buf = per_cpu_ptr(chanb->buf, cpu);
 	ret = lib_ring_buffer_create(buf, chanb, cpu);
 	if (ret) {
@@ -320,6 +542,8 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 	switch (action) {
 	case CPU_UP_PREPARE:
 	case CPU_UP_PREPARE_FROZEN:
+		if (chanb->lazy_alloc)
+			break;
 		buf = per_cpu_ptr(chanb->buf, cpu);
 		ret = lib_ring_buffer_create(buf, chanb, cpu);
 		if (ret) {
@@ -352,6 +576,7 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
  * @parent: dentry of parent directory, %NULL for root directory
  * @subbuf_size: size of sub-buffers (> PAGE_SIZE, power of 2)
  * @num_subbuf: number of sub-buffers (power of 2)
+ * @flags: RING_BUFFER_CHANNEL_* channel creation flags
  *
  * Returns channel pointer if successful, %NULL otherwise.
  *
@@ -364,7 +589,8 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 int channel_backend_init(struct channel_backend *chanb,
 			 const char *name,
 			 const struct lttng_kernel_ring_buffer_config *config,
-			 void *priv, size_t subbuf_size, size_t num_subbuf)
+			 void *priv, size_t subbuf_size, size_t num_subbuf,
+			 unsigned int flags)
 {
 	struct lttng_kernel_ring_buffer_channel *chan = container_of(chanb, struct lttng_kernel_ring_buffer_channel, backend);
 	unsigned int i;
@@ -402,6 +628,39 @@ int channel_backend_init(struct channel_backend *chanb,
 	chanb->buf_size_order = get_count_order(chanb->buf_size);
 	chanb->subbuf_size_order = get_count_order(subbuf_size);
 	chanb->num_subbuf_order = get_count_order(num_subbuf);
+	if (flags & RING_BUFFER_CHANNEL_LAZY_ALLOC) {
+		if (config->alloc != RING_BUFFER_ALLOC_PER_CPU
+		    || config->output == RING_BUFFER_ITERATOR)
+			return -EINVAL;
+		chanb->lazy_alloc = 1;
+	}
+	if (flags & RING_BUFFER_CHANNEL_AUTO_RESIZE) {
+		if (config->alloc != RING_BUFFER_ALLOC_PER_CPU
+		    || config->sync != RING_BUFFER_SYNC_PER_CPU
+		    || config->mode != RING_BUFFER_DISCARD
+		    || config->output != RING_BUFFER_SPLICE)
+			return -EINVAL;
+		chanb->auto_resize = 1;
+	}
+	if (flags & RING_BUFFER_CHANNEL_ADAPTIVE_SWITCH_TIMER)
+		chanb->adaptive_switch_timer = 1;
+	if (flags & RING_BUFFER_CHANNEL_MMAP_PREFAULT) {
+		if (config->output != RING_BUFFER_MMAP)
+			return -EINVAL;
+		chanb->mmap_prefault = 1;
+	}
+	if (flags & (RING_BUFFER_CHANNEL_COMPRESS_LZ4 | RING_BUFFER_CHANNEL_COMPRESS_ZSTD)) {
+		if ((flags & RING_BUFFER_CHANNEL_COMPRESS_LZ4)
+		    && (flags & RING_BUFFER_CHANNEL_COMPRESS_ZSTD))
+			return -EINVAL;
+		if (config->output != RING_BUFFER_SPLICE
+		    && config->output != RING_BUFFER_MMAP)
+			return -EINVAL;
+		chanb->compress = (flags & RING_BUFFER_CHANNEL_COMPRESS_LZ4) ?
+			RING_BUFFER_COMPRESS_LZ4 : RING_BUFFER_COMPRESS_ZSTD;
+		if (!lib_ring_buffer_compress_supported(chanb->compress))
+			return -EOPNOTSUPP;
+	}
 	chanb->extra_reader_sb =
 			(config->mode == RING_BUFFER_OVERWRITE) ? 1 : 0;
 	chanb->num_subbuf = num_subbuf;
@@ -419,6 +678,15 @@ int channel_backend_init(struct channel_backend *chanb,
 		if (!chanb->buf)
 			goto free_cpumask;
 
+		/*
+		 * Keep writers out of lazily allocated buffers until they
+		 * are populated. lib_ring_buffer_create() preserves this.
+		 */
+		if (chanb->lazy_alloc) {
+			for_each_possible_cpu(i)
+				atomic_set(&per_cpu_ptr(chanb->buf, i)->record_disabled, 1);
+		}
+
 #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,10,0))
 		chanb->cpuhp_prepare.component = LTTNG_RING_BUFFER_BACKEND;
 		ret = cpuhp_state_add_instance(lttng_rb_hp_prepare,
@@ -447,6 +715,8 @@ int channel_backend_init(struct channel_backend *chanb,
 
 			lttng_cpus_read_lock();
 			for_each_online_cpu(i) {
+				if (chanb->lazy_alloc)
+					break;
 				ret = lib_ring_buffer_create(per_cpu_ptr(chanb->buf, i),
 							 chanb, i);
 				if (ret)
@@ -455,6 +725,8 @@ int channel_backend_init(struct channel_backend *chanb,
 			lttng_cpus_read_unlock();
 #else
 			for_each_possible_cpu(i) {
+				if (chanb->lazy_alloc)
+					break;
 				ret = lib_ring_buffer_create(per_cpu_ptr(chanb->buf, i),
 							 chanb, i);
 				if (ret)
@@ -583,7 +855,7 @@ void _lib_ring_buffer_write(struct lttng_kernel_ring_buffer_backend *bufb, size_
 		 * Underlying layer should never ask for writes across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_wsb[sbidx].id;
@@ -626,7 +898,7 @@ void _lib_ring_buffer_memset(struct lttng_kernel_ring_buffer_backend *bufb,
 		 * Underlying layer should never ask for writes across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_wsb[sbidx].id;
@@ -670,7 +942,7 @@ void _lib_ring_buffer_strcpy(struct lttng_kernel_ring_buffer_backend *bufb,
 		 * Underlying layer should never ask for writes across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_wsb[sbidx].id;
@@ -757,7 +1029,7 @@ void _lib_ring_buffer_pstrcpy(struct lttng_kernel_ring_buffer_backend *bufb,
 		 * Underlying layer should never ask for writes across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_wsb[sbidx].id;
@@ -831,7 +1103,7 @@ void _lib_ring_buffer_copy_from_user_inatomic(struct lttng_kernel_ring_buffer_ba
 		 * Underlying layer should never ask for writes across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_wsb[sbidx].id;
@@ -884,7 +1156,7 @@ void _lib_ring_buffer_strcpy_from_user_inatomic(struct lttng_kernel_ring_buffer_
 		 * Underlying layer should never ask for writes across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_wsb[sbidx].id;
@@ -975,7 +1247,7 @@ void _lib_ring_buffer_pstrcpy_from_user_inatomic(struct lttng_kernel_ring_buffer
 		 * Underlying layer should never ask for writes across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 
 		bytes_left_in_page = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_wsb[sbidx].id;
@@ -1040,7 +1312,7 @@ size_t lib_ring_buffer_read(struct lttng_kernel_ring_buffer_backend *bufb, size_
 	unsigned long sb_bindex, id;
 
 	orig_len = len;
-	offset &= chanb->buf_size - 1;
+	offset &= bufb->buf_size - 1;
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	if (unlikely(!len))
 		return 0;
@@ -1063,7 +1335,7 @@ size_t lib_ring_buffer_read(struct lttng_kernel_ring_buffer_backend *bufb, size_
 		 * Underlying layer should never ask for reads across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 	}
 	return orig_len;
 }
@@ -1091,7 +1363,7 @@ int __lib_ring_buffer_copy_to_user(struct lttng_kernel_ring_buffer_backend *bufb
 	struct lttng_kernel_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
 
-	offset &= chanb->buf_size - 1;
+	offset &= bufb->buf_size - 1;
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	if (unlikely(!len))
 		return 0;
@@ -1116,7 +1388,7 @@ int __lib_ring_buffer_copy_to_user(struct lttng_kernel_ring_buffer_backend *bufb
 		 * Underlying layer should never ask for reads across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 	}
 	return 0;
 }
@@ -1144,7 +1416,7 @@ int lib_ring_buffer_read_cstr(struct lttng_kernel_ring_buffer_backend *bufb, siz
 	struct lttng_kernel_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
 
-	offset &= chanb->buf_size - 1;
+	offset &= bufb->buf_size - 1;
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	orig_offset = offset;
 	if (unlikely(!len))
@@ -1174,7 +1446,7 @@ int lib_ring_buffer_read_cstr(struct lttng_kernel_ring_buffer_backend *bufb, siz
 		 * Underlying layer should never ask for reads across
 		 * subbuffers.
 		 */
-		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+		CHAN_WARN_ON(chanb, offset >= bufb->buf_size);
 	}
 	if (dest && len)
 		((char *)dest)[0] = 0;
@@ -1200,9 +1472,9 @@ unsigned long *lib_ring_buffer_read_get_pfn(struct lttng_kernel_ring_buffer_back
 	const struct lttng_kernel_ring_buffer_config *config = &chanb->config;
 	unsigned long sb_bindex, id;
 
-	offset &= chanb->buf_size - 1;
+	offset &= bufb->buf_size - 1;
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	id = bufb->buf_rsb.id;
+	id = subbuffer_read_id(config, bufb, offset);
 	sb_bindex = subbuffer_id_get_index(config, id);
 	rpages = bufb->array[sb_bindex];
 	CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
@@ -1232,9 +1504,9 @@ void *lib_ring_buffer_read_offset_address(struct lttng_kernel_ring_buffer_backen
 	const struct lttng_kernel_ring_buffer_config *config = &chanb->config;
 	unsigned long sb_bindex, id;
 
-	offset &= chanb->buf_size - 1;
+	offset &= bufb->buf_size - 1;
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	id = bufb->buf_rsb.id;
+	id = subbuffer_read_id(config, bufb, offset);
 	sb_bindex = subbuffer_id_get_index(config, id);
 	rpages = bufb->array[sb_bindex];
 	CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
@@ -1262,7 +1534,7 @@ void *lib_ring_buffer_offset_address(struct lttng_kernel_ring_buffer_backend *bu
 	const struct lttng_kernel_ring_buffer_config *config = &chanb->config;
 	unsigned long sb_bindex, id;
 
-	offset &= chanb->buf_size - 1;
+	offset &= bufb->buf_size - 1;
 	sbidx = offset >> chanb->subbuf_size_order;
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	id = bufb->buf_wsb[sbidx].id;
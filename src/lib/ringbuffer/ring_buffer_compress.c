@@ -0,0 +1,262 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR LGPL-2.1-only)
+ *
+ * ring_buffer_compress.c
+ *
+ * Compression of the sub-buffers handed to readers.
+ *
+ * Sub-buffers are compressed when the user-space reader gets them, so the
+ * tracing fast path and in-kernel readers are never involved. The compressed packet is kept in an
+ * area readers either map or splice from.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/kconfig.h>
+#include <lttng/kernel-version.h>
+
+#if (IS_REACHABLE(CONFIG_LZ4_COMPRESS) \
+	&& LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,11,0))
+#define LTTNG_HAVE_RING_BUFFER_LZ4
+#include <linux/lz4.h>
+#endif
+
+#if (IS_REACHABLE(CONFIG_ZSTD_COMPRESS) \
+	&& LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,16,0))
+#define LTTNG_HAVE_RING_BUFFER_ZSTD
+#include <linux/zstd.h>
+#endif
+
+#include <ringbuffer/backend.h>
+#include <ringbuffer/frontend.h>
+#include <ringbuffer/vfs.h>
+#include <wrapper/vmalloc.h>
+
+/* Favor compression speed: the reader competes with traced workloads. */
+#define RING_BUFFER_COMPRESS_ZSTD_LEVEL	1
+
+bool lib_ring_buffer_compress_supported(enum lttng_kernel_ring_buffer_compress compress)
+{
+	switch (compress) {
+	case RING_BUFFER_COMPRESS_NONE:
+		return true;
+#ifdef LTTNG_HAVE_RING_BUFFER_LZ4
+	case RING_BUFFER_COMPRESS_LZ4:
+		return true;
+#endif
+#ifdef LTTNG_HAVE_RING_BUFFER_ZSTD
+	case RING_BUFFER_COMPRESS_ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+/*
+ * Worst case size of a compressed sub-buffer.
+ */
+static
+size_t lib_ring_buffer_compress_bound(enum lttng_kernel_ring_buffer_compress compress,
+				      size_t subbuf_size)
+{
+	switch (compress) {
+#ifdef LTTNG_HAVE_RING_BUFFER_LZ4
+	case RING_BUFFER_COMPRESS_LZ4:
+		return LZ4_compressBound(subbuf_size);
+#endif
+#ifdef LTTNG_HAVE_RING_BUFFER_ZSTD
+	case RING_BUFFER_COMPRESS_ZSTD:
+		return zstd_compress_bound(subbuf_size);
+#endif
+	default:
+		return 0;
+	}
+}
+
+/**
+ * lib_ring_buffer_compress_mmap_offset - mmap offset of the compressed area
+ * @buf: buffer
+ *
+ * The compressed area follows the control area.
+ */
+unsigned long lib_ring_buffer_compress_mmap_offset(struct lttng_kernel_ring_buffer *buf)
+{
+	return lib_ring_buffer_control_mmap_offset(buf)
+		+ lib_ring_buffer_control_len(buf->backend.chan);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_compress_mmap_offset);
+
+/*
+ * Must be called under cpu hotplug protection.
+ */
+int lib_ring_buffer_compress_alloc(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	enum lttng_kernel_ring_buffer_compress compress = chan->backend.compress;
+	struct lttng_kernel_ring_buffer_compress_area *area;
+	int node = cpu_to_node(max(buf->backend.cpu, 0));
+
+	if (compress == RING_BUFFER_COMPRESS_NONE)
+		return 0;
+	area = kzalloc_node(sizeof(*area), GFP_KERNEL, node);
+	if (!area)
+		return -ENOMEM;
+	area->len = PAGE_ALIGN(lib_ring_buffer_compress_bound(compress,
+					chan->backend.subbuf_size));
+	area->data = vmalloc_user(area->len);
+	if (!area->data)
+		goto error;
+	if (config->backend != RING_BUFFER_VMAP) {
+		area->src = vmalloc_node(chan->backend.subbuf_size, node);
+		if (!area->src)
+			goto error;
+	}
+
+	switch (compress) {
+#ifdef LTTNG_HAVE_RING_BUFFER_LZ4
+	case RING_BUFFER_COMPRESS_LZ4:
+		area->wrkmem = lttng_kvmalloc_node(LZ4_MEM_COMPRESS, GFP_KERNEL, node);
+		if (!area->wrkmem)
+			goto error;
+		break;
+#endif
+#ifdef LTTNG_HAVE_RING_BUFFER_ZSTD
+	case RING_BUFFER_COMPRESS_ZSTD:
+	{
+		zstd_parameters params;
+		size_t wrkmem_len;
+
+		params = zstd_get_params(RING_BUFFER_COMPRESS_ZSTD_LEVEL,
+					 chan->backend.subbuf_size);
+		wrkmem_len = zstd_cctx_workspace_bound(&params.cParams);
+		area->wrkmem = lttng_kvmalloc_node(wrkmem_len, GFP_KERNEL, node);
+		if (!area->wrkmem)
+			goto error;
+		area->cctx = zstd_init_cctx(area->wrkmem, wrkmem_len);
+		if (!area->cctx)
+			goto error;
+		break;
+	}
+#endif
+	default:
+		CHAN_WARN_ON(chan, 1);
+		goto error;
+	}
+	buf->compress = area;
+	return 0;
+
+error:
+	lttng_kvfree(area->wrkmem);
+	vfree(area->src);
+	vfree(area->data);
+	kfree(area);
+	return -ENOMEM;
+}
+
+void lib_ring_buffer_compress_free(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_compress_area *area = buf->compress;
+
+	if (!area)
+		return;
+	lttng_kvfree(area->wrkmem);
+	vfree(area->src);
+	vfree(area->data);
+	kfree(area);
+	buf->compress = NULL;
+}
+
+/*
+ * Contiguous view of the sub-buffer held by the reader.
+ */
+static
+const void *lib_ring_buffer_compress_src(struct lttng_kernel_ring_buffer *buf,
+					 unsigned long len)
+{
+	struct lttng_kernel_ring_buffer_backend *bufb = &buf->backend;
+	const struct lttng_kernel_ring_buffer_config *config = &bufb->chan->backend.config;
+	unsigned long sb_bindex;
+
+	if (config->backend == RING_BUFFER_VMAP) {
+		sb_bindex = subbuffer_id_get_index(config,
+				subbuffer_read_id(config, bufb, buf->get_subbuf_consumed));
+		return bufb->array[sb_bindex]->vaddr;
+	}
+	lib_ring_buffer_read(bufb, buf->get_subbuf_consumed, buf->compress->src, len);
+	return buf->compress->src;
+}
+
+static
+int __lib_ring_buffer_compress_subbuf(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_kernel_ring_buffer_compress_area *area = buf->compress;
+	unsigned long raw_size;
+	const void *src;
+
+	raw_size = lib_ring_buffer_get_read_data_size(config, buf);
+	src = lib_ring_buffer_compress_src(buf, raw_size);
+	area->raw_size = raw_size;
+	area->size = 0;
+
+	switch (chan->backend.compress) {
+#ifdef LTTNG_HAVE_RING_BUFFER_LZ4
+	case RING_BUFFER_COMPRESS_LZ4:
+	{
+		int ret;
+
+		ret = LZ4_compress_default(src, area->data, raw_size,
+					   area->len, area->wrkmem);
+		if (ret <= 0)
+			return -EIO;
+		area->size = ret;
+		return 0;
+	}
+#endif
+#ifdef LTTNG_HAVE_RING_BUFFER_ZSTD
+	case RING_BUFFER_COMPRESS_ZSTD:
+	{
+		zstd_parameters params;
+		size_t ret;
+
+		params = zstd_get_params(RING_BUFFER_COMPRESS_ZSTD_LEVEL,
+					 chan->backend.subbuf_size);
+		ret = zstd_compress_cctx(area->cctx, area->data, area->len,
+					 src, raw_size, &params);
+		if (zstd_is_error(ret))
+			return -EIO;
+		area->size = ret;
+		return 0;
+	}
+#endif
+	default:
+		CHAN_WARN_ON(chan, 1);
+		return -EIO;
+	}
+}
+
+/**
+ * lib_ring_buffer_compress_subbuf - compress the sub-buffer held by the reader
+ * @buf: ring buffer
+ *
+ * Called by the ioctls handing a single sub-buffer to user-space after a
+ * successful get, as user-space reads the compressed area. Does nothing
+ * for uncompressed buffers. Returns 0 on success, -EIO if the compressor
+ * fails, in which case the sub-buffer is released.
+ */
+int lib_ring_buffer_compress_subbuf(struct lttng_kernel_ring_buffer *buf)
+{
+	int ret;
+
+	if (!buf->compress)
+		return 0;
+	ret = __lib_ring_buffer_compress_subbuf(buf);
+	if (ret)
+		lib_ring_buffer_put_subbuf(buf);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_compress_subbuf);
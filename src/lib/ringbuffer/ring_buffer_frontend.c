@@ -42,6 +42,7 @@
 #include <linux/module.h>
 #include <linux/percpu.h>
 #include <linux/percpu-defs.h>
+#include <linux/vmalloc.h>
 #include <asm/cacheflush.h>
 
 #include <ringbuffer/config.h>
@@ -79,10 +80,46 @@ static DEFINE_PER_CPU(spinlock_t, ring_buffer_nohz_lock);
 DEFINE_PER_CPU(unsigned int, lib_ring_buffer_nesting);
 EXPORT_PER_CPU_SYMBOL(lib_ring_buffer_nesting);
 
+/*
+ * Quiescent period after which lazily allocated buffers without readers are
+ * freed. 0 disables reclaim.
+ */
+static unsigned int lib_ring_buffer_lazy_reclaim_ms;
+module_param_named(lazy_reclaim_ms, lib_ring_buffer_lazy_reclaim_ms, uint, 0644);
+MODULE_PARM_DESC(lazy_reclaim_ms,
+	"Quiescent period (ms) before freeing lazily allocated buffers (0: never)");
+
+/*
+ * Period at which the size of buffers of channels created with
+ * RING_BUFFER_CHANNEL_AUTO_RESIZE is reconsidered. 0 disables resizing.
+ */
+static unsigned int lib_ring_buffer_resize_interval_ms = 1000;
+module_param_named(resize_interval_ms, lib_ring_buffer_resize_interval_ms, uint, 0644);
+MODULE_PARM_DESC(resize_interval_ms,
+	"Period (ms) at which auto-resized buffer sizes are adjusted (0: never)");
+
+/*
+ * Maximum backoff of the adaptive switch timer of idle buffers, as a power of
+ * two of the channel switch timer period.
+ */
+#define RING_BUFFER_SWITCH_TIMER_BACKOFF_LIMIT	16
+static unsigned int lib_ring_buffer_switch_timer_max_backoff = 6;
+module_param_named(switch_timer_max_backoff,
+		   lib_ring_buffer_switch_timer_max_backoff, uint, 0644);
+MODULE_PARM_DESC(switch_timer_max_backoff,
+	"Idle buffers adaptive switch timer period is at most 2^N times the base period (max 16)");
+
+static
+int __lib_ring_buffer_resize(struct lttng_kernel_ring_buffer *buf,
+		unsigned long num_subbuf);
+static
+unsigned long lib_ring_buffer_resize_sample(struct lttng_kernel_ring_buffer *buf);
 static
 void lib_ring_buffer_print_errors(struct lttng_kernel_ring_buffer_channel *chan,
 				  struct lttng_kernel_ring_buffer *buf, int cpu);
 static
+void lib_ring_buffer_switch_timer_rearm(struct irq_work *entry);
+static
 void _lib_ring_buffer_switch_remote(struct lttng_kernel_ring_buffer *buf,
 		enum switch_mode mode);
 
@@ -94,7 +131,7 @@ int lib_ring_buffer_poll_deliver(const struct lttng_kernel_ring_buffer_config *c
 	unsigned long consumed_old, consumed_idx, commit_count, write_offset;
 
 	consumed_old = atomic_long_read(&buf->consumed);
-	consumed_idx = subbuf_index(consumed_old, chan);
+	consumed_idx = subbuf_index(consumed_old, buf);
 	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
 	/*
 	 * No memory barrier here, since we are only interested
@@ -110,9 +147,9 @@ int lib_ring_buffer_poll_deliver(const struct lttng_kernel_ring_buffer_config *c
 	 */
 
 	if (((commit_count - chan->backend.subbuf_size)
-	     & chan->commit_count_mask)
-	    - (buf_trunc(consumed_old, chan)
-	       >> chan->backend.num_subbuf_order)
+	     & buf->commit_count_mask)
+	    - (buf_trunc(consumed_old, buf)
+	       >> buf->backend.num_subbuf_order)
 	    != 0)
 		return 0;
 
@@ -127,6 +164,153 @@ int lib_ring_buffer_poll_deliver(const struct lttng_kernel_ring_buffer_config *c
 	return 1;
 }
 
+/**
+ * lib_ring_buffer_control_len - length of the control area of a buffer
+ * @chan: channel
+ *
+ * Sized for the number of sub-buffers the channel was created with, which
+ * buffers never exceed.
+ */
+size_t lib_ring_buffer_control_len(struct lttng_kernel_ring_buffer_channel *chan)
+{
+	return PAGE_ALIGN(sizeof(struct lttng_kernel_abi_ring_buffer_control)
+			  + sizeof(struct lttng_kernel_abi_ring_buffer_packet)
+			    * chan->backend.num_subbuf);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_control_len);
+
+/**
+ * lib_ring_buffer_control_mmap_offset - mmap offset of the control area
+ * @buf: buffer
+ *
+ * The control area follows the data pages for mmap readers, and is the only
+ * mapping available to other readers.
+ */
+unsigned long lib_ring_buffer_control_mmap_offset(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long offset = 0;
+
+	if (config->output == RING_BUFFER_MMAP) {
+		offset = chan->backend.buf_size;
+		if (chan->backend.extra_reader_sb)
+			offset += chan->backend.subbuf_size;
+	}
+	return offset;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_control_mmap_offset);
+
+/**
+ * lib_ring_buffer_index_len - length of the packet index of a buffer
+ * @chan: channel
+ */
+size_t lib_ring_buffer_index_len(struct lttng_kernel_ring_buffer_channel *chan)
+{
+	return PAGE_ALIGN(chan->backend.config.packet_index_size
+			  * chan->backend.num_subbuf);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_index_len);
+
+/**
+ * lib_ring_buffer_index_mmap_offset - mmap offset of the packet index
+ * @buf: buffer
+ *
+ * The packet index follows the control and compressed areas.
+ */
+unsigned long lib_ring_buffer_index_mmap_offset(struct lttng_kernel_ring_buffer *buf)
+{
+	unsigned long offset = lib_ring_buffer_compress_mmap_offset(buf);
+
+	if (buf->compress)
+		offset += buf->compress->len;
+	return offset;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_index_mmap_offset);
+
+static
+void lib_ring_buffer_control_reset(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_abi_ring_buffer_control *control = buf->control;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	unsigned long i;
+
+	if (!control)
+		return;
+	WRITE_ONCE(control->produced, 0);
+	WRITE_ONCE(control->consumed, 0);
+	control->subbuf_size = chan->backend.subbuf_size;
+	control->num_packets = chan->backend.num_subbuf;
+	for (i = 0; i < chan->backend.num_subbuf; i++)
+		WRITE_ONCE(control->packets[i].position, ~0ULL);
+}
+
+/* Control area slot of the packet starting at @offset. */
+static
+struct lttng_kernel_abi_ring_buffer_packet *
+	lib_ring_buffer_control_packet(struct lttng_kernel_ring_buffer *buf,
+				       unsigned long offset)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+
+	return &buf->control->packets[(offset >> chan->backend.subbuf_size_order)
+				      & (chan->backend.num_subbuf - 1)];
+}
+
+/*
+ * Invalidate the control area slot of the packet starting at @offset and
+ * record its begin timestamp. Called by the writer starting the packet.
+ */
+static
+void lib_ring_buffer_control_begin(struct lttng_kernel_ring_buffer *buf,
+				   unsigned long offset, u64 timestamp)
+{
+	struct lttng_kernel_abi_ring_buffer_packet *packet;
+
+	if (!buf->control)
+		return;
+	packet = lib_ring_buffer_control_packet(buf, offset);
+	WRITE_ONCE(packet->position, ~0ULL);
+	smp_wmb();
+	WRITE_ONCE(packet->timestamp_begin, timestamp);
+}
+
+/*
+ * Publish the packet containing @offset in the control area. Called with
+ * exclusive access to its sub-buffer, before it is delivered.
+ */
+static
+void lib_ring_buffer_control_deliver(const struct lttng_kernel_ring_buffer_config *config,
+				     struct lttng_kernel_ring_buffer *buf,
+				     unsigned long offset, unsigned long idx)
+{
+	struct lttng_kernel_abi_ring_buffer_control *control = buf->control;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	struct lttng_kernel_abi_ring_buffer_packet *packet;
+
+	if (!control)
+		return;
+	packet = lib_ring_buffer_control_packet(buf, offset);
+	WRITE_ONCE(packet->data_size,
+		   lib_ring_buffer_get_data_size(config, buf, idx));
+	WRITE_ONCE(packet->timestamp_end, buf->ts_end[idx]);
+	WRITE_ONCE(packet->seq_num, (u64) buf->backend.num_subbuf
+			* buf->backend.buf_cnt[idx].seq_cnt + idx);
+	/* Order packet fields before its position. */
+	smp_wmb();
+	WRITE_ONCE(packet->position, subbuf_trunc(offset, chan));
+	/* The consumed position is published by the reader only. */
+	WRITE_ONCE(control->produced, v_read(config, &buf->offset));
+	WRITE_ONCE(control->records_lost_full,
+		   v_read(config, &buf->records_lost_full));
+	WRITE_ONCE(control->records_lost_wrap,
+		   v_read(config, &buf->records_lost_wrap));
+	WRITE_ONCE(control->records_lost_big,
+		   v_read(config, &buf->records_lost_big));
+	WRITE_ONCE(control->records_lost_unavailable,
+		   atomic_long_read(&buf->records_lost_unavailable));
+}
+
 /*
  * Must be called under cpu hotplug protection.
  */
@@ -135,11 +319,15 @@ void lib_ring_buffer_free(struct lttng_kernel_ring_buffer *buf)
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
 
 	irq_work_sync(&buf->wakeup_pending);
+	irq_work_sync(&buf->switch_timer_rearm);
 
 	lib_ring_buffer_print_errors(chan, buf, buf->backend.cpu);
 	lttng_kvfree(buf->commit_hot);
 	lttng_kvfree(buf->commit_cold);
 	lttng_kvfree(buf->ts_end);
+	vfree(buf->control);
+	lib_ring_buffer_compress_free(buf);
+	vfree(buf->index);
 
 	lib_ring_buffer_backend_free(&buf->backend);
 }
@@ -165,7 +353,7 @@ void lib_ring_buffer_reset(struct lttng_kernel_ring_buffer *buf)
 	 */
 	lib_ring_buffer_iterator_reset(buf);
 	v_set(config, &buf->offset, 0);
-	for (i = 0; i < chan->backend.num_subbuf; i++) {
+	for (i = 0; i < buf->backend.num_subbuf; i++) {
 		v_set(config, &buf->commit_hot[i].cc, 0);
 		v_set(config, &buf->commit_hot[i].seq, 0);
 		v_set(config, &buf->commit_cold[i].cc_sb, 0);
@@ -175,12 +363,15 @@ void lib_ring_buffer_reset(struct lttng_kernel_ring_buffer *buf)
 	atomic_set(&buf->record_disabled, 0);
 	v_set(config, &buf->last_timestamp, 0);
 	lib_ring_buffer_backend_reset(&buf->backend);
+	lib_ring_buffer_control_reset(buf);
 	/* Don't reset number of active readers */
 	v_set(config, &buf->records_lost_full, 0);
 	v_set(config, &buf->records_lost_wrap, 0);
 	v_set(config, &buf->records_lost_big, 0);
+	atomic_long_set(&buf->records_lost_unavailable, 0);
 	v_set(config, &buf->records_count, 0);
 	v_set(config, &buf->records_overrun, 0);
+	memset(&buf->stats, 0, sizeof(buf->stats));
 	buf->finalized = 0;
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_reset);
@@ -201,7 +392,6 @@ void channel_reset(struct lttng_kernel_ring_buffer_channel *chan)
 	 */
 	channel_iterator_reset(chan);
 	atomic_set(&chan->record_disabled, 0);
-	/* Don't reset commit_count_mask, still valid */
 	channel_backend_reset(&chan->backend);
 	/* Don't reset switch/read timer interval */
 	/* Don't reset notifiers and notifier enable bits */
@@ -220,8 +410,77 @@ static void lib_ring_buffer_pending_wakeup_chan(struct irq_work *entry)
 {
 	struct lttng_kernel_ring_buffer_channel *chan = container_of(entry, struct lttng_kernel_ring_buffer_channel, wakeup_pending);
 	wake_up_interruptible(&chan->read_wait);
+	if (atomic_read(&chan->read_ready_count) > 0)
+		wake_up_interruptible(&chan->read_ready_wait);
+}
+
+/*
+ * Mark the buffer as holding deliverable data in the channel readiness
+ * mask. Returns true when the readiness waiters need to be woken up, which
+ * is only the case for the first buffer marked since the last fetch, so a
+ * single wakeup covers all the buffers becoming ready meanwhile. Safe to
+ * call from NMI context.
+ */
+static
+bool lib_ring_buffer_mark_read_ready(const struct lttng_kernel_ring_buffer_config *config,
+				     struct lttng_kernel_ring_buffer_channel *chan,
+				     struct lttng_kernel_ring_buffer *buf)
+{
+	if (config->alloc != RING_BUFFER_ALLOC_PER_CPU)
+		return false;
+	if (cpumask_test_and_set_cpu(buf->backend.cpu, chan->read_ready))
+		return false;
+	return atomic_inc_return(&chan->read_ready_count) == 1;
+}
+
+/*
+ * Wake up the buffer and channel readers. Called when the buffer has
+ * deliverable data.
+ */
+static
+void lib_ring_buffer_wakeup_readers(const struct lttng_kernel_ring_buffer_config *config,
+				    struct lttng_kernel_ring_buffer_channel *chan,
+				    struct lttng_kernel_ring_buffer *buf)
+{
+	wake_up_interruptible(&buf->read_wait);
+	wake_up_interruptible(&chan->read_wait);
+	if (lib_ring_buffer_mark_read_ready(config, chan, buf))
+		wake_up_interruptible(&chan->read_ready_wait);
 }
 
+/**
+ * lib_ring_buffer_channel_read_ready - fetch the channel readiness mask
+ * @chan: channel
+ * @mask: output mask of the cpus whose buffer had deliverable data
+ *
+ * Fetch and clear the set of per-cpu buffers which had data to deliver since
+ * the last call. A buffer is only reported once per transition, so readers
+ * should drain each reported buffer until it returns -EAGAIN. Returns the
+ * number of cpus set in @mask, or -EINVAL for channels which are not
+ * allocated per-cpu.
+ */
+int lib_ring_buffer_channel_read_ready(struct lttng_kernel_ring_buffer_channel *chan,
+				       struct cpumask *mask)
+{
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long *ready = cpumask_bits(chan->read_ready);
+	unsigned int i;
+	int nr;
+
+	if (config->alloc != RING_BUFFER_ALLOC_PER_CPU)
+		return -EINVAL;
+	for (i = 0; i < BITS_TO_LONGS(nr_cpumask_bits); i++)
+		cpumask_bits(mask)[i] = xchg(&ready[i], 0);
+	nr = cpumask_weight(mask);
+	/*
+	 * Buffers marked concurrently either had their bit fetched above, or
+	 * will see the count drop to zero and issue the next wakeup.
+	 */
+	atomic_sub(nr, &chan->read_ready_count);
+	return nr;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_channel_read_ready);
+
 /*
  * Must be called under cpu hotplug protection.
  */
@@ -242,16 +501,27 @@ int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 	/*
 	 * Paranoia: per cpu dynamic allocation is not officially documented as
 	 * zeroing the memory, so let's do it here too, just in case.
+	 * Leave record_disabled alone: it keeps concurrent writers out of
+	 * lazily allocated buffers. So is records_lost_unavailable, where
+	 * they count the records they drop.
 	 */
-	memset(buf, 0, sizeof(*buf));
+	BUILD_BUG_ON(offsetof(struct lttng_kernel_ring_buffer, records_lost_unavailable)
+		     < offsetofend(struct lttng_kernel_ring_buffer, record_disabled));
+	memset(buf, 0, offsetof(struct lttng_kernel_ring_buffer, record_disabled));
+	memset((char *) buf + offsetofend(struct lttng_kernel_ring_buffer, record_disabled),
+	       0, offsetof(struct lttng_kernel_ring_buffer, records_lost_unavailable)
+		  - offsetofend(struct lttng_kernel_ring_buffer, record_disabled));
+	memset((char *) buf + offsetofend(struct lttng_kernel_ring_buffer, records_lost_unavailable),
+	       0, sizeof(*buf) - offsetofend(struct lttng_kernel_ring_buffer, records_lost_unavailable));
 
 	ret = lib_ring_buffer_backend_create(&buf->backend, &chan->backend, cpu);
 	if (ret)
 		return ret;
+	buf->commit_count_mask = (~0UL >> buf->backend.num_subbuf_order);
 
 	buf->commit_hot =
 		lttng_kvzalloc_node(ALIGN(sizeof(*buf->commit_hot)
-				   * chan->backend.num_subbuf,
+				   * buf->backend.num_subbuf,
 				   1 << INTERNODE_CACHE_SHIFT),
 			GFP_KERNEL | __GFP_NOWARN,
 			cpu_to_node(max(cpu, 0)));
@@ -262,7 +532,7 @@ int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 
 	buf->commit_cold =
 		lttng_kvzalloc_node(ALIGN(sizeof(*buf->commit_cold)
-				   * chan->backend.num_subbuf,
+				   * buf->backend.num_subbuf,
 				   1 << INTERNODE_CACHE_SHIFT),
 			GFP_KERNEL | __GFP_NOWARN,
 			cpu_to_node(max(cpu, 0)));
@@ -273,7 +543,7 @@ int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 
 	buf->ts_end =
 		lttng_kvzalloc_node(ALIGN(sizeof(*buf->ts_end)
-				   * chan->backend.num_subbuf,
+				   * buf->backend.num_subbuf,
 				   1 << INTERNODE_CACHE_SHIFT),
 			GFP_KERNEL | __GFP_NOWARN,
 			cpu_to_node(max(cpu, 0)));
@@ -282,10 +552,36 @@ int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 		goto free_commit_cold;
 	}
 
+	if (config->output == RING_BUFFER_SPLICE
+	    || config->output == RING_BUFFER_MMAP) {
+		buf->control = vmalloc_user(lib_ring_buffer_control_len(chan));
+		if (!buf->control) {
+			ret = -ENOMEM;
+			goto free_ts_end;
+		}
+		lib_ring_buffer_control_reset(buf);
+	}
+
+	ret = lib_ring_buffer_compress_alloc(buf);
+	if (ret)
+		goto free_control;
+
+	if (config->packet_index_size
+	    && (config->output == RING_BUFFER_SPLICE
+		|| config->output == RING_BUFFER_MMAP)) {
+		buf->index = vmalloc_user(lib_ring_buffer_index_len(chan));
+		if (!buf->index) {
+			ret = -ENOMEM;
+			goto free_compress;
+		}
+	}
+
 	init_waitqueue_head(&buf->read_wait);
 	init_waitqueue_head(&buf->write_wait);
 	init_irq_work(&buf->wakeup_pending, lib_ring_buffer_pending_wakeup_buf);
+	init_irq_work(&buf->switch_timer_rearm, lib_ring_buffer_switch_timer_rearm);
 	raw_spin_lock_init(&buf->raw_tick_nohz_spinlock);
+	mutex_init(&buf->resize_mutex);
 
 	/*
 	 * Write the subbuffer header for first subbuffer so we know the total
@@ -293,9 +589,15 @@ int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 	 */
 	subbuf_header_size = config->cb.subbuffer_header_size();
 	v_set(config, &buf->offset, subbuf_header_size);
+	/*
+	 * Not an offset the buffer can reach before the first reclaim scan,
+	 * which only records the offset it finds.
+	 */
+	buf->lazy_reclaim_offset = subbuf_header_size - 1;
 	subbuffer_id_clear_noref(config, &buf->backend.buf_wsb[0].id);
 	timestamp = config->cb.ring_buffer_clock_read(buf->backend.chan);
 	config->cb.buffer_begin(buf, timestamp, 0);
+	lib_ring_buffer_control_begin(buf, 0, timestamp);
 	v_add(config, subbuf_header_size, &buf->commit_hot[0].cc);
 
 	if (config->cb.buffer_create) {
@@ -322,6 +624,12 @@ int lib_ring_buffer_create(struct lttng_kernel_ring_buffer *buf,
 
 	/* Error handling */
 free_init:
+	vfree(buf->index);
+free_compress:
+	lib_ring_buffer_compress_free(buf);
+free_control:
+	vfree(buf->control);
+free_ts_end:
 	lttng_kvfree(buf->ts_end);
 free_commit_cold:
 	lttng_kvfree(buf->commit_cold);
@@ -332,24 +640,75 @@ free_chanbuf:
 	return ret;
 }
 
+/*
+ * Adaptive switch timer (RING_BUFFER_CHANNEL_ADAPTIVE_SWITCH_TIMER): only
+ * flush the buffer if it was written to since the previous flush. Each
+ * expiry finding the buffer idle doubles the timer period, up to
+ * 2^switch_timer_max_backoff times the channel period. The period goes back
+ * to the channel period as soon as writes resume: the reserve slow path
+ * re-arms a backed off timer through lib_ring_buffer_switch_timer_rearm().
+ * Returns the period shift.
+ *
+ * Called from the switch timer, or from the nohz flush on the buffer cpu.
+ */
+static unsigned int lib_ring_buffer_switch_timer_adapt(const struct lttng_kernel_ring_buffer_config *config,
+						       struct lttng_kernel_ring_buffer *buf)
+{
+	unsigned int max_backoff;
+
+	max_backoff = min_t(unsigned int,
+			    READ_ONCE(lib_ring_buffer_switch_timer_max_backoff),
+			    RING_BUFFER_SWITCH_TIMER_BACKOFF_LIMIT);
+	if (v_read(config, &buf->offset) == buf->switch_timer_offset) {
+		if (buf->switch_timer_backoff < max_backoff)
+			buf->switch_timer_backoff++;
+	} else {
+		lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+		buf->switch_timer_offset = v_read(config, &buf->offset);
+		buf->switch_timer_backoff = 0;
+	}
+	return min(buf->switch_timer_backoff, max_backoff);
+}
+
 static void switch_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
 {
 	struct lttng_kernel_ring_buffer *buf = lttng_from_timer(buf, t, switch_timer);
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long interval = chan->switch_timer_interval;
 
 	/*
 	 * Only flush buffers periodically if readers are active.
 	 */
-	if (atomic_long_read(&buf->active_readers))
-		lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+	if (atomic_long_read(&buf->active_readers)) {
+		if (chan->backend.adaptive_switch_timer)
+			interval <<= lib_ring_buffer_switch_timer_adapt(config, buf);
+		else
+			lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+	}
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		lttng_mod_timer_pinned(&buf->switch_timer,
-				 jiffies + chan->switch_timer_interval);
+		lttng_mod_timer_pinned(&buf->switch_timer, jiffies + interval);
 	else
-		mod_timer(&buf->switch_timer,
-			  jiffies + chan->switch_timer_interval);
+		mod_timer(&buf->switch_timer, jiffies + interval);
+}
+
+/*
+ * Writes resumed on a buffer whose switch timer backed off: bring the next
+ * expiry back within the channel period. Runs from irq work on the writer
+ * cpu, which owns the pinned timer of per-cpu buffers. Only a pending timer
+ * is modified, so a concurrently stopped timer stays stopped.
+ */
+static
+void lib_ring_buffer_switch_timer_rearm(struct irq_work *entry)
+{
+	struct lttng_kernel_ring_buffer *buf = container_of(entry, struct lttng_kernel_ring_buffer,
+						   switch_timer_rearm);
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+
+	WRITE_ONCE(buf->switch_timer_backoff, 0);
+	lttng_mod_timer_pending_pinned(&buf->switch_timer,
+				       jiffies + chan->switch_timer_interval);
 }
 
 /*
@@ -361,7 +720,8 @@ static void lib_ring_buffer_start_switch_timer(struct lttng_kernel_ring_buffer *
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 	unsigned int flags = 0;
 
-	if (!chan->switch_timer_interval || buf->switch_timer_enabled)
+	if (!chan->switch_timer_interval || buf->switch_timer_enabled
+	    || !buf->backend.allocated)
 		return;
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
@@ -369,6 +729,7 @@ static void lib_ring_buffer_start_switch_timer(struct lttng_kernel_ring_buffer *
 
 	lttng_timer_setup(&buf->switch_timer, switch_buffer_timer, flags, buf);
 	buf->switch_timer.expires = jiffies + chan->switch_timer_interval;
+	buf->switch_timer_backoff = 0;
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
 		add_timer_on(&buf->switch_timer, buf->backend.cpu);
@@ -404,10 +765,8 @@ static void read_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
 	CHAN_WARN_ON(chan, !buf->backend.allocated);
 
 	if (atomic_long_read(&buf->active_readers)
-	    && lib_ring_buffer_poll_deliver(config, buf, chan)) {
-		wake_up_interruptible(&buf->read_wait);
-		wake_up_interruptible(&chan->read_wait);
-	}
+	    && lib_ring_buffer_poll_deliver(config, buf, chan))
+		lib_ring_buffer_wakeup_readers(config, chan, buf);
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
 		lttng_mod_timer_pinned(&buf->read_timer,
@@ -417,6 +776,24 @@ static void read_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
 			  jiffies + chan->read_timer_interval);
 }
 
+/*
+ * The read timer polls for data with RING_BUFFER_WAKEUP_BY_TIMER. With
+ * RING_BUFFER_WAKEUP_BY_WRITER and a wakeup watermark, it bounds the latency
+ * of the wakeups held back by the watermark.
+ */
+static bool lib_ring_buffer_read_timer_wanted(const struct lttng_kernel_ring_buffer_config *config,
+					      struct lttng_kernel_ring_buffer_channel *chan)
+{
+	switch (config->wakeup) {
+	case RING_BUFFER_WAKEUP_BY_TIMER:
+		return true;
+	case RING_BUFFER_WAKEUP_BY_WRITER:
+		return chan->wakeup_watermark > 1;
+	default:
+		return false;
+	}
+}
+
 /*
  * Called with ring_buffer_nohz_lock held for per-cpu buffers.
  */
@@ -426,9 +803,10 @@ static void lib_ring_buffer_start_read_timer(struct lttng_kernel_ring_buffer *bu
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 	unsigned int flags = 0;
 
-	if (config->wakeup != RING_BUFFER_WAKEUP_BY_TIMER
+	if (!lib_ring_buffer_read_timer_wanted(config, chan)
 	    || !chan->read_timer_interval
-	    || buf->read_timer_enabled)
+	    || buf->read_timer_enabled
+	    || !buf->backend.allocated)
 		return;
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
@@ -453,7 +831,7 @@ static void lib_ring_buffer_stop_read_timer(struct lttng_kernel_ring_buffer *buf
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 
-	if (config->wakeup != RING_BUFFER_WAKEUP_BY_TIMER
+	if (!lib_ring_buffer_read_timer_wanted(config, chan)
 	    || !chan->read_timer_interval
 	    || !buf->read_timer_enabled)
 		return;
@@ -463,13 +841,83 @@ static void lib_ring_buffer_stop_read_timer(struct lttng_kernel_ring_buffer *buf
 	 * do one more check to catch data that has been written in the last
 	 * timer period.
 	 */
-	if (lib_ring_buffer_poll_deliver(config, buf, chan)) {
-		wake_up_interruptible(&buf->read_wait);
-		wake_up_interruptible(&chan->read_wait);
-	}
+	if (lib_ring_buffer_poll_deliver(config, buf, chan))
+		lib_ring_buffer_wakeup_readers(config, chan, buf);
 	buf->read_timer_enabled = 0;
 }
 
+/**
+ * lib_ring_buffer_channel_set_wakeup_watermark - coalesce writer wakeups
+ * @chan: channel
+ * @watermark: number of sub-buffers ready to read before waking readers
+ * @max_latency: maximum delay (in us) of a wakeup held back by the watermark
+ *
+ * For RING_BUFFER_WAKEUP_BY_WRITER channels, wake up readers only once
+ * @watermark sub-buffers are ready rather than at each sub-buffer delivery.
+ * The read timer wakes up readers of buffers holding fewer sub-buffers every
+ * @max_latency us, which bounds the wakeup delay of low-volume buffers. A
+ * watermark of 0 or 1 restores a wakeup per delivered sub-buffer.
+ */
+int lib_ring_buffer_channel_set_wakeup_watermark(struct lttng_kernel_ring_buffer_channel *chan,
+						 unsigned long watermark,
+						 unsigned int max_latency)
+{
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_kernel_ring_buffer *buf;
+	int cpu;
+
+	int ret = 0;
+
+	if (config->wakeup != RING_BUFFER_WAKEUP_BY_WRITER)
+		return -EINVAL;
+	if (watermark > chan->backend.num_subbuf
+	    || (watermark > 1 && !max_latency))
+		return -EINVAL;
+
+	/*
+	 * channel_destroy() stops the read timers for good: do not restart
+	 * them past that point. The lazy allocation work starts the read
+	 * timer of the buffers it creates.
+	 */
+	mutex_lock(&chan->wakeup_mutex);
+	if (chan->finalized) {
+		ret = -EBUSY;
+		goto end;
+	}
+	if (chan->backend.lazy_alloc)
+		mutex_lock(&chan->lazy_mutex);
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+		lttng_cpus_read_lock();
+		for_each_online_cpu(cpu) {
+			buf = per_cpu_ptr(chan->backend.buf, cpu);
+			spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+			lib_ring_buffer_stop_read_timer(buf);
+			spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+		}
+		WRITE_ONCE(chan->wakeup_watermark, watermark);
+		chan->read_timer_interval = usecs_to_jiffies(max_latency);
+		for_each_online_cpu(cpu) {
+			buf = per_cpu_ptr(chan->backend.buf, cpu);
+			spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+			lib_ring_buffer_start_read_timer(buf);
+			spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+		}
+		lttng_cpus_read_unlock();
+	} else {
+		buf = chan->backend.buf;
+		lib_ring_buffer_stop_read_timer(buf);
+		WRITE_ONCE(chan->wakeup_watermark, watermark);
+		chan->read_timer_interval = usecs_to_jiffies(max_latency);
+		lib_ring_buffer_start_read_timer(buf);
+	}
+	if (chan->backend.lazy_alloc)
+		mutex_unlock(&chan->lazy_mutex);
+end:
+	mutex_unlock(&chan->wakeup_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_channel_set_wakeup_watermark);
+
 #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,10,0))
 
 enum cpuhp_state lttng_rb_hp_prepare;
@@ -497,6 +945,10 @@ int lttng_cpuhp_rb_frontend_dead(unsigned int cpu,
 
 	CHAN_WARN_ON(chan, config->alloc == RING_BUFFER_ALLOC_GLOBAL);
 
+	/* Lazily allocated buffer never used. */
+	if (!buf->backend.allocated)
+		return 0;
+
 	/*
 	 * Performing a buffer switch on a remote CPU. Performed by
 	 * the CPU responsible for doing the hotunplug after the target
@@ -587,6 +1039,9 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 
 	case CPU_DEAD:
 	case CPU_DEAD_FROZEN:
+		/* Lazily allocated buffer never used. */
+		if (!buf->backend.allocated)
+			return NOTIFY_OK;
 		/*
 		 * Performing a buffer switch on a remote CPU. Performed by
 		 * the CPU responsible for doing the hotunplug after the target
@@ -636,6 +1091,9 @@ static int notrace ring_buffer_tick_nohz_callback(struct notifier_block *nb,
 	}
 
 	buf = channel_get_ring_buffer(config, chan, cpu);
+	/* Lazily allocated buffer not populated yet. */
+	if (!buf->backend.allocated)
+		return 0;
 	switch (val) {
 	case TICK_NOHZ_FLUSH:
 		raw_spin_lock(&buf->raw_tick_nohz_spinlock);
@@ -643,12 +1101,18 @@ static int notrace ring_buffer_tick_nohz_callback(struct notifier_block *nb,
 		    && chan->read_timer_interval
 		    && atomic_long_read(&buf->active_readers)
 		    && (lib_ring_buffer_poll_deliver(config, buf, chan)
-			|| lib_ring_buffer_pending_data(config, buf, chan))) {
-			wake_up_interruptible(&buf->read_wait);
-			wake_up_interruptible(&chan->read_wait);
+			|| lib_ring_buffer_pending_data(config, buf, chan)))
+			lib_ring_buffer_wakeup_readers(config, chan, buf);
+		if (chan->switch_timer_interval) {
+			/*
+			 * Don't produce empty packets for cpus going idle
+			 * without having written since the last flush.
+			 */
+			if (chan->backend.adaptive_switch_timer)
+				lib_ring_buffer_switch_timer_adapt(config, buf);
+			else
+				lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
 		}
-		if (chan->switch_timer_interval)
-			lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
 		raw_spin_unlock(&buf->raw_tick_nohz_spinlock);
 		break;
 	case TICK_NOHZ_STOP:
@@ -811,12 +1275,199 @@ void lib_ring_buffer_clear_quiescent_channel(struct lttng_kernel_ring_buffer_cha
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_clear_quiescent_channel);
 
+/**
+ * lib_ring_buffer_lazy_alloc_request - request allocation of a per-cpu buffer
+ * @chan: channel
+ * @cpu: cpu of the buffer
+ *
+ * Called from the tracing fast path when a writer hits a lazily allocated
+ * buffer which is not populated yet. Safe from any context, including NMI:
+ * allocation is deferred to a worker thread.
+ */
+void lib_ring_buffer_lazy_alloc_request(struct lttng_kernel_ring_buffer_channel *chan,
+		int cpu)
+{
+	if (!chan->backend.lazy_alloc)
+		return;
+	if (cpumask_test_and_set_cpu(cpu, chan->lazy_alloc_pending))
+		return;
+	irq_work_queue(&chan->lazy_alloc_irq_work);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_lazy_alloc_request);
+
+static void lib_ring_buffer_lazy_alloc_irq_work(struct irq_work *entry)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = container_of(entry,
+			struct lttng_kernel_ring_buffer_channel, lazy_alloc_irq_work);
+
+	schedule_work(&chan->lazy_alloc_work);
+}
+
+static void lib_ring_buffer_lazy_alloc_work(struct work_struct *work)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = container_of(work,
+			struct lttng_kernel_ring_buffer_channel, lazy_alloc_work);
+	unsigned int reclaim_ms = READ_ONCE(lib_ring_buffer_lazy_reclaim_ms);
+	int cpu;
+
+	mutex_lock(&chan->lazy_mutex);
+	lttng_cpus_read_lock();
+	for_each_possible_cpu(cpu) {
+		struct lttng_kernel_ring_buffer *buf = per_cpu_ptr(chan->backend.buf, cpu);
+		int ret;
+
+		if (!cpumask_test_and_clear_cpu(cpu, chan->lazy_alloc_pending))
+			continue;
+		/*
+		 * Writers of an offline cpu will ask again when it comes
+		 * back online.
+		 */
+		if (READ_ONCE(chan->finalized) || !cpu_online(cpu))
+			continue;
+		/*
+		 * Writers racing with a previous run of this work ask again
+		 * while the buffer is being created: only the run which
+		 * allocates it lets writers in.
+		 */
+		if (buf->backend.allocated)
+			continue;
+		ret = lib_ring_buffer_create(buf, &chan->backend, cpu);
+		if (ret) {
+			printk(KERN_ERR
+			  "LTTng: cpu %d lazy buffer creation failed\n", cpu);
+			continue;
+		}
+		spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+		lib_ring_buffer_start_switch_timer(buf);
+		lib_ring_buffer_start_read_timer(buf);
+		spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+		/* Let writers in, then advertise the new stream. */
+		atomic_dec(&buf->record_disabled);
+		wake_up_interruptible(&chan->hp_wait);
+		/* Only a populated buffer can be reclaimed. */
+		if (reclaim_ms)
+			schedule_delayed_work(&chan->lazy_reclaim_work,
+					      msecs_to_jiffies(reclaim_ms));
+	}
+	lttng_cpus_read_unlock();
+	mutex_unlock(&chan->lazy_mutex);
+}
+
+/*
+ * Wait for writers which may have passed the record_disabled check.
+ * Writers run with preemption disabled.
+ */
+static void lib_ring_buffer_wait_writers(void)
+{
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,1,0) || \
+	LTTNG_RHEL_KERNEL_RANGE(4,18,0,193,0,0, 4,19,0,0,0,0))
+	synchronize_rcu();
+#else
+	synchronize_sched();
+#endif
+}
+
+/*
+ * Free a lazily allocated buffer if no reader has it open, no event was
+ * written to it since the previous scan, and it holds no unconsumed data
+ * besides the header of the current sub-buffer. The buffer goes back to the
+ * unpopulated state, so its next writer allocates it again.
+ *
+ * Called with the channel lazy_mutex and cpu hotplug held.
+ */
+static void lib_ring_buffer_lazy_try_reclaim(struct lttng_kernel_ring_buffer *buf, int cpu)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long offset;
+
+	offset = v_read(config, &buf->offset);
+	if (offset != buf->lazy_reclaim_offset) {
+		buf->lazy_reclaim_offset = offset;
+		return;
+	}
+	if (subbuf_trunc(offset, chan) - atomic_long_read(&buf->consumed)
+	    || subbuf_offset(offset, chan) > config->cb.subbuffer_header_size())
+		return;
+	/* Hold off readers. */
+	if (!atomic_long_add_unless(&buf->active_readers, 1, 1))
+		return;
+	atomic_inc(&buf->record_disabled);
+	lib_ring_buffer_wait_writers();
+	if (v_read(config, &buf->offset) != offset) {
+		atomic_dec(&buf->record_disabled);
+		atomic_long_dec(&buf->active_readers);
+		return;
+	}
+	spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+	lib_ring_buffer_stop_switch_timer(buf);
+	lib_ring_buffer_stop_read_timer(buf);
+	spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+	cpumask_clear_cpu(cpu, chan->backend.cpumask);
+	lib_ring_buffer_free(buf);
+}
+
+static void lib_ring_buffer_lazy_reclaim_work(struct work_struct *work)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = container_of(work,
+			struct lttng_kernel_ring_buffer_channel, lazy_reclaim_work.work);
+	unsigned int interval_ms = READ_ONCE(lib_ring_buffer_lazy_reclaim_ms);
+	bool populated;
+	int cpu;
+
+	/* Armed again by the next allocation once reclaim is enabled. */
+	if (!interval_ms)
+		return;
+	mutex_lock(&chan->lazy_mutex);
+	lttng_cpus_read_lock();
+	for_each_channel_cpu(cpu, chan)
+		lib_ring_buffer_lazy_try_reclaim(per_cpu_ptr(chan->backend.buf, cpu), cpu);
+	populated = !cpumask_empty(chan->backend.cpumask);
+	lttng_cpus_read_unlock();
+	mutex_unlock(&chan->lazy_mutex);
+	if (populated)
+		schedule_delayed_work(&chan->lazy_reclaim_work,
+				      msecs_to_jiffies(interval_ms));
+}
+
+static void lib_ring_buffer_resize_work(struct work_struct *work)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = container_of(work,
+			struct lttng_kernel_ring_buffer_channel, resize_work.work);
+	unsigned int interval_ms = READ_ONCE(lib_ring_buffer_resize_interval_ms);
+	int cpu;
+
+	/* Armed again by the reader once resizing is enabled. */
+	if (!interval_ms)
+		return;
+	/* Lazily allocated buffers must not be reclaimed while resized. */
+	if (chan->backend.lazy_alloc)
+		mutex_lock(&chan->lazy_mutex);
+	lttng_cpus_read_lock();
+	for_each_channel_cpu(cpu, chan) {
+		struct lttng_kernel_ring_buffer *buf = per_cpu_ptr(chan->backend.buf, cpu);
+
+		/* -EBUSY and -EAGAIN are retried at the next sample. */
+		(void) __lib_ring_buffer_resize(buf,
+				lib_ring_buffer_resize_sample(buf));
+	}
+	lttng_cpus_read_unlock();
+	if (chan->backend.lazy_alloc)
+		mutex_unlock(&chan->lazy_mutex);
+	schedule_delayed_work(&chan->resize_work,
+			      msecs_to_jiffies(interval_ms));
+}
+
 static void channel_free(struct lttng_kernel_ring_buffer_channel *chan)
 {
 	if (chan->backend.release_priv_ops) {
 		chan->backend.release_priv_ops(chan->backend.priv_ops);
 	}
 	channel_iterator_free(chan);
+	if (chan->backend.lazy_alloc)
+		free_cpumask_var(chan->lazy_alloc_pending);
+	if (chan->backend.config.alloc == RING_BUFFER_ALLOC_PER_CPU)
+		free_cpumask_var(chan->read_ready);
 	channel_backend_free(&chan->backend);
 	kfree(chan);
 }
@@ -835,6 +1486,7 @@ static void channel_free(struct lttng_kernel_ring_buffer_channel *chan)
  *                         padding to let readers get those sub-buffers.
  *                         Used for live streaming.
  * @read_timer_interval: Time interval (in us) to wake up pending readers.
+ * @flags: RING_BUFFER_CHANNEL_* channel creation flags.
  *
  * Holds cpu hotplug.
  * Returns NULL on failure.
@@ -843,7 +1495,7 @@ struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kerne
 		   const char *name, void *priv, void *buf_addr,
 		   size_t subbuf_size,
 		   size_t num_subbuf, unsigned int switch_timer_interval,
-		   unsigned int read_timer_interval)
+		   unsigned int read_timer_interval, unsigned int flags)
 {
 	int ret;
 	struct lttng_kernel_ring_buffer_channel *chan;
@@ -856,21 +1508,37 @@ struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kerne
 	if (!chan)
 		return NULL;
 
+	if (flags & RING_BUFFER_CHANNEL_LAZY_ALLOC) {
+		if (!zalloc_cpumask_var(&chan->lazy_alloc_pending, GFP_KERNEL))
+			goto error;
+		init_irq_work(&chan->lazy_alloc_irq_work,
+			      lib_ring_buffer_lazy_alloc_irq_work);
+		INIT_WORK(&chan->lazy_alloc_work, lib_ring_buffer_lazy_alloc_work);
+		INIT_DELAYED_WORK(&chan->lazy_reclaim_work,
+				  lib_ring_buffer_lazy_reclaim_work);
+		mutex_init(&chan->lazy_mutex);
+	}
+	mutex_init(&chan->wakeup_mutex);
+	INIT_DELAYED_WORK(&chan->resize_work, lib_ring_buffer_resize_work);
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU
+	    && !zalloc_cpumask_var(&chan->read_ready, GFP_KERNEL))
+		goto error_free_pending;
+
 	ret = channel_backend_init(&chan->backend, name, config, priv,
-				   subbuf_size, num_subbuf);
+				   subbuf_size, num_subbuf, flags);
 	if (ret)
-		goto error;
+		goto error_free_ready;
 
 	ret = channel_iterator_init(chan);
 	if (ret)
 		goto error_free_backend;
 
-	chan->commit_count_mask = (~0UL >> chan->backend.num_subbuf_order);
 	chan->switch_timer_interval = usecs_to_jiffies(switch_timer_interval);
 	chan->read_timer_interval = usecs_to_jiffies(read_timer_interval);
 	kref_init(&chan->ref);
 	init_waitqueue_head(&chan->read_wait);
 	init_waitqueue_head(&chan->hp_wait);
+	init_waitqueue_head(&chan->read_ready_wait);
 	init_irq_work(&chan->wakeup_pending, lib_ring_buffer_pending_wakeup_chan);
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
@@ -940,6 +1608,9 @@ struct lttng_kernel_ring_buffer_channel *channel_create(const struct lttng_kerne
 		lib_ring_buffer_start_read_timer(buf);
 	}
 
+	if (chan->backend.auto_resize)
+		schedule_delayed_work(&chan->resize_work, 0);
+
 	return chan;
 
 #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,10,0))
@@ -951,6 +1622,12 @@ cpuhp_prepare_error:
 #endif /* #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,10,0)) */
 error_free_backend:
 	channel_backend_free(&chan->backend);
+error_free_ready:
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+		free_cpumask_var(chan->read_ready);
+error_free_pending:
+	if (flags & RING_BUFFER_CHANNEL_LAZY_ALLOC)
+		free_cpumask_var(chan->lazy_alloc_pending);
 error:
 	kfree(chan);
 	return NULL;
@@ -982,7 +1659,17 @@ void *channel_destroy(struct lttng_kernel_ring_buffer_channel *chan)
 	void *priv;
 
 	irq_work_sync(&chan->wakeup_pending);
+	if (chan->backend.lazy_alloc) {
+		/* The allocation work arms the reclaim work. */
+		irq_work_sync(&chan->lazy_alloc_irq_work);
+		cancel_work_sync(&chan->lazy_alloc_work);
+		cancel_delayed_work_sync(&chan->lazy_reclaim_work);
+	}
+	if (chan->backend.auto_resize)
+		cancel_delayed_work_sync(&chan->resize_work);
 
+	/* Wakeup watermark updates must not restart the read timers. */
+	mutex_lock(&chan->wakeup_mutex);
 	channel_unregister_notifiers(chan);
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
@@ -1018,8 +1705,10 @@ void *channel_destroy(struct lttng_kernel_ring_buffer_channel *chan)
 		wake_up_interruptible(&buf->read_wait);
 	}
 	WRITE_ONCE(chan->finalized, 1);
+	mutex_unlock(&chan->wakeup_mutex);
 	wake_up_interruptible(&chan->hp_wait);
 	wake_up_interruptible(&chan->read_wait);
+	wake_up_interruptible(&chan->read_ready_wait);
 	priv = chan->backend.priv;
 	kref_put(&chan->ref, channel_release);
 	return priv;
@@ -1057,6 +1746,8 @@ void lib_ring_buffer_release_read(struct lttng_kernel_ring_buffer *buf)
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
 
 	CHAN_WARN_ON(chan, atomic_long_read(&buf->active_readers) != 1);
+	if (buf->writeout)
+		(void) lib_ring_buffer_stop_writeout(buf);
 	smp_mb__before_atomic();
 	atomic_long_dec(&buf->active_readers);
 	kref_put(&chan->ref, channel_release);
@@ -1168,6 +1859,71 @@ int lib_ring_buffer_snapshot_sample_positions(struct lttng_kernel_ring_buffer *b
 	return 0;
 }
 
+/**
+ * lib_ring_buffer_snapshot_since - incremental snapshot
+ * @buf: ring buffer
+ * @since: produced position returned by a previous snapshot
+ * @consumed: consumed count indicating the first sub-buffer to read
+ * @produced: produced count indicating the end of the readable sub-buffers
+ *
+ * Performs the same function as lib_ring_buffer_snapshot(), but only
+ * reports the sub-buffers produced since the @since position, so periodic
+ * flight recorder snapshots don't read the same sub-buffers again. Falls
+ * back to a full snapshot when @since has already been overwritten or is
+ * ahead of the writer (buffer cleared or reset).
+ *
+ * Returns -EAGAIN (-ENODATA if finalized) if no sub-buffer was produced
+ * since @since.
+ */
+int lib_ring_buffer_snapshot_since(struct lttng_kernel_ring_buffer *buf,
+				   unsigned long since,
+				   unsigned long *consumed,
+				   unsigned long *produced)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	int ret;
+
+	ret = lib_ring_buffer_snapshot(buf, consumed, produced);
+	if (ret)
+		return ret;
+	since = subbuf_trunc(since, chan);
+	if ((long) (since - *consumed) <= 0 || (long) (*produced - since) < 0)
+		return 0;
+	if (since == *produced)
+		return LTTNG_READ_ONCE(buf->finalized) ? -ENODATA : -EAGAIN;
+	*consumed = since;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_snapshot_since);
+
+/**
+ * lib_ring_buffer_get_stats - read the buffer statistics
+ * @buf: ring buffer
+ * @stats: statistics output
+ *
+ * Counters are read one by one while tracing is active, so they are not
+ * a consistent snapshot.
+ */
+void lib_ring_buffer_get_stats(struct lttng_kernel_ring_buffer *buf,
+			       struct lttng_kernel_abi_ring_buffer_stats *stats)
+{
+	const struct lttng_kernel_ring_buffer_config *config = &buf->backend.chan->backend.config;
+
+	stats->reserve_fast = (unsigned long) v_read(config, &buf->stats.reserve_fast);
+	stats->reserve_slow = (unsigned long) v_read(config, &buf->stats.reserve_slow);
+	stats->reserve_slow_time = (unsigned long) v_read(config, &buf->stats.reserve_slow_time);
+	stats->switch_slow = (unsigned long) v_read(config, &buf->stats.switch_slow);
+	stats->deliver = (unsigned long) v_read(config, &buf->stats.deliver);
+	stats->deliver_latency = (unsigned long) v_read(config, &buf->stats.deliver_latency);
+	stats->deliver_latency_max = (unsigned long) v_read(config, &buf->stats.deliver_latency_max);
+	stats->fill_max = (unsigned long) v_read(config, &buf->stats.fill_max);
+	stats->records_lost_full = (unsigned long) v_read(config, &buf->records_lost_full);
+	stats->records_lost_wrap = (unsigned long) v_read(config, &buf->records_lost_wrap);
+	stats->records_lost_big = (unsigned long) v_read(config, &buf->records_lost_big);
+	stats->records_lost_unavailable = (unsigned long) atomic_long_read(&buf->records_lost_unavailable);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_get_stats);
+
 /**
  * lib_ring_buffer_put_snapshot - move consumed counter forward
  *
@@ -1193,6 +1949,8 @@ void lib_ring_buffer_move_consumer(struct lttng_kernel_ring_buffer *buf,
 	while ((long) consumed - (long) consumed_new < 0)
 		consumed = atomic_long_cmpxchg(&buf->consumed, consumed,
 					       consumed_new);
+	if (buf->control)
+		WRITE_ONCE(buf->control->consumed, atomic_long_read(&buf->consumed));
 	/* Wake-up the metadata producer */
 	wake_up_interruptible(&buf->write_wait);
 }
@@ -1205,7 +1963,7 @@ static void lib_ring_buffer_flush_read_subbuf_dcache(
 		struct lttng_kernel_ring_buffer *buf)
 {
 	struct lttng_kernel_ring_buffer_backend_pages *pages;
-	unsigned long sb_bindex, id, i, nr_pages;
+	unsigned long sb_bindex, id, i, j, nr_pages;
 
 	if (config->output != RING_BUFFER_MMAP)
 		return;
@@ -1227,17 +1985,21 @@ static void lib_ring_buffer_flush_read_subbuf_dcache(
 	 * based on the kernel linear mapping, aligning it with the
 	 * user-space mapping is not straightforward, and would require
 	 * extra TLB entries. Therefore, simply flush the dcache for the
-	 * entire sub-buffer before reading it.
+	 * entire sub-buffers held before reading them.
 	 */
-	id = buf->backend.buf_rsb.id;
-	sb_bindex = subbuffer_id_get_index(config, id);
-	pages = buf->backend.array[sb_bindex];
 	nr_pages = buf->backend.num_pages_per_subbuf;
-	for (i = 0; i < nr_pages; i++) {
-		struct lttng_kernel_ring_buffer_backend_page *backend_page;
-
-		backend_page = &pages->p[i];
-		flush_dcache_page(pfn_to_page(backend_page->pfn));
+	for (j = 0; j < buf->get_subbuf_nr; j++) {
+		id = subbuffer_read_id(config, &buf->backend,
+				buf->get_subbuf_consumed
+				+ (j << chan->backend.subbuf_size_order));
+		sb_bindex = subbuffer_id_get_index(config, id);
+		pages = buf->backend.array[sb_bindex];
+		for (i = 0; i < nr_pages; i++) {
+			struct lttng_kernel_ring_buffer_backend_page *backend_page;
+
+			backend_page = &pages->p[i];
+			flush_dcache_page(pfn_to_page(backend_page->pfn));
+		}
 	}
 }
 #else
@@ -1249,21 +2011,41 @@ static void lib_ring_buffer_flush_read_subbuf_dcache(
 }
 #endif
 
-/**
- * lib_ring_buffer_get_subbuf - get exclusive access to subbuffer for reading
- * @buf: ring buffer
- * @consumed: consumed count indicating the position where to read
- *
- * Returns -ENODATA if buffer is finalized, -EAGAIN if there is currently no
- * data to read at consumed position, or 0 if the get operation succeeds.
- * Busy-loop trying to get data if the tick_nohz sequence lock is held.
+/*
+ * Number of consecutive sub-buffers fully committed, starting at consumed,
+ * up to max_nr.
  */
-int lib_ring_buffer_get_subbuf(struct lttng_kernel_ring_buffer *buf,
-			       unsigned long consumed)
+static
+unsigned long lib_ring_buffer_committed_subbufs(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer *buf,
+		unsigned long consumed, unsigned long max_nr)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	unsigned long i;
+
+	for (i = 0; i < max_nr; i++) {
+		unsigned long pos, commit_count;
+
+		pos = consumed + (i << chan->backend.subbuf_size_order);
+		commit_count = v_read(config,
+				&buf->commit_cold[subbuf_index(pos, buf)].cc_sb);
+		if (((commit_count - chan->backend.subbuf_size)
+		     & buf->commit_count_mask)
+		    - (buf_trunc(pos, buf) >> buf->backend.num_subbuf_order)
+		    != 0)
+			break;
+	}
+	return i;
+}
+
+static
+int __lib_ring_buffer_get_subbuf(struct lttng_kernel_ring_buffer *buf,
+				 unsigned long consumed, unsigned long *nr)
 {
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
-	unsigned long consumed_cur, consumed_idx, commit_count, write_offset;
+	unsigned long consumed_cur, consumed_idx, write_offset, count;
+	long written;
 	int ret;
 	int finalized;
 
@@ -1274,6 +2056,7 @@ int lib_ring_buffer_get_subbuf(struct lttng_kernel_ring_buffer *buf,
 		CHAN_WARN_ON(chan, 1);
 		return -EBUSY;
 	}
+	mutex_lock(&buf->resize_mutex);
 retry:
 	finalized = LTTNG_READ_ONCE(buf->finalized);
 	/*
@@ -1281,8 +2064,8 @@ retry:
 	 */
 	smp_rmb();
 	consumed_cur = atomic_long_read(&buf->consumed);
-	consumed_idx = subbuf_index(consumed, chan);
-	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
+	consumed_idx = subbuf_index(consumed, buf);
+	count = lib_ring_buffer_committed_subbufs(config, buf, consumed, *nr);
 	/*
 	 * Make sure we read the commit count before reading the buffer
 	 * data and the write offset. Correct consumed offset ordering
@@ -1360,20 +2143,20 @@ retry:
 	 * Check that the subbuffer we are trying to consume has been
 	 * already fully committed.
 	 */
-	if (((commit_count - chan->backend.subbuf_size)
-	     & chan->commit_count_mask)
-	    - (buf_trunc(consumed, chan)
-	       >> chan->backend.num_subbuf_order)
-	    != 0)
+	if (!count)
 		goto nodata;
 
 	/*
 	 * Check that we are not about to read the same subbuffer in
 	 * which the writer head is.
 	 */
-	if (subbuf_trunc(write_offset, chan) - subbuf_trunc(consumed, chan)
-	    == 0)
+	written = (long) (subbuf_trunc(write_offset, chan)
+			  - subbuf_trunc(consumed, chan));
+	if (written == 0)
 		goto nodata;
+	if (written > 0)
+		count = min_t(unsigned long, count,
+			      written >> chan->backend.subbuf_size_order);
 
 	/*
 	 * Failure to get the subbuffer causes a busy-loop retry without going
@@ -1383,17 +2166,20 @@ retry:
 	 * looking for matches the one contained in the subbuffer id.
 	 */
 	ret = update_read_sb_index(config, &buf->backend, &chan->backend,
-				   consumed_idx, buf_trunc_val(consumed, chan));
+				   consumed_idx, buf_trunc_val(consumed, buf));
 	if (ret)
 		goto retry;
 	subbuffer_id_clear_noref(config, &buf->backend.buf_rsb.id);
 
 	buf->get_subbuf_consumed = consumed;
+	buf->get_subbuf_nr = count;
 	buf->get_subbuf = 1;
+	*nr = count;
 
 	lib_ring_buffer_flush_read_subbuf_dcache(config, chan, buf);
 
-	return 0;
+	ret = 0;
+	goto end;
 
 nodata:
 	/*
@@ -1401,14 +2187,65 @@ nodata:
 	 * of "raw_spin_is_locked" memory ordering.
 	 */
 	if (finalized)
-		return -ENODATA;
+		ret = -ENODATA;
 	else if (raw_spin_is_locked(&buf->raw_tick_nohz_spinlock))
 		goto retry;
 	else
-		return -EAGAIN;
+		ret = -EAGAIN;
+end:
+	mutex_unlock(&buf->resize_mutex);
+	return ret;
+}
+
+/**
+ * lib_ring_buffer_get_subbuf - get exclusive access to subbuffer for reading
+ * @buf: ring buffer
+ * @consumed: consumed count indicating the position where to read
+ *
+ * Returns -ENODATA if buffer is finalized, -EAGAIN if there is currently no
+ * data to read at consumed position, or 0 if the get operation succeeds.
+ * Busy-loop trying to get data if the tick_nohz sequence lock is held.
+ */
+int lib_ring_buffer_get_subbuf(struct lttng_kernel_ring_buffer *buf,
+			       unsigned long consumed)
+{
+	unsigned long nr = 1;
+
+	return __lib_ring_buffer_get_subbuf(buf, consumed, &nr);
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_get_subbuf);
 
+/**
+ * lib_ring_buffer_get_subbuf_batch - get exclusive access to consecutive subbuffers
+ * @buf: ring buffer
+ * @consumed: consumed count indicating the position where to read
+ * @nr: maximum number of subbuffers to get (input), number held (output)
+ *
+ * Same as lib_ring_buffer_get_subbuf(), but hands over every fully
+ * committed subbuffer starting at consumed, up to @nr, with a single
+ * memory barrier sequence. All of them are released by
+ * lib_ring_buffer_put_subbuf(). Only discard mode lets the reader hold
+ * more than one subbuffer: in overwrite mode, the reader owns a single
+ * subbuffer exchanged with the writer, so at most one is handed over.
+ * Compressed buffers also hand over one subbuffer at a time.
+ */
+int lib_ring_buffer_get_subbuf_batch(struct lttng_kernel_ring_buffer *buf,
+				     unsigned long consumed, unsigned long *nr)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+
+	if (!*nr)
+		return -EINVAL;
+	if (config->mode == RING_BUFFER_OVERWRITE || buf->compress) {
+		*nr = 1;
+		return lib_ring_buffer_get_subbuf(buf, consumed);
+	}
+	*nr = min(*nr, buf->backend.num_subbuf);
+	return __lib_ring_buffer_get_subbuf(buf, consumed, nr);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_get_subbuf_batch);
+
 /**
  * lib_ring_buffer_put_subbuf - release exclusive subbuffer access
  * @buf: ring buffer
@@ -1418,7 +2255,7 @@ void lib_ring_buffer_put_subbuf(struct lttng_kernel_ring_buffer *buf)
 	struct lttng_kernel_ring_buffer_backend *bufb = &buf->backend;
 	struct lttng_kernel_ring_buffer_channel *chan = bufb->chan;
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
-	unsigned long read_sb_bindex, consumed_idx, consumed;
+	unsigned long read_sb_bindex, consumed_idx, consumed, i;
 
 	CHAN_WARN_ON(chan, atomic_long_read(&buf->active_readers) != 1);
 
@@ -1429,6 +2266,7 @@ void lib_ring_buffer_put_subbuf(struct lttng_kernel_ring_buffer *buf)
 		CHAN_WARN_ON(chan, 1);
 		return;
 	}
+	mutex_lock(&buf->resize_mutex);
 	consumed = buf->get_subbuf_consumed;
 	buf->get_subbuf = 0;
 
@@ -1439,11 +2277,15 @@ void lib_ring_buffer_put_subbuf(struct lttng_kernel_ring_buffer *buf)
 	 * Can be below zero if an iterator is used on a snapshot more than
 	 * once.
 	 */
-	read_sb_bindex = subbuffer_id_get_index(config, bufb->buf_rsb.id);
-	v_add(config, v_read(config,
-			     &bufb->array[read_sb_bindex]->records_unread),
-	      &bufb->records_read);
-	v_set(config, &bufb->array[read_sb_bindex]->records_unread, 0);
+	for (i = 0; i < buf->get_subbuf_nr; i++) {
+		read_sb_bindex = subbuffer_id_get_index(config,
+				subbuffer_read_id(config, bufb, consumed
+					+ (i << chan->backend.subbuf_size_order)));
+		v_add(config, v_read(config,
+				     &bufb->array[read_sb_bindex]->records_unread),
+		      &bufb->records_read);
+		v_set(config, &bufb->array[read_sb_bindex]->records_unread, 0);
+	}
 	CHAN_WARN_ON(chan, config->mode == RING_BUFFER_OVERWRITE
 		     && subbuffer_id_is_noref(config, bufb->buf_rsb.id));
 	subbuffer_id_set_noref(config, &bufb->buf_rsb.id);
@@ -1456,16 +2298,318 @@ void lib_ring_buffer_put_subbuf(struct lttng_kernel_ring_buffer *buf)
 	 * currently have: it has become invalid to try reading this sub-buffer
 	 * consumed count value anyway.
 	 */
-	consumed_idx = subbuf_index(consumed, chan);
+	consumed_idx = subbuf_index(consumed, buf);
 	update_read_sb_index(config, &buf->backend, &chan->backend,
-			     consumed_idx, buf_trunc_val(consumed, chan));
+			     consumed_idx, buf_trunc_val(consumed, buf));
 	/*
 	 * update_read_sb_index return value ignored. Don't exchange sub-buffer
 	 * if the writer concurrently updated it.
 	 */
+	mutex_unlock(&buf->resize_mutex);
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_put_subbuf);
 
+struct resize_param {
+	struct lttng_kernel_ring_buffer *buf;
+	struct lttng_kernel_ring_buffer_backend_resize backend;
+	struct commit_counters_hot *commit_hot;
+	struct commit_counters_cold *commit_cold;
+	u64 *ts_end;
+	int ret;
+};
+
+/*
+ * Number of sub-buffers holding data not consumed yet, including the
+ * sub-buffer being written to.
+ */
+static
+unsigned long lib_ring_buffer_live_subbufs(struct lttng_kernel_ring_buffer_channel *chan,
+		unsigned long consumed, unsigned long offset)
+{
+	return (subbuf_align(offset - 1, chan) - consumed)
+		>> chan->backend.subbuf_size_order;
+}
+
+static
+int lib_ring_buffer_resize_supported(const struct lttng_kernel_ring_buffer_config *config)
+{
+	return config->alloc == RING_BUFFER_ALLOC_PER_CPU
+		&& config->sync == RING_BUFFER_SYNC_PER_CPU
+		&& config->mode == RING_BUFFER_DISCARD
+		&& config->output == RING_BUFFER_SPLICE;
+}
+
+/*
+ * Carry a commit counter over to the resized buffer: keep the progress
+ * within the sub-buffer at position @pos, rebased on the new buffer lap.
+ */
+static
+unsigned long lib_ring_buffer_rebase_count(struct lttng_kernel_ring_buffer *buf,
+		unsigned long pos, unsigned long count,
+		unsigned long new_base)
+{
+	unsigned long old_base = buf_trunc(pos, buf) >> buf->backend.num_subbuf_order;
+
+	return new_base + ((count - old_base) & buf->commit_count_mask);
+}
+
+/*
+ * Runs on the buffer cpu, with its writers and timers held off.
+ */
+static void remote_resize(void *info)
+{
+	struct resize_param *param = info;
+	struct lttng_kernel_ring_buffer *buf = param->buf;
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long num_subbuf = param->backend.num_subbuf;
+	unsigned int num_subbuf_order = get_count_order(num_subbuf);
+	unsigned long consumed, offset, nr_live, i;
+
+	/* The tick nohz flush may have been interrupted mid-switch. */
+	if (!raw_spin_trylock(&buf->raw_tick_nohz_spinlock)) {
+		param->ret = -EAGAIN;
+		return;
+	}
+	consumed = atomic_long_read(&buf->consumed);
+	offset = v_read(config, &buf->offset);
+	nr_live = lib_ring_buffer_live_subbufs(chan, consumed, offset);
+	if (nr_live > num_subbuf) {
+		param->ret = -EBUSY;
+		goto end;
+	}
+
+	for (i = 0; i < num_subbuf; i++) {
+		unsigned long pos = consumed + (i << chan->backend.subbuf_size_order);
+		unsigned long idx = (pos >> chan->backend.subbuf_size_order)
+					& (num_subbuf - 1);
+		unsigned long new_base = (pos & ~((num_subbuf << chan->backend.subbuf_size_order) - 1))
+					>> num_subbuf_order;
+		struct commit_counters_hot *cc_hot = &param->commit_hot[idx];
+		struct commit_counters_cold *cc_cold = &param->commit_cold[idx];
+
+		if (i < nr_live) {
+			unsigned long old_idx = subbuf_index(pos, buf);
+
+			v_set(config, &cc_hot->cc,
+			      lib_ring_buffer_rebase_count(buf, pos,
+				v_read(config, &buf->commit_hot[old_idx].cc),
+				new_base));
+			v_set(config, &cc_hot->seq,
+			      lib_ring_buffer_rebase_count(buf, pos,
+				v_read(config, &buf->commit_hot[old_idx].seq),
+				new_base));
+			v_set(config, &cc_cold->cc_sb,
+			      lib_ring_buffer_rebase_count(buf, pos,
+				v_read(config, &buf->commit_cold[old_idx].cc_sb),
+				new_base));
+			param->ts_end[idx] = buf->ts_end[old_idx];
+		} else {
+			/* Ready for the writer to reach this position. */
+			v_set(config, &cc_hot->cc, new_base);
+			v_set(config, &cc_hot->seq, new_base);
+			v_set(config, &cc_cold->cc_sb, new_base);
+		}
+	}
+
+	lib_ring_buffer_backend_resize_commit(&buf->backend, &param->backend,
+					      consumed, offset);
+	swap(buf->commit_hot, param->commit_hot);
+	swap(buf->commit_cold, param->commit_cold);
+	swap(buf->ts_end, param->ts_end);
+	buf->commit_count_mask = (~0UL >> buf->backend.num_subbuf_order);
+	param->ret = 0;
+end:
+	raw_spin_unlock(&buf->raw_tick_nohz_spinlock);
+}
+
+/*
+ * Called with cpu hotplug held. Events discarded while writers are held off
+ * are accounted in records_lost_unavailable.
+ */
+static
+int __lib_ring_buffer_resize(struct lttng_kernel_ring_buffer *buf,
+		unsigned long num_subbuf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	int cpu = buf->backend.cpu, node = cpu_to_node(max(cpu, 0));
+	unsigned long old_num_subbuf = buf->backend.num_subbuf;
+	unsigned int switch_timer_enabled, read_timer_enabled;
+	struct resize_param *param;
+	int ret;
+
+	if (!lib_ring_buffer_resize_supported(config))
+		return -EOPNOTSUPP;
+	if (!num_subbuf || (num_subbuf & (num_subbuf - 1))
+	    || num_subbuf > chan->backend.num_subbuf)
+		return -EINVAL;
+	if (num_subbuf == old_num_subbuf)
+		return 0;
+	/* Checked again once writers are held off. */
+	if (READ_ONCE(buf->get_subbuf)
+	    || lib_ring_buffer_live_subbufs(chan,
+			atomic_long_read(&buf->consumed),
+			v_read(config, &buf->offset)) > num_subbuf)
+		return -EBUSY;
+	if (!cpu_online(cpu))
+		return -EAGAIN;
+
+	param = kzalloc(sizeof(*param), GFP_KERNEL);
+	if (!param)
+		return -ENOMEM;
+	param->buf = buf;
+	ret = lib_ring_buffer_backend_resize_prepare(&buf->backend,
+			&param->backend, num_subbuf);
+	if (ret)
+		goto free_param;
+	ret = -ENOMEM;
+	param->commit_hot =
+		lttng_kvzalloc_node(ALIGN(sizeof(*param->commit_hot) * num_subbuf,
+				   1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (!param->commit_hot)
+		goto free_counters;
+	param->commit_cold =
+		lttng_kvzalloc_node(ALIGN(sizeof(*param->commit_cold) * num_subbuf,
+				   1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (!param->commit_cold)
+		goto free_counters;
+	param->ts_end =
+		lttng_kvzalloc_node(ALIGN(sizeof(*param->ts_end) * num_subbuf,
+				   1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (!param->ts_end)
+		goto free_counters;
+
+	WRITE_ONCE(buf->resizing, 1);
+	atomic_inc(&buf->record_disabled);
+	lib_ring_buffer_wait_writers();
+	/* Keep the reader and remote switches away from the swapped tables. */
+	mutex_lock(&buf->resize_mutex);
+	if (buf->get_subbuf) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+	/* The tables were prepared for the size we started from. */
+	if (buf->backend.num_subbuf != old_num_subbuf) {
+		ret = -EAGAIN;
+		goto unlock;
+	}
+	/* Timers switch sub-buffers from softirq context. */
+	spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+	switch_timer_enabled = buf->switch_timer_enabled;
+	read_timer_enabled = buf->read_timer_enabled;
+	lib_ring_buffer_stop_switch_timer(buf);
+	lib_ring_buffer_stop_read_timer(buf);
+	spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+
+	ret = smp_call_function_single(cpu, remote_resize, param, 1);
+	if (!ret)
+		ret = param->ret;
+
+	spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+	if (switch_timer_enabled)
+		lib_ring_buffer_start_switch_timer(buf);
+	if (read_timer_enabled)
+		lib_ring_buffer_start_read_timer(buf);
+	spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+unlock:
+	mutex_unlock(&buf->resize_mutex);
+	atomic_dec(&buf->record_disabled);
+	WRITE_ONCE(buf->resizing, 0);
+free_counters:
+	/* Holds the tables no longer in use after a successful resize. */
+	lttng_kvfree(param->ts_end);
+	lttng_kvfree(param->commit_cold);
+	lttng_kvfree(param->commit_hot);
+	lib_ring_buffer_backend_resize_release(&buf->backend, &param->backend);
+free_param:
+	kfree(param);
+	return ret;
+}
+
+/**
+ * lib_ring_buffer_resize - change the number of sub-buffers of a buffer
+ * @buf: ring buffer
+ * @num_subbuf: new number of sub-buffers, a power of 2 no larger than the
+ *              number the channel was created with
+ *
+ * Data not consumed yet is kept, and must fit within the resized buffer.
+ * Events written to the buffer during the resize are discarded, and
+ * accounted in the records_lost_unavailable counter. Waits for a grace period,
+ * so must not be called from the reader sub-buffer exchange path. Only
+ * per-cpu discard mode buffers read through splice can be resized: mmap
+ * readers would keep mappings on freed pages.
+ *
+ * Returns 0 on success, -EBUSY if a sub-buffer is held or if the data
+ * pending does not fit, -EAGAIN if the buffer is busy or its cpu is offline,
+ * -EOPNOTSUPP if the buffer configuration cannot be resized, -EINVAL for an
+ * invalid @num_subbuf, -ENOMEM when out of memory.
+ */
+int lib_ring_buffer_resize(struct lttng_kernel_ring_buffer *buf,
+		unsigned long num_subbuf)
+{
+	int ret;
+
+	lttng_cpus_read_lock();
+	ret = __lib_ring_buffer_resize(buf, num_subbuf);
+	lttng_cpus_read_unlock();
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_resize);
+
+/*
+ * Pick the number of sub-buffers a buffer should have from its activity since
+ * the previous sample: grow back towards the channel size when events were
+ * discarded because the buffer was full, shrink when less than a quarter of
+ * the buffer was written to. Events discarded by a resize don't count.
+ */
+static
+unsigned long lib_ring_buffer_resize_sample(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long lost_full, offset, num_subbuf, target;
+
+	lost_full = v_read(config, &buf->records_lost_full);
+	offset = v_read(config, &buf->offset);
+	num_subbuf = buf->backend.num_subbuf;
+	target = num_subbuf;
+	if (lost_full != buf->resize_lost_full)
+		target = min(num_subbuf << 1, chan->backend.num_subbuf);
+	else if (num_subbuf > 2
+		 && offset - buf->resize_offset
+			< (num_subbuf << chan->backend.subbuf_size_order) >> 2)
+		target = num_subbuf >> 1;
+	buf->resize_lost_full = lost_full;
+	buf->resize_offset = offset;
+	return target;
+}
+
+/**
+ * lib_ring_buffer_resize_pending - keep the buffer resize work armed
+ * @buf: ring buffer
+ *
+ * Called by the buffer reader after releasing a sub-buffer, for channels
+ * created with RING_BUFFER_CHANNEL_AUTO_RESIZE. The resize work stops while
+ * lib_ring_buffer_resize_interval_ms is 0: arm it again once resizing is
+ * enabled. Buffers are resized by the work, never from the reader.
+ */
+void lib_ring_buffer_resize_pending(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	unsigned int interval_ms = READ_ONCE(lib_ring_buffer_resize_interval_ms);
+
+	if (!chan->backend.auto_resize || !interval_ms
+	    || delayed_work_pending(&chan->resize_work))
+		return;
+	schedule_delayed_work(&chan->resize_work,
+			      msecs_to_jiffies(interval_ms));
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_resize_pending);
+
 /*
  * cons_offset is an iterator on all subbuffer offsets between the reader
  * position and the writer position. (inclusive)
@@ -1479,7 +2623,7 @@ void lib_ring_buffer_print_subbuffer_errors(struct lttng_kernel_ring_buffer *buf
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 	unsigned long cons_idx, commit_count, commit_count_sb;
 
-	cons_idx = subbuf_index(cons_offset, chan);
+	cons_idx = subbuf_index(cons_offset, buf);
 	commit_count = v_read(config, &buf->commit_hot[cons_idx].cc);
 	commit_count_sb = v_read(config, &buf->commit_cold[cons_idx].cc_sb);
 
@@ -1576,15 +2720,17 @@ void lib_ring_buffer_print_errors(struct lttng_kernel_ring_buffer_channel *chan,
 	if (strcmp(chan->backend.name, "relay-metadata")) {
 		if (v_read(config, &buf->records_lost_full)
 		    || v_read(config, &buf->records_lost_wrap)
-		    || v_read(config, &buf->records_lost_big))
+		    || v_read(config, &buf->records_lost_big)
+		    || atomic_long_read(&buf->records_lost_unavailable))
 			printk(KERN_WARNING
 				"LTTng: ring buffer %s, cpu %d: records were lost. Caused by:\n"
 				"  [ %lu buffer full, %lu nest buffer wrap-around, "
-				"%lu event too big ]\n",
+				"%lu event too big, %lu buffer unavailable ]\n",
 				chan->backend.name, cpu,
 				v_read(config, &buf->records_lost_full),
 				v_read(config, &buf->records_lost_wrap),
-				v_read(config, &buf->records_lost_big));
+				v_read(config, &buf->records_lost_big),
+				(unsigned long) atomic_long_read(&buf->records_lost_unavailable));
 	}
 	lib_ring_buffer_print_buffer_errors(buf, chan, priv, cpu);
 }
@@ -1601,11 +2747,12 @@ void lib_ring_buffer_switch_old_start(struct lttng_kernel_ring_buffer *buf,
 				      const struct lttng_kernel_ring_buffer_ctx *ctx)
 {
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
-	unsigned long oldidx = subbuf_index(offsets->old, chan);
+	unsigned long oldidx = subbuf_index(offsets->old, buf);
 	unsigned long commit_count;
 	struct commit_counters_hot *cc_hot;
 
 	config->cb.buffer_begin(buf, ctx->priv.timestamp, oldidx);
+	lib_ring_buffer_control_begin(buf, offsets->old, ctx->priv.timestamp);
 
 	/*
 	 * Order all writes to buffer before the commit count update that will
@@ -1646,7 +2793,7 @@ void lib_ring_buffer_switch_old_end(struct lttng_kernel_ring_buffer *buf,
 				    const struct lttng_kernel_ring_buffer_ctx *ctx)
 {
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
-	unsigned long oldidx = subbuf_index(offsets->old - 1, chan);
+	unsigned long oldidx = subbuf_index(offsets->old - 1, buf);
 	unsigned long commit_count, padding_size, data_size;
 	struct commit_counters_hot *cc_hot;
 	u64 *ts_end;
@@ -1703,11 +2850,12 @@ void lib_ring_buffer_switch_new_start(struct lttng_kernel_ring_buffer *buf,
 				      const struct lttng_kernel_ring_buffer_ctx *ctx)
 {
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
-	unsigned long beginidx = subbuf_index(offsets->begin, chan);
+	unsigned long beginidx = subbuf_index(offsets->begin, buf);
 	unsigned long commit_count;
 	struct commit_counters_hot *cc_hot;
 
 	config->cb.buffer_begin(buf, ctx->priv.timestamp, beginidx);
+	lib_ring_buffer_control_begin(buf, offsets->begin, ctx->priv.timestamp);
 
 	/*
 	 * Order all writes to buffer before the commit count update that will
@@ -1751,7 +2899,7 @@ void lib_ring_buffer_switch_new_end(struct lttng_kernel_ring_buffer *buf,
 	unsigned long endidx, data_size;
 	u64 *ts_end;
 
-	endidx = subbuf_index(offsets->end - 1, chan);
+	endidx = subbuf_index(offsets->end - 1, buf);
 	data_size = subbuf_offset(offsets->end - 1, chan) + 1;
 	subbuffer_set_data_size(config, &buf->backend, endidx, data_size);
 	ts_end = &buf->ts_end[endidx];
@@ -1822,20 +2970,20 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 			return -1;
 
 		/* Test new buffer integrity */
-		sb_index = subbuf_index(offsets->begin, chan);
+		sb_index = subbuf_index(offsets->begin, buf);
 		commit_count = v_read(config,
 				&buf->commit_cold[sb_index].cc_sb);
 		reserve_commit_diff =
-		  (buf_trunc(offsets->begin, chan)
-		   >> chan->backend.num_subbuf_order)
-		  - (commit_count & chan->commit_count_mask);
+		  (buf_trunc(offsets->begin, buf)
+		   >> buf->backend.num_subbuf_order)
+		  - (commit_count & buf->commit_count_mask);
 		if (likely(reserve_commit_diff == 0)) {
 			/* Next subbuffer not being written to. */
 			if (unlikely(config->mode != RING_BUFFER_OVERWRITE &&
 				subbuf_trunc(offsets->begin, chan)
 				 - subbuf_trunc((unsigned long)
 				     atomic_long_read(&buf->consumed), chan)
-				>= chan->backend.buf_size)) {
+				>= buf->backend.buf_size)) {
 				/*
 				 * We do not overwrite non consumed buffers
 				 * and we are full : don't switch.
@@ -1875,6 +3023,8 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 	ctx->priv.records_lost_full = v_read(config, &buf->records_lost_full);
 	ctx->priv.records_lost_wrap = v_read(config, &buf->records_lost_wrap);
 	ctx->priv.records_lost_big = v_read(config, &buf->records_lost_big);
+	ctx->priv.records_lost_unavailable =
+		atomic_long_read(&buf->records_lost_unavailable);
 	return 0;
 }
 
@@ -1913,13 +3063,14 @@ void lib_ring_buffer_switch_slow(struct lttng_kernel_ring_buffer *buf, enum swit
 	 * timestamp record when it would be needed).
 	 */
 	save_last_timestamp(config, buf, ctx.priv.timestamp);
+	v_inc(config, &buf->stats.switch_slow);
 
 	/*
 	 * Push the reader if necessary
 	 */
 	lib_ring_buffer_reserve_push_reader(buf, chan, offsets.old);
 
-	oldidx = subbuf_index(offsets.old, chan);
+	oldidx = subbuf_index(offsets.old, buf);
 	lib_ring_buffer_clear_noref(config, &buf->backend, oldidx);
 
 	/*
@@ -1966,6 +3117,8 @@ static void _lib_ring_buffer_switch_remote(struct lttng_kernel_ring_buffer *buf,
 		return;
 	}
 
+	/* Don't switch sub-buffers while the buffer is being resized. */
+	mutex_lock(&buf->resize_mutex);
 	/*
 	 * Disabling preemption ensures two things: first, that the
 	 * target cpu is not taken concurrently offline while we are within
@@ -1984,6 +3137,7 @@ static void _lib_ring_buffer_switch_remote(struct lttng_kernel_ring_buffer *buf,
 		lib_ring_buffer_switch_slow(buf, mode);
 	}
 	preempt_enable();
+	mutex_unlock(&buf->resize_mutex);
 }
 
 /* Switch sub-buffer if current sub-buffer is non-empty. */
@@ -2070,7 +3224,7 @@ retry:
 		offsets->begin = offsets->begin
 				 + config->cb.subbuffer_header_size();
 		/* Test new buffer integrity */
-		sb_index = subbuf_index(offsets->begin, chan);
+		sb_index = subbuf_index(offsets->begin, buf);
 		/*
 		 * Read buf->offset before buf->commit_cold[sb_index].cc_sb.
 		 * lib_ring_buffer_check_deliver() has the matching
@@ -2093,16 +3247,16 @@ retry:
 			goto retry;
 		}
 		reserve_commit_diff =
-		  (buf_trunc(offsets->begin, chan)
-		   >> chan->backend.num_subbuf_order)
-		  - (commit_count & chan->commit_count_mask);
+		  (buf_trunc(offsets->begin, buf)
+		   >> buf->backend.num_subbuf_order)
+		  - (commit_count & buf->commit_count_mask);
 		if (likely(reserve_commit_diff == 0)) {
 			/* Next subbuffer not being written to. */
 			if (unlikely(config->mode != RING_BUFFER_OVERWRITE &&
 				subbuf_trunc(offsets->begin, chan)
 				 - subbuf_trunc((unsigned long)
 				     atomic_long_read(&buf->consumed), chan)
-				>= chan->backend.buf_size)) {
+				>= buf->backend.buf_size)) {
 				/*
 				 * We do not overwrite non consumed buffers
 				 * and we are full : record is lost.
@@ -2174,10 +3328,43 @@ retry:
 		ctx->priv.records_lost_full = v_read(config, &buf->records_lost_full);
 		ctx->priv.records_lost_wrap = v_read(config, &buf->records_lost_wrap);
 		ctx->priv.records_lost_big = v_read(config, &buf->records_lost_big);
+		ctx->priv.records_lost_unavailable =
+			atomic_long_read(&buf->records_lost_unavailable);
 	}
 	return 0;
 }
 
+/*
+ * Time deltas are only accounted when the clock did not go backwards, which
+ * can happen between CPUs for global buffers.
+ */
+static
+void lib_ring_buffer_stats_add_time(const struct lttng_kernel_ring_buffer_config *config,
+				    union v_atomic *v_a, u64 begin, u64 end)
+{
+	if ((int64_t) end == -EIO || (int64_t) (end - begin) <= 0)
+		return;
+	v_add(config, (long) (end - begin), v_a);
+}
+
+/*
+ * Racy maximum, updated with cmpxchg so concurrent updaters never lower it.
+ */
+static
+void lib_ring_buffer_stats_max(const struct lttng_kernel_ring_buffer_config *config,
+			       union v_atomic *v_a, unsigned long v)
+{
+	unsigned long old = v_read(config, v_a);
+
+	while (v > old) {
+		unsigned long prev = v_cmpxchg(config, v_a, old, v);
+
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
+
 static struct lttng_kernel_ring_buffer *get_current_buf(struct lttng_kernel_ring_buffer_channel *chan, int cpu)
 {
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
@@ -2243,14 +3430,14 @@ int lib_ring_buffer_reserve_slow(struct lttng_kernel_ring_buffer_ctx *ctx,
 	 * Clear noref flag for this subbuffer.
 	 */
 	lib_ring_buffer_clear_noref(config, &buf->backend,
-				    subbuf_index(offsets.end - 1, chan));
+				    subbuf_index(offsets.end - 1, buf));
 
 	/*
 	 * Switch old subbuffer if needed.
 	 */
 	if (unlikely(offsets.switch_old_end)) {
 		lib_ring_buffer_clear_noref(config, &buf->backend,
-					    subbuf_index(offsets.old - 1, chan));
+					    subbuf_index(offsets.old - 1, buf));
 		lib_ring_buffer_switch_old_end(buf, chan, &offsets, ctx);
 	}
 
@@ -2263,6 +3450,23 @@ int lib_ring_buffer_reserve_slow(struct lttng_kernel_ring_buffer_ctx *ctx,
 	if (unlikely(offsets.switch_new_end))
 		lib_ring_buffer_switch_new_end(buf, chan, &offsets, ctx);
 
+	/*
+	 * Account the slow path from the timestamp of the successful attempt,
+	 * sub-buffer switch included.
+	 */
+	v_inc(config, &buf->stats.reserve_slow);
+	lib_ring_buffer_stats_add_time(config, &buf->stats.reserve_slow_time,
+				       ctx->priv.timestamp,
+				       config->cb.ring_buffer_clock_read(chan));
+
+	/*
+	 * The first write following a switch timer flush starts a sub-buffer
+	 * from here: leave the switch timer backoff from irq work.
+	 */
+	if (unlikely(chan->backend.adaptive_switch_timer
+		     && READ_ONCE(buf->switch_timer_backoff)))
+		irq_work_queue(&buf->switch_timer_rearm);
+
 	ctx->priv.slot_size = offsets.size;
 	ctx->priv.pre_offset = offsets.begin;
 	ctx->priv.buf_offset = offsets.begin + offsets.pre_header_padding;
@@ -2306,6 +3510,64 @@ void deliver_count_events(const struct lttng_kernel_ring_buffer_config *config,
 }
 #endif /* #else LTTNG_RING_BUFFER_COUNT_EVENTS */
 
+/*
+ * Unlike the event counts, the delivery statistics cost a clock read per
+ * delivered sub-buffer and are always maintained.
+ */
+static
+void deliver_stats(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer *buf,
+		struct lttng_kernel_ring_buffer_channel *chan,
+		unsigned long offset, u64 ts_end)
+{
+	u64 now = config->cb.ring_buffer_clock_read(chan);
+	unsigned long fill;
+
+	v_inc(config, &buf->stats.deliver);
+	if ((int64_t) now != -EIO && (int64_t) (now - ts_end) > 0) {
+		v_add(config, (long) (now - ts_end), &buf->stats.deliver_latency);
+		lib_ring_buffer_stats_max(config, &buf->stats.deliver_latency_max,
+					  (unsigned long) (now - ts_end));
+	}
+	fill = min(subbuf_align(offset, chan)
+		   - subbuf_trunc(atomic_long_read(&buf->consumed), chan),
+		   buf->backend.buf_size);
+	lib_ring_buffer_stats_max(config, &buf->stats.fill_max, fill);
+}
+
+
+/*
+ * Check whether the sub-buffers ready to be read, up to and including the one
+ * being delivered at offset, reach the channel wakeup watermark. The
+ * watermark is capped to the number of sub-buffers which can be ready at
+ * once, the writer always owning one of them.
+ */
+static
+bool lib_ring_buffer_wakeup_watermark_reached(struct lttng_kernel_ring_buffer *buf,
+					      struct lttng_kernel_ring_buffer_channel *chan,
+					      unsigned long offset)
+{
+	unsigned long watermark = READ_ONCE(chan->wakeup_watermark);
+	unsigned long ready;
+
+	if (watermark <= 1)
+		return true;
+	watermark = min(watermark, buf->backend.num_subbuf - 1);
+	ready = (subbuf_trunc(offset, chan)
+		 - subbuf_trunc(atomic_long_read(&buf->consumed), chan))
+		>> chan->backend.subbuf_size_order;
+	return ready + 1 >= watermark;
+}
+
+bool lib_ring_buffer_wakeup_watermark_due(const struct lttng_kernel_ring_buffer_config *config,
+					  struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+
+	return lib_ring_buffer_wakeup_watermark_reached(buf, chan,
+			v_read(config, &buf->offset));
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_wakeup_watermark_due);
 
 void lib_ring_buffer_check_deliver_slow(const struct lttng_kernel_ring_buffer_config *config,
 				   struct lttng_kernel_ring_buffer *buf,
@@ -2370,10 +3632,12 @@ void lib_ring_buffer_check_deliver_slow(const struct lttng_kernel_ring_buffer_co
 		smp_mb();
 		ts_end = &buf->ts_end[idx];
 		deliver_count_events(config, buf, idx);
+		deliver_stats(config, buf, chan, offset, *ts_end);
 		config->cb.buffer_end(buf, *ts_end, idx,
 				      lib_ring_buffer_get_data_size(config,
 								buf,
 								idx), ctx);
+		lib_ring_buffer_control_deliver(config, buf, offset, idx);
 
 		/*
 		 * Increment the packet counter while we have exclusive
@@ -2387,7 +3651,7 @@ void lib_ring_buffer_check_deliver_slow(const struct lttng_kernel_ring_buffer_co
 		 * are ordered before set noref and offset.
 		 */
 		lib_ring_buffer_set_noref_offset(config, &buf->backend, idx,
-						 buf_trunc_val(offset, chan));
+						 buf_trunc_val(offset, buf));
 
 		/*
 		 * Order set_noref and record counter updates before the
@@ -2413,8 +3677,11 @@ void lib_ring_buffer_check_deliver_slow(const struct lttng_kernel_ring_buffer_co
 		 */
 		if (config->wakeup == RING_BUFFER_WAKEUP_BY_WRITER
 		    && atomic_long_read(&buf->active_readers)
-		    && lib_ring_buffer_poll_deliver(config, buf, chan)) {
+		    && lib_ring_buffer_poll_deliver(config, buf, chan)
+		    && lib_ring_buffer_wakeup_watermark_reached(buf, chan,
+								offset)) {
 			irq_work_queue(&buf->wakeup_pending);
+			lib_ring_buffer_mark_read_ready(config, chan, buf);
 			irq_work_queue(&chan->wakeup_pending);
 		}
 
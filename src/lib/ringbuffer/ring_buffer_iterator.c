@@ -3,8 +3,9 @@
  * ring_buffer_iterator.c
  *
  * Ring buffer and channel iterators. Get each event of a channel in order. Uses
- * a prio heap for per-cpu buffers, giving a O(log(NR_CPUS)) algorithmic
- * complexity for the "get next event" operation.
+ * a loser tree for per-cpu buffers, giving a O(log(NR_CPUS)) algorithmic
+ * complexity for the "get next event" operation, and O(1) for consecutive
+ * events of a buffer older than the events of all other buffers.
  *
  * Copyright (C) 2010-2012 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
  */
@@ -129,15 +130,29 @@ static int buf_is_higher(void *a, void *b)
 	struct lttng_kernel_ring_buffer *bufa = a;
 	struct lttng_kernel_ring_buffer *bufb = b;
 
-	/* Consider lowest timestamps to be at the top of the heap */
+	/* Consider lowest timestamps to win the tree */
 	return (bufa->iter.timestamp < bufb->iter.timestamp);
 }
 
+/*
+ * The winner buffer stays the one holding the oldest record until its
+ * timestamp exceeds the runner-up timestamp. Must be called after each
+ * tree update.
+ */
+static
+void channel_iter_update_winner_limit(struct lttng_kernel_ring_buffer_channel *chan)
+{
+	struct lttng_kernel_ring_buffer *runner_up;
+
+	runner_up = lttng_loser_tree_runner_up(&chan->iter.tree);
+	chan->iter.winner_limit = runner_up ? runner_up->iter.timestamp : U64_MAX;
+}
+
 static
 void lib_ring_buffer_get_empty_buf_records(const struct lttng_kernel_ring_buffer_config *config,
 					   struct lttng_kernel_ring_buffer_channel *chan)
 {
-	struct lttng_ptr_heap *heap = &chan->iter.heap;
+	struct lttng_loser_tree *tree = &chan->iter.tree;
 	struct lttng_kernel_ring_buffer *buf, *tmp;
 	ssize_t len;
 
@@ -167,14 +182,15 @@ void lib_ring_buffer_get_empty_buf_records(const struct lttng_kernel_ring_buffer
 			break;
 		default:
 			/*
-			 * Insert buffer into the heap, remove from empty buffer
+			 * Insert buffer into the tree, remove from empty buffer
 			 * list.
 			 */
 			CHAN_WARN_ON(chan, len < 0);
 			list_del(&buf->iter.empty_node);
-			CHAN_WARN_ON(chan, lttng_heap_insert(heap, buf));
+			lttng_loser_tree_set(tree, buf->backend.cpu, buf);
 		}
 	}
+	channel_iter_update_winner_limit(chan);
 }
 
 static
@@ -194,7 +210,7 @@ void lib_ring_buffer_wait_for_qs(const struct lttng_kernel_ring_buffer_config *c
 	/*
 	 * We need to consider previously empty buffers.
 	 * Do a get next buf record on each of them. Add them to
-	 * the heap if they have data. If at least one of them
+	 * the tree if they have data. If at least one of them
 	 * don't have data, we need to wait for
 	 * switch_timer_interval + MAX_SYSTEM_LATENCY (so we are sure the
 	 * buffers have been switched either by the timer or idle entry) and
@@ -244,7 +260,7 @@ ssize_t channel_get_next_record(struct lttng_kernel_ring_buffer_channel *chan,
 {
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 	struct lttng_kernel_ring_buffer *buf;
-	struct lttng_ptr_heap *heap;
+	struct lttng_loser_tree *tree;
 	ssize_t len;
 
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
@@ -252,12 +268,12 @@ ssize_t channel_get_next_record(struct lttng_kernel_ring_buffer_channel *chan,
 		return lib_ring_buffer_get_next_record(chan, *ret_buf);
 	}
 
-	heap = &chan->iter.heap;
+	tree = &chan->iter.tree;
 
 	/*
-	 * get next record for topmost buffer.
+	 * get next record for winner buffer.
 	 */
-	buf = lttng_heap_maximum(heap);
+	buf = lttng_loser_tree_winner(tree);
 	if (buf) {
 		len = lib_ring_buffer_get_next_record(chan, buf);
 		/*
@@ -268,43 +284,49 @@ ssize_t channel_get_next_record(struct lttng_kernel_ring_buffer_channel *chan,
 		case -EAGAIN:
 			buf->iter.timestamp = 0;
 			list_add(&buf->iter.empty_node, &chan->iter.empty_head);
-			/* Remove topmost buffer from the heap */
-			CHAN_WARN_ON(chan, lttng_heap_remove(heap) != buf);
+			/* Remove winner buffer from the tree */
+			lttng_loser_tree_replace_winner(tree, NULL);
+			channel_iter_update_winner_limit(chan);
 			break;
 		case -ENODATA:
 			/*
-			 * Buffer is finalized. Remove buffer from heap and
+			 * Buffer is finalized. Remove buffer from tree and
 			 * don't add to list of empty buffer, because it has no
 			 * more data to provide, ever.
 			 */
-			CHAN_WARN_ON(chan, lttng_heap_remove(heap) != buf);
+			lttng_loser_tree_replace_winner(tree, NULL);
+			channel_iter_update_winner_limit(chan);
 			break;
 		case -EBUSY:
 			CHAN_WARN_ON(chan, 1);
 			break;
 		default:
+			CHAN_WARN_ON(chan, len < 0);
 			/*
-			 * Reinsert buffer into the heap. Note that heap can be
-			 * partially empty, so we need to use
-			 * lttng_heap_replace_max().
+			 * Records of the winner buffer older than the runner-up
+			 * are consumed without replaying the tree matches, so
+			 * runs of records from a buffer cost a single
+			 * comparison each.
 			 */
-			CHAN_WARN_ON(chan, len < 0);
-			CHAN_WARN_ON(chan, lttng_heap_replace_max(heap, buf) != buf);
+			if (buf->iter.timestamp <= chan->iter.winner_limit)
+				break;
+			lttng_loser_tree_replace_winner(tree, buf);
+			channel_iter_update_winner_limit(chan);
 			break;
 		}
 	}
 
-	buf = lttng_heap_maximum(heap);
+	buf = lttng_loser_tree_winner(tree);
 	if (!buf || buf->iter.timestamp > chan->iter.last_qs) {
 		/*
 		 * Deal with buffers previously showing no data.
-		 * Add buffers containing data to the heap, update
+		 * Add buffers containing data to the tree, update
 		 * last_qs.
 		 */
 		lib_ring_buffer_wait_for_qs(config, chan);
 	}
 
-	*ret_buf = buf = lttng_heap_maximum(heap);
+	*ret_buf = buf = lttng_loser_tree_winner(tree);
 	if (buf) {
 		/*
 		 * If this warning triggers, you probably need to check your
@@ -328,7 +350,7 @@ ssize_t channel_get_next_record(struct lttng_kernel_ring_buffer_channel *chan,
 		chan->iter.last_cpu = buf->backend.cpu;
 		return buf->iter.payload_len;
 	} else {
-		/* Heap is empty */
+		/* Tree is empty */
 		if (list_empty(&chan->iter.empty_head))
 			return -ENODATA;	/* All buffers finalized */
 		else
@@ -340,7 +362,8 @@ EXPORT_SYMBOL_GPL(channel_get_next_record);
 static
 void lib_ring_buffer_iterator_init(struct lttng_kernel_ring_buffer_channel *chan, struct lttng_kernel_ring_buffer *buf)
 {
-	if (buf->iter.allocated)
+	/* Lazily allocated buffers are never iterated. */
+	if (buf->iter.allocated || !buf->backend.allocated)
 		return;
 
 	buf->iter.allocated = 1;
@@ -414,11 +437,12 @@ int channel_iterator_init(struct lttng_kernel_ring_buffer_channel *chan)
 		int ret;
 
 		INIT_LIST_HEAD(&chan->iter.empty_head);
-		ret = lttng_heap_init(&chan->iter.heap,
-				num_possible_cpus(),
+		ret = lttng_loser_tree_init(&chan->iter.tree,
+				nr_cpu_ids,
 				GFP_KERNEL, buf_is_higher);
 		if (ret)
 			return ret;
+		chan->iter.winner_limit = U64_MAX;
 
 #if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(4,10,0))
 		chan->cpuhp_iter_online.component = LTTNG_RING_BUFFER_ITER;
@@ -488,7 +512,7 @@ void channel_iterator_free(struct lttng_kernel_ring_buffer_channel *chan)
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		lttng_heap_free(&chan->iter.heap);
+		lttng_loser_tree_free(&chan->iter.tree);
 }
 
 int lib_ring_buffer_iterator_open(struct lttng_kernel_ring_buffer *buf)
@@ -571,13 +595,18 @@ EXPORT_SYMBOL_GPL(channel_iterator_release);
 void lib_ring_buffer_iterator_reset(struct lttng_kernel_ring_buffer *buf)
 {
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 
 	if (buf->iter.state != ITER_GET_SUBBUF)
 		lib_ring_buffer_put_next_subbuf(buf);
 	buf->iter.state = ITER_GET_SUBBUF;
-	/* Remove from heap (if present). */
-	if (lttng_heap_cherrypick(&chan->iter.heap, buf))
+	/* Remove from tree (if present). */
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU
+	    && lttng_loser_tree_get(&chan->iter.tree, buf->backend.cpu) == buf) {
+		lttng_loser_tree_set(&chan->iter.tree, buf->backend.cpu, NULL);
+		channel_iter_update_winner_limit(chan);
 		list_add(&buf->iter.empty_node, &chan->iter.empty_head);
+	}
 	buf->iter.timestamp = 0;
 	buf->iter.header_len = 0;
 	buf->iter.payload_len = 0;
@@ -593,9 +622,12 @@ void channel_iterator_reset(struct lttng_kernel_ring_buffer_channel *chan)
 	struct lttng_kernel_ring_buffer *buf;
 	int cpu;
 
-	/* Empty heap, put into empty_head */
-	while ((buf = lttng_heap_remove(&chan->iter.heap)) != NULL)
+	/* Empty tree, put into empty_head */
+	while ((buf = lttng_loser_tree_winner(&chan->iter.tree)) != NULL) {
+		lttng_loser_tree_replace_winner(&chan->iter.tree, NULL);
 		list_add(&buf->iter.empty_node, &chan->iter.empty_head);
+	}
+	chan->iter.winner_limit = U64_MAX;
 
 	for_each_channel_cpu(cpu, chan) {
 		buf = channel_get_ring_buffer(config, chan, cpu);
@@ -635,7 +667,7 @@ ssize_t channel_ring_buffer_file_read(struct file *filp,
 			read_offset = *ppos;
 			if (config->alloc == RING_BUFFER_ALLOC_PER_CPU
 			    && fusionmerge)
-				buf = lttng_heap_maximum(&chan->iter.heap);
+				buf = lttng_loser_tree_winner(&chan->iter.tree);
 			CHAN_WARN_ON(chan, !buf);
 			goto skip_get_next;
 		}
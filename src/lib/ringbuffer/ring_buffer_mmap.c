@@ -12,12 +12,14 @@
 
 #include <linux/module.h>
 #include <linux/mm.h>
+#include <linux/vmalloc.h>
 
 #include <ringbuffer/backend.h>
 #include <ringbuffer/frontend.h>
 #include <ringbuffer/vfs.h>
 
 #include <wrapper/mm.h>
+#include <wrapper/vmalloc.h>
 
 /*
  * fault() vm_op implementation for ring buffer file mapping.
@@ -42,11 +44,26 @@ static int lib_ring_buffer_fault_compat(struct vm_area_struct *vma, struct vm_fa
 	 * reader.
 	 */
 	offset = pgoff << PAGE_SHIFT;
-	sb_bindex = subbuffer_id_get_index(config, buf->backend.buf_rsb.id);
-	if (!(offset >= buf->backend.array[sb_bindex]->mmap_offset
-	      && offset < buf->backend.array[sb_bindex]->mmap_offset +
-			  buf->backend.chan->backend.subbuf_size))
-		return VM_FAULT_SIGBUS;
+	if (config->mode == RING_BUFFER_DISCARD) {
+		unsigned long first_idx;
+
+		/*
+		 * Sub-buffers are mapped in buffer order in discard mode, and
+		 * the reader may hold a batch of consecutive sub-buffers.
+		 */
+		first_idx = subbuf_index(buf->get_subbuf_consumed, buf);
+		sb_bindex = offset >> chan->backend.subbuf_size_order;
+		if (sb_bindex >= buf->backend.num_subbuf
+		    || ((sb_bindex - first_idx) & (buf->backend.num_subbuf - 1))
+				>= buf->get_subbuf_nr)
+			return VM_FAULT_SIGBUS;
+	} else {
+		sb_bindex = subbuffer_id_get_index(config, buf->backend.buf_rsb.id);
+		if (!(offset >= buf->backend.array[sb_bindex]->mmap_offset
+		      && offset < buf->backend.array[sb_bindex]->mmap_offset +
+				  buf->backend.chan->backend.subbuf_size))
+			return VM_FAULT_SIGBUS;
+	}
 	/*
 	 * ring_buffer_read_get_pfn() gets the page frame number for the
 	 * current reader's pages.
@@ -87,6 +104,120 @@ static const struct vm_operations_struct lib_ring_buffer_mmap_ops = {
 	.fault = lib_ring_buffer_fault,
 };
 
+/**
+ *	lib_ring_buffer_mmap_control: - mmap buffer control area, read-only
+ *	@buf: ring buffer to map
+ *	@vma: vm_area_struct describing memory to be mapped
+ *
+ *	Returns 0 if ok, negative on error
+ */
+static int lib_ring_buffer_mmap_control(struct lttng_kernel_ring_buffer *buf,
+					struct vm_area_struct *vma)
+{
+	unsigned long length = vma->vm_end - vma->vm_start;
+
+	if (!buf->control)
+		return -EINVAL;
+	if (length != lib_ring_buffer_control_len(buf->backend.chan))
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	wrapper_vm_flags_clear(vma, VM_MAYWRITE);
+
+	return remap_vmalloc_range(vma, buf->control, 0);
+}
+
+/**
+ *	lib_ring_buffer_mmap_compress: - mmap buffer compressed area, read-only
+ *	@buf: ring buffer to map
+ *	@vma: vm_area_struct describing memory to be mapped
+ *
+ *	Returns 0 if ok, negative on error
+ */
+static int lib_ring_buffer_mmap_compress(struct lttng_kernel_ring_buffer *buf,
+					 struct vm_area_struct *vma)
+{
+	unsigned long length = vma->vm_end - vma->vm_start;
+
+	if (!buf->compress)
+		return -EINVAL;
+	if (length != buf->compress->len)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	wrapper_vm_flags_clear(vma, VM_MAYWRITE);
+
+	return remap_vmalloc_range(vma, buf->compress->data, 0);
+}
+
+/**
+ *	lib_ring_buffer_mmap_index: - mmap buffer packet index, read-only
+ *	@buf: ring buffer to map
+ *	@vma: vm_area_struct describing memory to be mapped
+ *
+ *	Returns 0 if ok, negative on error
+ */
+static int lib_ring_buffer_mmap_index(struct lttng_kernel_ring_buffer *buf,
+				      struct vm_area_struct *vma)
+{
+	unsigned long length = vma->vm_end - vma->vm_start;
+
+	if (length != lib_ring_buffer_index_len(buf->backend.chan))
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	wrapper_vm_flags_clear(vma, VM_MAYWRITE);
+
+	return remap_vmalloc_range(vma, buf->index, 0);
+}
+
+/**
+ *	lib_ring_buffer_mmap_prefault: - populate a buffer mapping
+ *	@buf: ring buffer to map
+ *	@vma: vm_area_struct describing memory to be mapped
+ *
+ *	Inserts every page of the buffer, reader sub-buffer included, at its
+ *	mmap offset. The pages backing each mmap offset never change over the
+ *	buffer lifetime, so the mapping does not fault afterwards.
+ *
+ *	Returns 0 if ok, negative on error
+ */
+static int lib_ring_buffer_mmap_prefault(struct lttng_kernel_ring_buffer *buf,
+					 struct vm_area_struct *vma)
+{
+	struct lttng_kernel_ring_buffer_backend *bufb = &buf->backend;
+	unsigned long num_pages = vma_pages(vma), num_subbuf_alloc, sb, i;
+	struct page **pages;
+	int ret;
+
+	num_subbuf_alloc = bufb->num_subbuf;
+	if (bufb->chan->backend.extra_reader_sb)
+		num_subbuf_alloc++;
+	if (CHAN_WARN_ON(bufb->chan,
+			 num_subbuf_alloc * bufb->num_pages_per_subbuf != num_pages))
+		return -EINVAL;
+
+	pages = lttng_kvzalloc(num_pages * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+	for (sb = 0; sb < num_subbuf_alloc; sb++) {
+		struct lttng_kernel_ring_buffer_backend_pages *rpages = bufb->array[sb];
+		unsigned long first = rpages->mmap_offset >> PAGE_SHIFT;
+
+		for (i = 0; i < bufb->num_pages_per_subbuf; i++) {
+			if (CHAN_WARN_ON(bufb->chan, first + i >= num_pages)) {
+				ret = -EINVAL;
+				goto end;
+			}
+			pages[first + i] = pfn_to_page(rpages->p[i].pfn);
+		}
+	}
+	ret = wrapper_vm_insert_pages(vma, vma->vm_start, pages, &num_pages);
+end:
+	lttng_kvfree(pages);
+	return ret;
+}
+
 /**
  *	lib_ring_buffer_mmap_buf: - mmap channel buffer to process address space
  *	@buf: ring buffer to map
@@ -118,12 +249,25 @@ static int lib_ring_buffer_mmap_buf(struct lttng_kernel_ring_buffer *buf,
 	wrapper_vm_flags_set(vma, VM_DONTEXPAND);
 	vma->vm_private_data = buf;
 
+	if (chan->backend.mmap_prefault)
+		return lib_ring_buffer_mmap_prefault(buf, vma);
 	return 0;
 }
 
 int lib_ring_buffer_mmap(struct file *filp, struct vm_area_struct *vma,
 		struct lttng_kernel_ring_buffer *buf)
 {
+	if (vma->vm_pgoff == lib_ring_buffer_control_mmap_offset(buf) >> PAGE_SHIFT)
+		return lib_ring_buffer_mmap_control(buf, vma);
+	/* The writeout work is the reader, only the control area is mapped. */
+	if (READ_ONCE(buf->writeout))
+		return -EBUSY;
+	if (buf->compress
+	    && vma->vm_pgoff == lib_ring_buffer_compress_mmap_offset(buf) >> PAGE_SHIFT)
+		return lib_ring_buffer_mmap_compress(buf, vma);
+	if (buf->index
+	    && vma->vm_pgoff == lib_ring_buffer_index_mmap_offset(buf) >> PAGE_SHIFT)
+		return lib_ring_buffer_mmap_index(buf, vma);
 	return lib_ring_buffer_mmap_buf(buf, vma);
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_mmap);
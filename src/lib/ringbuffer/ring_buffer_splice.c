@@ -12,7 +12,9 @@
 
 #include <linux/module.h>
 #include <linux/fs.h>
+#include <linux/slab.h>
 #include <linux/splice.h>
+#include <linux/pipe_fs_i.h>
 #include <lttng/kernel-version.h>
 
 #include <ringbuffer/backend.h>
@@ -79,6 +81,25 @@ static void lib_ring_buffer_page_release(struct splice_pipe_desc *spd,
 	__free_page(spd->pages[i]);
 }
 
+/*
+ * Number of pipe buffers still free. Pipes can be resized beyond
+ * PIPE_DEF_BUFFERS with F_SETPIPE_SZ, which lets a single splice move
+ * a whole sub-buffer.
+ */
+static unsigned int lib_ring_buffer_pipe_free_bufs(struct pipe_inode_info *pipe)
+{
+#if (LTTNG_LINUX_VERSION_CODE >= LTTNG_KERNEL_VERSION(5,5,0))
+	unsigned int used = pipe_occupancy(READ_ONCE(pipe->head),
+					   READ_ONCE(pipe->tail));
+
+	return used < pipe->max_usage ? pipe->max_usage - used : 0;
+#else
+	unsigned int used = READ_ONCE(pipe->nrbufs);
+
+	return used < pipe->buffers ? pipe->buffers - used : 0;
+#endif
+}
+
 /*
  *	subbuf_splice_actor - splice up to one subbuf's worth of data
  */
@@ -92,12 +113,13 @@ static int subbuf_splice_actor(struct file *in,
 	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
 	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
 	unsigned int poff, subbuf_pages, nr_pages;
-	struct page *pages[PIPE_DEF_BUFFERS];
-	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct page *stack_pages[PIPE_DEF_BUFFERS];
+	struct partial_page stack_partial[PIPE_DEF_BUFFERS];
 	struct splice_pipe_desc spd = {
-		.pages = pages,
+		.pages = stack_pages,
 		.nr_pages = 0,
-		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		.partial = stack_partial,
 #if (LTTNG_LINUX_VERSION_CODE < LTTNG_KERNEL_VERSION(4,12,0))
 		.flags = flags,
 #endif
@@ -106,6 +128,8 @@ static int subbuf_splice_actor(struct file *in,
 	};
 	unsigned long consumed_old, roffset;
 	unsigned long bytes_avail;
+	bool pipe_full;
+	ssize_t ret;
 
 	/*
 	 * Check that a GET_SUBBUF ioctl has been done before.
@@ -116,15 +140,64 @@ static int subbuf_splice_actor(struct file *in,
 
 	/*
 	 * Adjust read len, if longer than what is available.
-	 * Max read size is 1 subbuffer due to get_subbuf/put_subbuf for
+	 * Max read size is the subbuffers held by get_subbuf/put_subbuf for
 	 * protection.
 	 */
-	bytes_avail = chan->backend.subbuf_size;
-	WARN_ON(bytes_avail > chan->backend.buf_size);
+	if (buf->compress) {
+		/*
+		 * Compressed buffers splice the compressed packet, offset
+		 * by the position within it.
+		 */
+		bytes_avail = PAGE_ALIGN(buf->compress->size);
+		if (*ppos >= bytes_avail)
+			return 0;
+		bytes_avail -= *ppos;
+		roffset = *ppos;
+	} else {
+		bytes_avail = chan->backend.subbuf_size * max(buf->get_subbuf_nr, 1UL);
+		WARN_ON(bytes_avail > buf->backend.buf_size);
+		/*
+		 * Several calls can splice the sub-buffers held, never
+		 * go past their end.
+		 */
+		if (*ppos >= bytes_avail)
+			return 0;
+		bytes_avail -= *ppos;
+		roffset = consumed_old & PAGE_MASK;
+	}
 	len = min_t(size_t, len, bytes_avail);
 	subbuf_pages = bytes_avail >> PAGE_SHIFT;
-	nr_pages = min_t(unsigned int, subbuf_pages, PIPE_DEF_BUFFERS);
-	roffset = consumed_old & PAGE_MASK;
+	/*
+	 * Pages handed over to the pipe are no longer in the buffer, never
+	 * hand over more than the pipe can take.
+	 */
+	nr_pages = min(subbuf_pages, lib_ring_buffer_pipe_free_bufs(pipe));
+	/*
+	 * Splicing nothing reads as end of file. With a full pipe, hand over
+	 * a single page so splice_to_pipe() waits for room or returns
+	 * -EAGAIN. splice_to_pipe() releases the pages it cannot add, so
+	 * that page is a copy.
+	 */
+	pipe_full = !nr_pages;
+	if (pipe_full)
+		nr_pages = 1;
+	if (nr_pages > PIPE_DEF_BUFFERS) {
+		struct page **pages;
+		struct partial_page *partial;
+
+		pages = kmalloc_array(nr_pages, sizeof(*pages), GFP_KERNEL);
+		partial = kmalloc_array(nr_pages, sizeof(*partial), GFP_KERNEL);
+		if (pages && partial) {
+			spd.pages = pages;
+			spd.partial = partial;
+			spd.nr_pages_max = nr_pages;
+		} else {
+			/* Fall back to the on-stack arrays. */
+			kfree(pages);
+			kfree(partial);
+			nr_pages = PIPE_DEF_BUFFERS;
+		}
+	}
 	poff = consumed_old & ~PAGE_MASK;
 	printk_dbg(KERN_DEBUG "LTTng: SPLICE actor len %zu pos %zd write_pos %ld\n",
 		   len, (ssize_t)*ppos, lib_ring_buffer_get_offset(config, buf));
@@ -151,10 +224,25 @@ static int subbuf_splice_actor(struct file *in,
 			break;
 		new_pfn = page_to_pfn(new_page);
 		this_len = PAGE_SIZE - poff;
-		pfnp = lib_ring_buffer_read_get_pfn(&buf->backend, roffset, &virt);
-		spd.pages[spd.nr_pages] = pfn_to_page(*pfnp);
-		*pfnp = new_pfn;
-		*virt = page_address(new_page);
+		if (buf->compress) {
+			memcpy(page_address(new_page),
+			       buf->compress->data + roffset, PAGE_SIZE);
+			spd.pages[spd.nr_pages] = new_page;
+		} else if (config->backend == RING_BUFFER_VMAP || pipe_full) {
+			pfnp = lib_ring_buffer_read_get_pfn(&buf->backend, roffset, &virt);
+			/*
+			 * Buffer pages are part of a contiguous kernel
+			 * mapping and cannot be exchanged, or may come back
+			 * from a full pipe. Hand a copy to the pipe instead.
+			 */
+			memcpy(page_address(new_page), *virt, PAGE_SIZE);
+			spd.pages[spd.nr_pages] = new_page;
+		} else {
+			pfnp = lib_ring_buffer_read_get_pfn(&buf->backend, roffset, &virt);
+			spd.pages[spd.nr_pages] = pfn_to_page(*pfnp);
+			*pfnp = new_pfn;
+			*virt = page_address(new_page);
+		}
 		spd.partial[spd.nr_pages].offset = poff;
 		spd.partial[spd.nr_pages].len = this_len;
 
@@ -164,9 +252,14 @@ static int subbuf_splice_actor(struct file *in,
 	}
 
 	if (!spd.nr_pages)
-		return 0;
-
-	return splice_to_pipe(pipe, &spd);
+		ret = 0;
+	else
+		ret = splice_to_pipe(pipe, &spd);
+	if (spd.pages != stack_pages) {
+		kfree(spd.pages);
+		kfree(spd.partial);
+	}
+	return ret;
 }
 
 ssize_t lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
@@ -181,6 +274,9 @@ ssize_t lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 
 	if (config->output != RING_BUFFER_SPLICE)
 		return -EINVAL;
+	/* The writeout work is the reader. */
+	if (READ_ONCE(buf->writeout))
+		return -EBUSY;
 
 	/*
 	 * We require ppos and length to be page-aligned for performance reasons
@@ -10,6 +10,7 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/compat.h>
+#include <linux/uaccess.h>
 
 #include <ringbuffer/backend.h>
 #include <ringbuffer/frontend.h>
@@ -142,7 +143,7 @@ retry:
 					 chan)
 			  - subbuf_trunc(lib_ring_buffer_get_consumed(config, buf),
 					 chan)
-			  >= chan->backend.buf_size)
+			  >= buf->backend.buf_size)
 				return POLLPRI | POLLRDBAND;
 			else
 				return POLLIN | POLLRDNORM;
@@ -175,6 +176,10 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 
 	if (lib_ring_buffer_channel_is_disabled(chan))
 		return -EIO;
+	if (READ_ONCE(buf->writeout)
+	    && cmd != LTTNG_KERNEL_ABI_RING_BUFFER_SET_WRITEOUT_FD
+	    && cmd != LTTNG_KERNEL_ABI_RING_BUFFER_GET_STATS)
+		return -EBUSY;
 
 	switch (cmd) {
 	case LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT:
@@ -183,6 +188,17 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 	case LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT_SAMPLE_POSITIONS:
 		return lib_ring_buffer_snapshot_sample_positions(buf,
 				&buf->cons_snapshot, &buf->prod_snapshot);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT_SINCE:
+	{
+		unsigned long since;
+		long ret;
+
+		ret = get_user(since, (unsigned long __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		return lib_ring_buffer_snapshot_since(buf, since,
+				&buf->cons_snapshot, &buf->prod_snapshot);
+	}
 	case LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT_GET_CONSUMED:
 		return put_ulong(buf->cons_snapshot, arg);
 	case LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT_GET_PRODUCED:
@@ -196,6 +212,8 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 		if (ret)
 			return ret; /* will return -EFAULT */
 		ret = lib_ring_buffer_get_subbuf(buf, uconsume);
+		if (!ret)
+			ret = lib_ring_buffer_compress_subbuf(buf);
 		if (!ret) {
 			/* Set file position to zero at each successful "get" */
 			filp->f_pos = 0;
@@ -211,6 +229,8 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 		long ret;
 
 		ret = lib_ring_buffer_get_next_subbuf(buf);
+		if (!ret)
+			ret = lib_ring_buffer_compress_subbuf(buf);
 		if (!ret) {
 			/* Set file position to zero at each successful "get" */
 			filp->f_pos = 0;
@@ -219,6 +239,7 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 	}
 	case LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUF:
 		lib_ring_buffer_put_next_subbuf(buf);
+		lib_ring_buffer_resize_pending(buf);
 		return 0;
 	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_SUBBUF_SIZE:
 		return put_ulong(lib_ring_buffer_get_read_data_size(config, buf),
@@ -266,6 +287,67 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 	case LTTNG_KERNEL_ABI_RING_BUFFER_CLEAR:
 		lib_ring_buffer_clear(buf);
 		return 0;
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_NUM_SUBBUF:
+		return put_ulong(buf->backend.num_subbuf, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_CONTROL_MMAP_OFFSET:
+		if (!buf->control)
+			return -EINVAL;
+		return put_ulong(lib_ring_buffer_control_mmap_offset(buf), arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_CONTROL_MMAP_LEN:
+		if (!buf->control)
+			return -EINVAL;
+		return put_ulong(lib_ring_buffer_control_len(chan), arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_SUBBUF_SIZE:
+		if (!buf->compress)
+			return -EINVAL;
+		return put_ulong(buf->compress->size, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_MMAP_OFFSET:
+		if (!buf->compress)
+			return -EINVAL;
+		return put_ulong(lib_ring_buffer_compress_mmap_offset(buf), arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_MMAP_LEN:
+		if (!buf->compress)
+			return -EINVAL;
+		return put_ulong(buf->compress->len, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_INDEX_MMAP_OFFSET:
+		if (!buf->index)
+			return -EINVAL;
+		return put_ulong(lib_ring_buffer_index_mmap_offset(buf), arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_INDEX_MMAP_LEN:
+		if (!buf->index)
+			return -EINVAL;
+		return put_ulong(lib_ring_buffer_index_len(chan), arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_SET_NUM_SUBBUF:
+	{
+		unsigned long num_subbuf;
+		long ret;
+
+		ret = get_user(num_subbuf, (unsigned long __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		return lib_ring_buffer_resize(buf, num_subbuf);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_SET_WRITEOUT_FD:
+	{
+		int fd;
+		long ret;
+
+		ret = get_user(fd, (int __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		if (fd < 0)
+			return lib_ring_buffer_stop_writeout(buf);
+		return lib_ring_buffer_set_writeout(buf, fd);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_STATS:
+	{
+		struct lttng_kernel_abi_ring_buffer_stats stats;
+
+		lib_ring_buffer_get_stats(buf, &stats);
+		if (copy_to_user((void __user *) arg, &stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+	}
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -290,8 +372,30 @@ EXPORT_SYMBOL_GPL(lib_ring_buffer_ioctl);
  *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_MAX_SUBBUF_SIZE
  *		returns the maximum size for sub-buffers.
  *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_NUM_SUBBUF
- *		returns the number of reader-visible sub-buffers in the per cpu
- *              channel (for mmap).
+ *		returns the current number of sub-buffers of the buffer.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_SET_NUM_SUBBUF
+ *		resizes the buffer to the given number of sub-buffers.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_CONTROL_MMAP_OFFSET
+ *		returns the mmap offset of the read-only control area.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_CONTROL_MMAP_LEN
+ *		returns the length of the control area.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_SUBBUF_SIZE
+ *		returns the compressed size of the current sub-buffer.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_MMAP_OFFSET
+ *		returns the mmap offset of the read-only compressed area.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_COMPRESSED_MMAP_LEN
+ *		returns the length of the compressed area.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_INDEX_MMAP_OFFSET
+ *		returns the mmap offset of the read-only packet index.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_INDEX_MMAP_LEN
+ *		returns the length of the packet index.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_SNAPSHOT_SINCE
+ *		snapshot of the sub-buffers produced since a previous
+ *		snapshot produced position.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_SET_WRITEOUT_FD
+ *		writes delivered sub-buffers to a file from the kernel.
+ *	LTTNG_KERNEL_ABI_RING_BUFFER_GET_STATS
+ *		returns the buffer hot-path statistics.
  *      LTTNG_KERNEL_ABI_RING_BUFFER_GET_MMAP_READ_OFFSET
  *              returns the offset of the subbuffer belonging to the reader.
  *              Should only be used for mmap clients.
@@ -313,6 +417,10 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 
 	if (lib_ring_buffer_channel_is_disabled(chan))
 		return -EIO;
+	if (READ_ONCE(buf->writeout)
+	    && cmd != LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SET_WRITEOUT_FD
+	    && cmd != LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_STATS)
+		return -EBUSY;
 
 	switch (cmd) {
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SNAPSHOT:
@@ -321,6 +429,23 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SNAPSHOT_SAMPLE_POSITIONS:
 		return lib_ring_buffer_snapshot_sample_positions(buf,
 				&buf->cons_snapshot, &buf->prod_snapshot);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SNAPSHOT_SINCE:
+	{
+		__u32 usince;
+		unsigned long since, produced;
+		long ret;
+
+		ret = get_user(usince, (__u32 __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		/* Extend the 32-bit position from the current write position. */
+		produced = v_read(config, &buf->offset);
+		since = (produced & ~0xFFFFFFFFUL) | usince;
+		if ((long) (since - produced) > 0)
+			since -= 1UL << 32;
+		return lib_ring_buffer_snapshot_since(buf, since,
+				&buf->cons_snapshot, &buf->prod_snapshot);
+	}
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SNAPSHOT_GET_CONSUMED:
 		return compat_put_ulong(buf->cons_snapshot, arg);
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SNAPSHOT_GET_PRODUCED:
@@ -338,6 +463,8 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 		consume &= ~0xFFFFFFFFL;
 		consume |= uconsume;
 		ret = lib_ring_buffer_get_subbuf(buf, consume);
+		if (!ret)
+			ret = lib_ring_buffer_compress_subbuf(buf);
 		if (!ret) {
 			/* Set file position to zero at each successful "get" */
 			filp->f_pos = 0;
@@ -353,6 +480,8 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 		long ret;
 
 		ret = lib_ring_buffer_get_next_subbuf(buf);
+		if (!ret)
+			ret = lib_ring_buffer_compress_subbuf(buf);
 		if (!ret) {
 			/* Set file position to zero at each successful "get" */
 			filp->f_pos = 0;
@@ -361,6 +490,7 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 	}
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_PUT_NEXT_SUBBUF:
 		lib_ring_buffer_put_next_subbuf(buf);
+		lib_ring_buffer_resize_pending(buf);
 		return 0;
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_SUBBUF_SIZE:
 	{
@@ -420,6 +550,104 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_CLEAR:
 		lib_ring_buffer_clear(buf);
 		return 0;
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_NUM_SUBBUF:
+		return compat_put_ulong(buf->backend.num_subbuf, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_CONTROL_MMAP_OFFSET:
+	{
+		unsigned long offset;
+
+		if (!buf->control)
+			return -EINVAL;
+		offset = lib_ring_buffer_control_mmap_offset(buf);
+		if (offset > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(offset, arg);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_CONTROL_MMAP_LEN:
+	{
+		size_t len;
+
+		if (!buf->control)
+			return -EINVAL;
+		len = lib_ring_buffer_control_len(chan);
+		if (len > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(len, arg);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_COMPRESSED_SUBBUF_SIZE:
+		if (!buf->compress)
+			return -EINVAL;
+		return compat_put_ulong(buf->compress->size, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_COMPRESSED_MMAP_OFFSET:
+	{
+		unsigned long offset;
+
+		if (!buf->compress)
+			return -EINVAL;
+		offset = lib_ring_buffer_compress_mmap_offset(buf);
+		if (offset > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(offset, arg);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_COMPRESSED_MMAP_LEN:
+		if (!buf->compress)
+			return -EINVAL;
+		if (buf->compress->len > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(buf->compress->len, arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_INDEX_MMAP_OFFSET:
+	{
+		unsigned long offset;
+
+		if (!buf->index)
+			return -EINVAL;
+		offset = lib_ring_buffer_index_mmap_offset(buf);
+		if (offset > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(offset, arg);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_INDEX_MMAP_LEN:
+	{
+		size_t len;
+
+		if (!buf->index)
+			return -EINVAL;
+		len = lib_ring_buffer_index_len(chan);
+		if (len > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(len, arg);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SET_NUM_SUBBUF:
+	{
+		__u32 num_subbuf;
+		long ret;
+
+		ret = get_user(num_subbuf, (__u32 __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		return lib_ring_buffer_resize(buf, num_subbuf);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SET_WRITEOUT_FD:
+	{
+		int fd;
+		long ret;
+
+		ret = get_user(fd, (int __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		if (fd < 0)
+			return lib_ring_buffer_stop_writeout(buf);
+		return lib_ring_buffer_set_writeout(buf, fd);
+	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_STATS:
+	{
+		struct lttng_kernel_abi_ring_buffer_stats stats;
+
+		lib_ring_buffer_get_stats(buf, &stats);
+		if (copy_to_user(compat_ptr(arg), &stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+	}
 	default:
 		return -ENOIOCTLCMD;
 	}
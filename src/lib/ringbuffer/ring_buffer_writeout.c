@@ -0,0 +1,211 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR LGPL-2.1-only)
+ *
+ * ring_buffer_writeout.c
+ *
+ * In-kernel writeout of delivered sub-buffers to a file.
+ *
+ * A work item, queued whenever the buffer readers are woken up, takes the
+ * stream reader role: it gets each delivered sub-buffer, writes it to the
+ * file and gives it back to the producer.
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include <ringbuffer/backend.h>
+#include <ringbuffer/frontend.h>
+#include <wrapper/fs.h>
+#include <wrapper/wait.h>
+
+struct lttng_kernel_ring_buffer_writeout {
+	struct lttng_kernel_ring_buffer *buf;
+	struct file *file;		/* Output file */
+	loff_t pos;			/* Output file position */
+	int error;			/* First write error */
+	struct work_struct work;
+	lttng_wait_queue_entry_t wait;	/* Entry in the buffer read_wait */
+};
+
+/*
+ * Set as the buffer writeout while it is being stopped, so reader entry
+ * points stay busy until the writeout work is flushed.
+ */
+static struct lttng_kernel_ring_buffer_writeout writeout_stopping;
+
+/*
+ * Write @len bytes of the sub-buffer held by the reader.
+ */
+static
+int lib_ring_buffer_writeout_subbuf(struct lttng_kernel_ring_buffer_writeout *wo,
+				    unsigned long len)
+{
+	struct lttng_kernel_ring_buffer *buf = wo->buf;
+	struct lttng_kernel_ring_buffer_backend *bufb = &buf->backend;
+	const struct lttng_kernel_ring_buffer_config *config = &bufb->chan->backend.config;
+	unsigned long offset = 0;
+
+	while (offset < len) {
+		unsigned long chunk;
+		const void *src;
+		ssize_t ret;
+
+		if (config->backend == RING_BUFFER_VMAP) {
+			unsigned long sb_bindex;
+
+			sb_bindex = subbuffer_id_get_index(config,
+					subbuffer_read_id(config, bufb,
+						buf->get_subbuf_consumed));
+			src = bufb->array[sb_bindex]->vaddr + offset;
+			chunk = len - offset;
+		} else {
+			/* Pages are only contiguous up to the page end. */
+			src = lib_ring_buffer_read_offset_address(bufb,
+					buf->get_subbuf_consumed + offset);
+			chunk = min_t(unsigned long, len - offset,
+				      PAGE_SIZE - ((unsigned long) src & ~PAGE_MASK));
+		}
+		ret = lttng_kernel_write(wo->file, src, chunk, &wo->pos);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -EIO;
+		offset += ret;
+	}
+	return 0;
+}
+
+static
+void lib_ring_buffer_writeout_work(struct work_struct *work)
+{
+	struct lttng_kernel_ring_buffer_writeout *wo =
+		container_of(work, struct lttng_kernel_ring_buffer_writeout, work);
+	struct lttng_kernel_ring_buffer *buf = wo->buf;
+	const struct lttng_kernel_ring_buffer_config *config = &buf->backend.chan->backend.config;
+
+	while (!wo->error) {
+		unsigned long len;
+		int ret;
+
+		if (lib_ring_buffer_get_next_subbuf(buf))
+			break;
+		/* Keep packets page-aligned in the file, as splice readers do. */
+		len = PAGE_ALIGN(lib_ring_buffer_get_read_data_size(config, buf));
+		ret = lib_ring_buffer_writeout_subbuf(wo, len);
+		lib_ring_buffer_put_next_subbuf(buf);
+		lib_ring_buffer_resize_pending(buf);
+		if (ret) {
+			printk(KERN_WARNING "LTTng: ring buffer writeout error %d, stopping writeout\n",
+			       ret);
+			wo->error = ret;
+		}
+		cond_resched();
+	}
+}
+
+static
+int lib_ring_buffer_writeout_wake(lttng_wait_queue_entry_t *wait, unsigned int mode,
+				  int sync, void *key)
+{
+	struct lttng_kernel_ring_buffer_writeout *wo =
+		container_of(wait, struct lttng_kernel_ring_buffer_writeout, wait);
+
+	queue_work(system_unbound_wq, &wo->work);
+	return 0;
+}
+
+/**
+ * lib_ring_buffer_set_writeout - write delivered sub-buffers to a file
+ * @buf: buffer, opened for reading by the caller
+ * @fd: file descriptor opened for writing
+ *
+ * Sub-buffers are written at the file position @fd has when writeout is
+ * set, padded to the page size. The caller must not read the buffer
+ * itself until lib_ring_buffer_stop_writeout(). Returns -EBUSY if the
+ * caller holds sub-buffers.
+ */
+int lib_ring_buffer_set_writeout(struct lttng_kernel_ring_buffer *buf, int fd)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_kernel_ring_buffer_writeout *wo;
+	int ret;
+
+	if (config->alloc != RING_BUFFER_ALLOC_PER_CPU || buf->compress)
+		return -EINVAL;
+	if (READ_ONCE(buf->get_subbuf))
+		return -EBUSY;
+	wo = kzalloc(sizeof(*wo), GFP_KERNEL);
+	if (!wo)
+		return -ENOMEM;
+	wo->file = fget(fd);
+	if (!wo->file) {
+		ret = -EBADF;
+		goto error_free;
+	}
+	if (!(wo->file->f_mode & FMODE_WRITE)) {
+		ret = -EBADF;
+		goto error_fput;
+	}
+	wo->buf = buf;
+	wo->pos = wo->file->f_pos;
+	INIT_WORK(&wo->work, lib_ring_buffer_writeout_work);
+	init_waitqueue_func_entry(&wo->wait, lib_ring_buffer_writeout_wake);
+	if (cmpxchg(&buf->writeout, NULL, wo)) {
+		ret = -EBUSY;
+		goto error_fput;
+	}
+	/*
+	 * Reader ioctls fail once writeout is visible. Recheck for a
+	 * sub-buffer taken by one which was already past that check.
+	 */
+	smp_mb();
+	if (READ_ONCE(buf->get_subbuf)) {
+		WRITE_ONCE(buf->writeout, NULL);
+		ret = -EBUSY;
+		goto error_fput;
+	}
+	add_wait_queue(&buf->read_wait, &wo->wait);
+	/* Write out the sub-buffers delivered before writeout was set. */
+	queue_work(system_unbound_wq, &wo->work);
+	return 0;
+
+error_fput:
+	fput(wo->file);
+error_free:
+	kfree(wo);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_set_writeout);
+
+/**
+ * lib_ring_buffer_stop_writeout - stop writing sub-buffers to a file
+ * @buf: buffer
+ *
+ * Waits for the writeout in progress. Returns the first write error,
+ * -EINVAL if no writeout was set, or -EBUSY if it is being stopped.
+ */
+int lib_ring_buffer_stop_writeout(struct lttng_kernel_ring_buffer *buf)
+{
+	struct lttng_kernel_ring_buffer_writeout *wo;
+	int ret;
+
+	do {
+		wo = READ_ONCE(buf->writeout);
+		if (!wo)
+			return -EINVAL;
+		if (wo == &writeout_stopping)
+			return -EBUSY;
+	} while (cmpxchg(&buf->writeout, wo, &writeout_stopping) != wo);
+	remove_wait_queue(&buf->read_wait, &wo->wait);
+	flush_work(&wo->work);
+	/* The work is done with the buffer: let readers in. */
+	smp_store_release(&buf->writeout, NULL);
+	ret = wo->error;
+	fput(wo->file);
+	kfree(wo);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_stop_writeout);
@@ -31,6 +31,7 @@
 #include <linux/uaccess.h>
 #include <linux/slab.h>
 #include <linux/err.h>
+#include <linux/compat.h>
 #include <wrapper/vmalloc.h>	/* for wrapper_vmalloc_sync_mappings() */
 #include <ringbuffer/vfs.h>
 #include <ringbuffer/backend.h>
@@ -139,6 +140,55 @@ void event_notifier_send_notification_work_wakeup(struct irq_work *entry)
 	wake_up_interruptible(&event_notifier_group->read_wait);
 }
 
+/*
+ * Wake up readers of notifications held back by the wakeup watermark, even
+ * within a partially filled sub-buffer: the reader flushes it.
+ */
+static
+void event_notifier_group_wakeup_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
+{
+	struct lttng_event_notifier_group *event_notifier_group =
+			lttng_from_timer(event_notifier_group, t, wakeup_timer);
+	struct lttng_kernel_ring_buffer_channel *chan = event_notifier_group->chan;
+	struct lttng_kernel_ring_buffer *buf = event_notifier_group->buf;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	unsigned long consumed, offset;
+
+	offset = lib_ring_buffer_get_offset(config, buf);
+	consumed = lib_ring_buffer_get_consumed(config, buf);
+	if (subbuf_trunc(offset, chan) != subbuf_trunc(consumed, chan)
+	    || subbuf_offset(offset, chan) > config->cb.subbuffer_header_size())
+		wake_up_interruptible(&event_notifier_group->read_wait);
+	mod_timer(&event_notifier_group->wakeup_timer,
+		  jiffies + chan->read_timer_interval);
+}
+
+/*
+ * Called with the sessions lock held.
+ */
+static
+int lttng_event_notifier_group_set_wakeup(struct lttng_event_notifier_group *event_notifier_group,
+		const struct lttng_kernel_abi_notification_wakeup *wakeup_param)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = event_notifier_group->chan;
+	int ret;
+
+	if (event_notifier_group->wakeup_timer_enabled) {
+		del_timer_sync(&event_notifier_group->wakeup_timer);
+		event_notifier_group->wakeup_timer_enabled = 0;
+	}
+	ret = lib_ring_buffer_channel_set_wakeup_watermark(chan,
+			wakeup_param->watermark, wakeup_param->max_latency);
+	if (ret)
+		return ret;
+	if (wakeup_param->watermark > 1) {
+		mod_timer(&event_notifier_group->wakeup_timer,
+			  jiffies + chan->read_timer_interval);
+		event_notifier_group->wakeup_timer_enabled = 1;
+	}
+	return 0;
+}
+
 static
 int lttng_abi_create_event_notifier_group(void)
 {
@@ -167,6 +217,8 @@ int lttng_abi_create_event_notifier_group(void)
 	init_waitqueue_head(&event_notifier_group->read_wait);
 	init_irq_work(&event_notifier_group->wakeup_pending,
 		      event_notifier_send_notification_work_wakeup);
+	lttng_timer_setup(&event_notifier_group->wakeup_timer,
+			  event_notifier_group_wakeup_timer, 0, event_notifier_group);
 	fd_install(event_notifier_group_fd, event_notifier_group_file);
 	return event_notifier_group_fd;
 
@@ -503,9 +555,43 @@ int lttng_abi_create_channel(struct file *session_file,
 	const char *transport_name;
 	struct lttng_kernel_channel_buffer *chan;
 	struct file *chan_file;
+	unsigned int flags = 0;
 	int chan_fd;
 	int ret = 0;
 
+	if (chan_param->flags & ~(LTTNG_KERNEL_ABI_CHANNEL_FLAG_LAZY_ALLOC
+			| LTTNG_KERNEL_ABI_CHANNEL_FLAG_AUTO_RESIZE
+			| LTTNG_KERNEL_ABI_CHANNEL_FLAG_ADAPTIVE_SWITCH_TIMER
+			| LTTNG_KERNEL_ABI_CHANNEL_FLAG_MMAP_PREFAULT
+			| LTTNG_KERNEL_ABI_CHANNEL_FLAG_TINY_HEADER
+			| LTTNG_KERNEL_ABI_CHANNEL_FLAG_COMPRESS_LZ4
+			| LTTNG_KERNEL_ABI_CHANNEL_FLAG_COMPRESS_ZSTD))
+		return -EINVAL;
+	if ((chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_TINY_HEADER)
+	    && (channel_type != PER_CPU_CHANNEL || BITS_PER_LONG != 64))
+		return -EINVAL;
+	if ((chan_param->flags & (LTTNG_KERNEL_ABI_CHANNEL_FLAG_COMPRESS_LZ4
+			| LTTNG_KERNEL_ABI_CHANNEL_FLAG_COMPRESS_ZSTD))
+	    && channel_type != PER_CPU_CHANNEL)
+		return -EINVAL;
+	/* Resizing frees pages an mmap reader could still have mapped. */
+	if ((chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_AUTO_RESIZE)
+	    && (channel_type != PER_CPU_CHANNEL
+		|| chan_param->output != LTTNG_KERNEL_ABI_SPLICE))
+		return -EINVAL;
+	if (chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_LAZY_ALLOC)
+		flags |= RING_BUFFER_CHANNEL_LAZY_ALLOC;
+	if (chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_AUTO_RESIZE)
+		flags |= RING_BUFFER_CHANNEL_AUTO_RESIZE;
+	if (chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_ADAPTIVE_SWITCH_TIMER)
+		flags |= RING_BUFFER_CHANNEL_ADAPTIVE_SWITCH_TIMER;
+	if (chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_MMAP_PREFAULT)
+		flags |= RING_BUFFER_CHANNEL_MMAP_PREFAULT;
+	if (chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_COMPRESS_LZ4)
+		flags |= RING_BUFFER_CHANNEL_COMPRESS_LZ4;
+	if (chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_COMPRESS_ZSTD)
+		flags |= RING_BUFFER_CHANNEL_COMPRESS_ZSTD;
+
 	chan_fd = get_unused_fd_flags(0);
 	if (chan_fd < 0) {
 		ret = chan_fd;
@@ -564,11 +650,14 @@ int lttng_abi_create_channel(struct file *session_file,
 				  chan_param->num_subbuf,
 				  chan_param->switch_timer_interval,
 				  chan_param->read_timer_interval,
+				  flags,
 				  channel_type);
 	if (!chan) {
 		ret = -EINVAL;
 		goto chan_error;
 	}
+	if (chan_param->flags & LTTNG_KERNEL_ABI_CHANNEL_FLAG_TINY_HEADER)
+		chan->priv->tiny_header = 1;
 	chan->priv->parent.file = chan_file;
 	chan_file->private_data = chan;
 	fd_install(chan_fd, chan_file);
@@ -686,6 +775,14 @@ end:
 	return 0;
 }
 
+static
+unsigned int user_event_param_ext_get_priority(const struct lttng_kernel_abi_event_ext *event_param_ext)
+{
+	if (event_param_ext->len < offsetofend(struct lttng_kernel_abi_event_ext, priority))
+		return 0;
+	return event_param_ext->priority;
+}
+
 static
 int create_counter_key_from_abi_dimensions(struct lttng_kernel_counter_key **_counter_key,
 		uint32_t nr_dimensions, void __user *ptr)
@@ -1528,6 +1625,7 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		chan_param.switch_timer_interval = old_chan_param.switch_timer_interval;
 		chan_param.read_timer_interval = old_chan_param.read_timer_interval;
 		chan_param.output = old_chan_param.output;
+		chan_param.flags = 0;
 
 		return lttng_abi_create_channel(file, &chan_param,
 				PER_CPU_CHANNEL);
@@ -1563,6 +1661,7 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		chan_param.switch_timer_interval = old_chan_param.switch_timer_interval;
 		chan_param.read_timer_interval = old_chan_param.read_timer_interval;
 		chan_param.output = old_chan_param.output;
+		chan_param.flags = 0;
 
 		return lttng_abi_create_channel(file, &chan_param,
 				METADATA_CHANNEL);
@@ -1860,7 +1959,7 @@ retry:
 			}
 		} else {
 			if (subbuf_trunc(offset, chan) - subbuf_trunc(consumed, chan)
-					>= chan->backend.buf_size)
+					>= buf->backend.buf_size)
 				return POLLPRI | POLLRDBAND;
 			else
 				return POLLIN | POLLRDNORM;
@@ -2354,6 +2453,120 @@ fd_error:
 	return ret;
 }
 
+static
+unsigned int lttng_channel_ready_poll(struct file *file, poll_table *wait)
+{
+	struct lttng_kernel_channel_buffer *channel = file->private_data;
+	struct lttng_kernel_ring_buffer_channel *chan = channel->priv->rb_chan;
+
+	if (!(file->f_mode & FMODE_READ))
+		return 0;
+	poll_wait(file, &chan->read_ready_wait, wait);
+	if (!cpumask_empty(chan->read_ready))
+		return POLLIN | POLLRDNORM;
+	if (channel->ops->priv->is_finalized(chan))
+		return POLLHUP;
+	return 0;
+}
+
+static
+ssize_t lttng_channel_ready_read(struct file *file, char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	struct lttng_kernel_channel_buffer *channel = file->private_data;
+	struct lttng_kernel_ring_buffer_channel *chan = channel->priv->rb_chan;
+	uint32_t __user *ucpu = (uint32_t __user *) user_buf;
+	cpumask_var_t mask;
+	ssize_t ret;
+	int cpu, nr = 0, finalized;
+
+	if (count < nr_cpu_ids * sizeof(uint32_t))
+		return -EINVAL;
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+	for (;;) {
+		/*
+		 * Read finalized before fetching the mask, so buffers
+		 * delivered before finalize are reported before end of file.
+		 */
+		finalized = channel->ops->priv->is_finalized(chan);
+		smp_rmb();
+		ret = lib_ring_buffer_channel_read_ready(chan, mask);
+		if (ret)
+			break;
+		/* End of file once finalized with no buffer left to report. */
+		if (finalized)
+			goto end;
+		if (file->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto end;
+		}
+		/* A concurrent reader may fetch the mask before us: wait again. */
+		ret = wait_event_interruptible(chan->read_ready_wait,
+				!cpumask_empty(chan->read_ready)
+				|| channel->ops->priv->is_finalized(chan));
+		if (ret)
+			goto end;
+	}
+	if (ret < 0)
+		goto end;
+	for_each_cpu(cpu, mask) {
+		if (put_user((uint32_t) cpu, &ucpu[nr++])) {
+			ret = -EFAULT;
+			goto end;
+		}
+	}
+	ret = nr * sizeof(uint32_t);
+end:
+	free_cpumask_var(mask);
+	return ret;
+}
+
+static
+int lttng_channel_ready_release(struct inode *inode, struct file *file)
+{
+	struct lttng_kernel_channel_buffer *channel = file->private_data;
+
+	fput(channel->priv->parent.file);
+	return 0;
+}
+
+static const struct file_operations lttng_channel_ready_fops = {
+	.owner = THIS_MODULE,
+	.poll = lttng_channel_ready_poll,
+	.read = lttng_channel_ready_read,
+	.release = lttng_channel_ready_release,
+};
+
+/*
+ * The readiness file descriptor reports which per-cpu streams of the channel
+ * have data to deliver, so a consumer can poll a single file descriptor per
+ * channel and only scan the streams that are ready.
+ */
+static
+int lttng_abi_open_channel_ready(struct file *channel_file)
+{
+	struct lttng_kernel_channel_buffer *channel = channel_file->private_data;
+	struct lttng_kernel_ring_buffer_channel *chan = channel->priv->rb_chan;
+	int ret;
+
+	if (chan->backend.config.alloc != RING_BUFFER_ALLOC_PER_CPU)
+		return -EINVAL;
+	/* The readiness fd holds a reference on the channel */
+	if (!atomic_long_add_unless(&channel_file->f_count, 1, LONG_MAX))
+		return -EOVERFLOW;
+	ret = lttng_abi_create_stream_fd(channel_file, channel,
+			&lttng_channel_ready_fops, "[lttng_channel_ready]");
+	if (ret < 0)
+		goto fd_error;
+
+	return ret;
+
+fd_error:
+	atomic_long_dec(&channel_file->f_count);
+	return ret;
+}
+
 static
 int lttng_abi_open_metadata_stream(struct file *channel_file)
 {
@@ -2718,8 +2931,10 @@ int lttng_abi_create_event_recorder_enabler(struct file *channel_file,
 			event_enabler = lttng_event_recorder_enabler_create(LTTNG_ENABLER_FORMAT_NAME,
 				event_param, channel);
 		}
-		if (event_enabler)
+		if (event_enabler) {
+			event_enabler->priority = user_event_param_ext_get_priority(event_param_ext);
 			lttng_event_enabler_session_add(channel->parent.session, &event_enabler->parent);
+		}
 		priv = event_enabler;
 		break;
 	}
@@ -2732,8 +2947,10 @@ int lttng_abi_create_event_recorder_enabler(struct file *channel_file,
 
 		event_enabler = lttng_event_recorder_enabler_create(LTTNG_ENABLER_FORMAT_NAME,
 				event_param, channel);
-		if (event_enabler)
+		if (event_enabler) {
+			event_enabler->priority = user_event_param_ext_get_priority(event_param_ext);
 			lttng_event_enabler_session_add(channel->parent.session, &event_enabler->parent);
+		}
 		priv = event_enabler;
 		break;
 	}
@@ -2749,6 +2966,7 @@ int lttng_abi_create_event_recorder_enabler(struct file *channel_file,
 			ret = -ENOMEM;
 			goto event_error;
 		}
+		event_enabler->priority = user_event_param_ext_get_priority(event_param_ext);
 		/*
 		 * We tolerate no failure path after event creation. It
 		 * will stay invariant for the rest of the session.
@@ -3382,6 +3600,22 @@ long lttng_event_notifier_group_ioctl(struct file *file, unsigned int cmd,
 	{
 		return lttng_abi_open_event_notifier_group_stream(file);
 	}
+	case LTTNG_KERNEL_ABI_EVENT_NOTIFIER_GROUP_NOTIFICATION_WAKEUP:
+	{
+		struct lttng_event_notifier_group *event_notifier_group =
+				file->private_data;
+		struct lttng_kernel_abi_notification_wakeup wakeup_param;
+
+		if (copy_from_user(&wakeup_param,
+				(struct lttng_kernel_abi_notification_wakeup __user *) arg,
+				sizeof(wakeup_param)))
+			return -EFAULT;
+		lttng_lock_sessions();
+		ret = lttng_event_notifier_group_set_wakeup(event_notifier_group,
+				&wakeup_param);
+		lttng_unlock_sessions();
+		return ret;
+	}
 	case LTTNG_KERNEL_ABI_EVENT_NOTIFIER_CREATE:
 	{
 		struct lttng_kernel_abi_event_notifier uevent_notifier_param;
@@ -3454,6 +3688,8 @@ static const struct file_operations lttng_event_notifier_group_fops = {
  *      LTTNG_KERNEL_ABI_STREAM
  *              Returns an event stream file descriptor or failure.
  *              (typically, one event stream records events from one CPU)
+ *	LTTNG_KERNEL_ABI_CHANNEL_READY
+ *		Returns a channel stream readiness file descriptor or failure.
  *	LTTNG_KERNEL_ABI_EVENT
  *		Returns an event file descriptor or failure.
  *	LTTNG_KERNEL_ABI_CONTEXT
@@ -3474,6 +3710,8 @@ long lttng_channel_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case LTTNG_KERNEL_ABI_OLD_STREAM:
 	case LTTNG_KERNEL_ABI_STREAM:
 		return lttng_abi_open_stream(file);
+	case LTTNG_KERNEL_ABI_CHANNEL_READY:
+		return lttng_abi_open_channel_ready(file);
 	case LTTNG_KERNEL_ABI_OLD_EVENT:
 	{
 		struct lttng_kernel_abi_event *uevent_param;
@@ -3886,6 +4124,64 @@ static int put_u32(uint32_t val, unsigned long arg)
 	return put_user(val, (uint32_t __user *) arg);
 }
 
+/*
+ * Get the next ready sub-buffers and copy their packet descriptors to
+ * user-space. The sub-buffers are released on error. As with
+ * GET_NEXT_SUBBUF, splice reads start over at the first sub-buffer held.
+ */
+static long lttng_stream_get_next_subbuf_batch(struct file *filp,
+		struct lttng_kernel_ring_buffer *buf,
+		struct lttng_kernel_abi_ring_buffer_batch __user *ubatch)
+{
+	struct lttng_kernel_ring_buffer_channel *chan = buf->backend.chan;
+	const struct lttng_kernel_ring_buffer_config *config = &chan->backend.config;
+	const struct lttng_kernel_channel_buffer_ops *ops = chan->backend.priv_ops;
+	struct lttng_kernel_abi_ring_buffer_packet_desc __user *udesc;
+	struct lttng_kernel_abi_ring_buffer_batch batch;
+	unsigned long nr, i;
+	int ret;
+
+	if (!ops->priv->packet_desc)
+		return -ENOSYS;
+	if (copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+	if (!batch.max_count)
+		return -EINVAL;
+	udesc = (struct lttng_kernel_abi_ring_buffer_packet_desc __user *)
+			(unsigned long) batch.packets;
+	nr = batch.max_count;
+	ret = lib_ring_buffer_get_next_subbuf_batch(buf, &nr);
+	if (!ret)
+		ret = lib_ring_buffer_compress_subbuf(buf);
+	if (ret)
+		return ret;
+	for (i = 0; i < nr; i++) {
+		struct lttng_kernel_abi_ring_buffer_packet_desc desc;
+		unsigned long offset = i << chan->backend.subbuf_size_order;
+
+		memset(&desc, 0, sizeof(desc));
+		desc.offset = offset;
+		ret = ops->priv->packet_desc(config, buf,
+				buf->cons_snapshot + offset, &desc);
+		if (ret < 0)
+			goto error_put;
+		if (copy_to_user(&udesc[i], &desc, sizeof(desc))) {
+			ret = -EFAULT;
+			goto error_put;
+		}
+	}
+	if (put_user((uint32_t) nr, &ubatch->count)) {
+		ret = -EFAULT;
+		goto error_put;
+	}
+	filp->f_pos = 0;
+	return 0;
+
+error_put:
+	lib_ring_buffer_put_subbuf(buf);
+	return ret;
+}
+
 static long lttng_stream_ring_buffer_ioctl(struct file *filp,
 		unsigned int cmd, unsigned long arg)
 {
@@ -3897,6 +4193,11 @@ static long lttng_stream_ring_buffer_ioctl(struct file *filp,
 
 	if (atomic_read(&chan->record_disabled))
 		return -EIO;
+	/* The writeout work is the reader, see lib_ring_buffer_ioctl(). */
+	if (READ_ONCE(buf->writeout)
+	    && cmd != LTTNG_KERNEL_ABI_RING_BUFFER_SET_WRITEOUT_FD
+	    && cmd != LTTNG_KERNEL_ABI_RING_BUFFER_GET_STATS)
+		return -EBUSY;
 
 	switch (cmd) {
 	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_TIMESTAMP_BEGIN:
@@ -3980,6 +4281,16 @@ static long lttng_stream_ring_buffer_ioctl(struct file *filp,
 			goto error;
 		return put_u64(id, arg);
 	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_GET_NEXT_SUBBUF_BATCH:
+		return lttng_stream_get_next_subbuf_batch(filp, buf,
+				(struct lttng_kernel_abi_ring_buffer_batch __user *) arg);
+	case LTTNG_KERNEL_ABI_RING_BUFFER_PUT_NEXT_SUBBUF_BATCH:
+		/* Only release sub-buffers held by a batch get. */
+		if (!buf->get_subbuf || !buf->get_subbuf_nr)
+			return -EINVAL;
+		lib_ring_buffer_put_next_subbuf_batch(buf);
+		lib_ring_buffer_resize_pending(buf);
+		return 0;
 	default:
 		return lib_ring_buffer_file_operations.unlocked_ioctl(filp,
 				cmd, arg);
@@ -4001,6 +4312,11 @@ static long lttng_stream_ring_buffer_compat_ioctl(struct file *filp,
 
 	if (atomic_read(&chan->record_disabled))
 		return -EIO;
+	/* The writeout work is the reader, see lib_ring_buffer_ioctl(). */
+	if (READ_ONCE(buf->writeout)
+	    && cmd != LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_SET_WRITEOUT_FD
+	    && cmd != LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_STATS)
+		return -EBUSY;
 
 	switch (cmd) {
 	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_TIMESTAMP_BEGIN:
@@ -4084,6 +4400,16 @@ static long lttng_stream_ring_buffer_compat_ioctl(struct file *filp,
 			goto error;
 		return put_u64(id, arg);
 	}
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_GET_NEXT_SUBBUF_BATCH:
+		return lttng_stream_get_next_subbuf_batch(filp, buf,
+				compat_ptr(arg));
+	case LTTNG_KERNEL_ABI_RING_BUFFER_COMPAT_PUT_NEXT_SUBBUF_BATCH:
+		/* Only release sub-buffers held by a batch get. */
+		if (!buf->get_subbuf || !buf->get_subbuf_nr)
+			return -EINVAL;
+		lib_ring_buffer_put_next_subbuf_batch(buf);
+		lib_ring_buffer_resize_pending(buf);
+		return 0;
 	default:
 		return lib_ring_buffer_file_operations.compat_ioctl(filp,
 				cmd, arg);
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-bytecode-compiler.c
+ *
+ * LTTng modules bytecode predicate compiler.
+ *
+ * Filters made of integer comparisons between an event field (or a static
+ * context field) and a constant, all joined by "&&" or all joined by "||",
+ * are compiled after specialization into a flat table of predicates, from
+ * the comparisons fused by the specializer. The
+ * table is evaluated by a straight loop, without the dispatch of each
+ * instruction and the stack traffic of the interpreter. Any other filter
+ * keeps using the interpreter.
+ */
+
+#include <linux/slab.h>
+
+#include <lttng/lttng-bytecode.h>
+#include <lttng/events-internal.h>
+
+/* Maximum number of predicates of a compiled filter. */
+#define BYTECODE_PRED_MAX	8
+
+/*
+ * Compile a comparison fused by the specializer into one predicate, or a
+ * range check into two. Returns the number of predicates, a negative error
+ * if the instruction is not a fused comparison.
+ */
+static
+int compile_term(const char *start_pc, uint16_t len, uint16_t *offset,
+		struct bytecode_pred *pred)
+{
+	const char *pc = &start_pc[*offset];
+
+	if (*offset + sizeof(bytecode_opcode_t) > len)
+		return -EINVAL;
+	switch (*(bytecode_opcode_t *) pc) {
+	case BYTECODE_OP_CMP_FIELD_REF_S64_IMM:
+	case BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM:
+	{
+		const struct cmp_imm_op *insn = (const struct cmp_imm_op *) pc;
+
+		pred->context = (insn->op == BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM);
+		pred->offset = insn->index;
+		pred->accept = insn->accept;
+		pred->imm = insn->imm;
+		*offset += insn->len;
+		return 1;
+	}
+	case BYTECODE_OP_RANGE_FIELD_REF_S64:
+	case BYTECODE_OP_RANGE_CONTEXT_REF_S64:
+	{
+		const struct range_op *insn = (const struct range_op *) pc;
+		unsigned int i;
+
+		for (i = 0; i < 2; i++) {
+			pred[i].context = (insn->op == BYTECODE_OP_RANGE_CONTEXT_REF_S64);
+			pred[i].offset = insn->index;
+			pred[i].accept = insn->accept[i];
+			pred[i].imm = insn->imm[i];
+		}
+		*offset += insn->len;
+		return 2;
+	}
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Compile a specialized filter bytecode into bytecode->pred. Bytecode which
+ * does not have the supported form is left to the interpreter. Returns 0 on
+ * success, -EINVAL if the bytecode cannot be compiled, -ENOMEM if out of
+ * memory.
+ */
+int lttng_bytecode_compile(struct bytecode_runtime *bytecode)
+{
+	const char *start_pc = bytecode->code;
+	struct bytecode_pred preds[BYTECODE_PRED_MAX];
+	uint16_t logical[BYTECODE_PRED_MAX], skip[BYTECODE_PRED_MAX];
+	struct bytecode_pred_prog *prog;
+	bytecode_opcode_t logical_op = BYTECODE_OP_UNKNOWN;
+	unsigned int nr_preds = 0, nr_terms = 0, i, j;
+	bool range = false;
+	uint16_t offset = 0, len = bytecode->len;
+
+	if (bytecode->p.type != LTTNG_KERNEL_BYTECODE_TYPE_FILTER)
+		return -EINVAL;
+	for (;;) {
+		bytecode_opcode_t op;
+		int ret;
+
+		if (nr_preds + 2 > BYTECODE_PRED_MAX)
+			return -EINVAL;
+		ret = compile_term(start_pc, len, &offset, &preds[nr_preds]);
+		if (ret < 0)
+			return ret;
+		range |= (ret > 1);
+		nr_preds += ret;
+		nr_terms++;
+		if (offset + sizeof(bytecode_opcode_t) > len)
+			return -EINVAL;
+		op = *(bytecode_opcode_t *) &start_pc[offset];
+		if (op == BYTECODE_OP_RETURN || op == BYTECODE_OP_RETURN_S64)
+			break;
+		if (op != BYTECODE_OP_AND && op != BYTECODE_OP_OR)
+			return -EINVAL;
+		/* Mixing "&&" and "||" needs the interpreter. */
+		if (logical_op != BYTECODE_OP_UNKNOWN && op != logical_op)
+			return -EINVAL;
+		if (offset + sizeof(struct logical_op) > len)
+			return -EINVAL;
+		logical_op = op;
+		logical[nr_terms - 1] = offset;
+		skip[nr_terms - 1] = ((const struct logical_op *) &start_pc[offset])->skip_offset;
+		offset += sizeof(struct logical_op);
+	}
+	/* A range check is a "&&" of two predicates. */
+	if (range && logical_op == BYTECODE_OP_OR)
+		return -EINVAL;
+
+	/*
+	 * Short-circuits must land on a later logical operator of the chain,
+	 * which short-circuits again, or on the return.
+	 */
+	for (i = 0; i < nr_terms - 1; i++) {
+		bool found = (skip[i] == offset);
+
+		for (j = i + 1; j < nr_terms - 1 && !found; j++)
+			found = (skip[i] == logical[j]);
+		if (!found)
+			return -EINVAL;
+	}
+
+	prog = kzalloc(sizeof(*prog) + nr_preds * sizeof(prog->preds[0]), GFP_KERNEL);
+	if (!prog)
+		return -ENOMEM;
+	prog->is_or = (logical_op == BYTECODE_OP_OR);
+	prog->nr_preds = nr_preds;
+	memcpy(prog->preds, preds, nr_preds * sizeof(preds[0]));
+	bytecode->pred = prog;
+	dbg_printk("Compiled filter into %u predicates\n", nr_preds);
+	return 0;
+}
+
+/*
+ * Evaluate a compiled filter. Same calling convention as
+ * lttng_bytecode_interpret(), for FILTER bytecode only.
+ */
+int lttng_bytecode_interpret_pred(struct lttng_kernel_bytecode_runtime *kernel_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
+		void *caller_ctx)
+{
+	struct bytecode_runtime *bytecode = container_of(kernel_bytecode, struct bytecode_runtime, p);
+	const struct bytecode_pred_prog *prog = bytecode->pred;
+	struct lttng_kernel_bytecode_filter_ctx *filter_ctx =
+		(struct lttng_kernel_bytecode_filter_ctx *) caller_ctx;
+	bool result = !prog->is_or;
+	unsigned int i;
+
+	for (i = 0; i < prog->nr_preds; i++) {
+		const struct bytecode_pred *pred = &prog->preds[i];
+		int64_t v;
+
+		if (likely(!pred->context)) {
+			v = ((const struct literal_numeric *) &interpreter_stack_data[pred->offset])->v;
+		} else {
+			struct lttng_kernel_ctx_field *ctx_field;
+			struct lttng_ctx_value value;
+
+			ctx_field = &lttng_static_ctx->fields[pred->offset];
+			ctx_field->get_value(ctx_field->priv, lttng_probe_ctx, &value);
+			v = value.u.s64;
+		}
+		/* Stop at the first false "&&" term or true "||" term. */
+		if (bytecode_cmp_accept(pred->accept, v, pred->imm) == prog->is_or) {
+			result = prog->is_or;
+			break;
+		}
+	}
+	if (result)
+		filter_ctx->result = LTTNG_KERNEL_BYTECODE_FILTER_ACCEPT;
+	else
+		filter_ctx->result = LTTNG_KERNEL_BYTECODE_FILTER_REJECT;
+	return LTTNG_KERNEL_BYTECODE_INTERPRETER_OK;
+}
@@ -78,6 +78,66 @@ char get_char_at_cb(size_t at, void *data)
 	return get_char(data, at);
 }
 
+/*
+ * Find the first occurrence of @needle within the @len first characters
+ * of @s.
+ */
+static
+const char *star_glob_find(const char *s, size_t len, const char *needle,
+		size_t needle_len)
+{
+	const char *end;
+
+	if (len < needle_len)
+		return NULL;
+	end = s + len - needle_len + 1;
+	while (s < end) {
+		s = memchr(s, needle[0], end - s);
+		if (!s)
+			return NULL;
+		if (!memcmp(s, needle, needle_len))
+			return s;
+		s++;
+	}
+	return NULL;
+}
+
+/*
+ * Match a kernel string of length @len against a compiled pattern: compare
+ * the first and last segments at both ends, then search the other segments
+ * in order, each at its leftmost position.
+ */
+static
+bool star_glob_match(const struct bytecode_star_glob *glob,
+		const char *candidate, size_t len)
+{
+	const char *base = (const char *) glob;
+	unsigned int last = glob->nr_segments - 1, i;
+	size_t first_len = glob->segments[0].len, last_len, pos, end;
+
+	if (!last)
+		return len == first_len
+			&& !memcmp(candidate, base + glob->segments[0].offset, len);
+	last_len = glob->segments[last].len;
+	if (len < first_len + last_len
+			|| memcmp(candidate, base + glob->segments[0].offset, first_len)
+			|| memcmp(candidate + len - last_len,
+				base + glob->segments[last].offset, last_len))
+		return false;
+	pos = first_len;
+	end = len - last_len;
+	for (i = 1; i < last; i++) {
+		const char *found;
+
+		found = star_glob_find(candidate + pos, end - pos,
+			base + glob->segments[i].offset, glob->segments[i].len);
+		if (!found)
+			return false;
+		pos = found - candidate + glob->segments[i].len;
+	}
+	return true;
+}
+
 static
 int stack_star_glob_match(struct estack *stack, int top, const char *cmp_type)
 {
@@ -86,13 +146,6 @@ int stack_star_glob_match(struct estack *stack, int top, const char *cmp_type)
 	struct estack_entry *pattern_reg;
 	struct estack_entry *candidate_reg;
 
-	/* Disable the page fault handler when reading from userspace. */
-	if (estack_bx(stack, top)->u.s.user
-			|| estack_ax(stack, top)->u.s.user) {
-		has_user = true;
-		pagefault_disable();
-	}
-
 	/* Find out which side is the pattern vs. the candidate. */
 	if (estack_ax(stack, top)->u.s.literal_type == ESTACK_STRING_LITERAL_TYPE_STAR_GLOB) {
 		pattern_reg = estack_ax(stack, top);
@@ -102,6 +155,18 @@ int stack_star_glob_match(struct estack *stack, int top, const char *cmp_type)
 		candidate_reg = estack_ax(stack, top);
 	}
 
+	/* Compiled pattern against a kernel string: no per-character callback. */
+	if (pattern_reg->u.s.glob && !candidate_reg->u.s.user)
+		return !star_glob_match(pattern_reg->u.s.glob, candidate_reg->u.s.str,
+			strnlen(candidate_reg->u.s.str, candidate_reg->u.s.seq_len));
+
+	/* Disable the page fault handler when reading from userspace. */
+	if (estack_bx(stack, top)->u.s.user
+			|| estack_ax(stack, top)->u.s.user) {
+		has_user = true;
+		pagefault_disable();
+	}
+
 	/* Perform the match operation. */
 	result = !strutils_star_glob_match_char_cb(get_char_at_cb,
 		pattern_reg, get_char_at_cb, candidate_reg);
@@ -1009,6 +1074,14 @@ int lttng_bytecode_interpret(struct lttng_kernel_bytecode_runtime *kernel_byteco
 		[ BYTECODE_OP_UNARY_BIT_NOT ] = &&LABEL_BYTECODE_OP_UNARY_BIT_NOT,
 
 		[ BYTECODE_OP_RETURN_S64 ] = &&LABEL_BYTECODE_OP_RETURN_S64,
+
+		/* fused instructions */
+		[ BYTECODE_OP_CMP_FIELD_REF_S64_IMM ] = &&LABEL_BYTECODE_OP_CMP_FIELD_REF_S64_IMM,
+		[ BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM ] = &&LABEL_BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM,
+		[ BYTECODE_OP_RANGE_FIELD_REF_S64 ] = &&LABEL_BYTECODE_OP_RANGE_FIELD_REF_S64,
+		[ BYTECODE_OP_RANGE_CONTEXT_REF_S64 ] = &&LABEL_BYTECODE_OP_RANGE_CONTEXT_REF_S64,
+
+		[ BYTECODE_OP_LOAD_STAR_GLOB_COMPILED ] = &&LABEL_BYTECODE_OP_LOAD_STAR_GLOB_COMPILED,
 	};
 #endif /* #ifndef INTERPRETER_USE_SWITCH */
 
@@ -1540,10 +1613,31 @@ int lttng_bytecode_interpret(struct lttng_kernel_bytecode_runtime *kernel_byteco
 			estack_ax(stack, top)->u.s.literal_type =
 				ESTACK_STRING_LITERAL_TYPE_STAR_GLOB;
 			estack_ax(stack, top)->u.s.user = 0;
+			estack_ax(stack, top)->u.s.glob = NULL;
 			next_pc += sizeof(struct load_op) + strlen(insn->data) + 1;
 			PO;
 		}
 
+		OP(BYTECODE_OP_LOAD_STAR_GLOB_COMPILED):
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct get_index_u16 *index = (struct get_index_u16 *) insn->data;
+			const struct bytecode_star_glob *glob =
+				(const struct bytecode_star_glob *) &bytecode->data[index->index];
+
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax(stack, top)->u.s.str = (const char *) glob + glob->pattern_offset;
+			dbg_printk("load compiled globbing pattern %s\n",
+				estack_ax(stack, top)->u.s.str);
+			estack_ax(stack, top)->u.s.seq_len = LTTNG_SIZE_MAX;
+			estack_ax(stack, top)->u.s.literal_type =
+				ESTACK_STRING_LITERAL_TYPE_STAR_GLOB;
+			estack_ax(stack, top)->u.s.user = 0;
+			estack_ax(stack, top)->u.s.glob = glob;
+			next_pc += glob->insn_len;
+			PO;
+		}
+
 		OP(BYTECODE_OP_LOAD_S64):
 		{
 			struct load_op *insn = (struct load_op *) pc;
@@ -1914,6 +2008,71 @@ int lttng_bytecode_interpret(struct lttng_kernel_bytecode_runtime *kernel_byteco
 			PO;
 		}
 
+		/* fused instructions */
+		OP(BYTECODE_OP_CMP_FIELD_REF_S64_IMM):
+		{
+			struct cmp_imm_op *insn = (struct cmp_imm_op *) pc;
+			int64_t v;
+
+			v = ((struct literal_numeric *) &interpreter_stack_data[insn->index])->v;
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax_v = bytecode_cmp_accept(insn->accept, v, insn->imm);
+			estack_ax_t = REG_S64;
+			dbg_printk("cmp field ref s64 %lld imm %lld: %lld\n",
+				(long long) v, (long long) insn->imm,
+				(long long) estack_ax_v);
+			next_pc += insn->len;
+			PO;
+		}
+
+		OP(BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM):
+		{
+			struct cmp_imm_op *insn = (struct cmp_imm_op *) pc;
+			struct lttng_kernel_ctx_field *ctx_field;
+			struct lttng_ctx_value v;
+
+			ctx_field = &lttng_static_ctx->fields[insn->index];
+			ctx_field->get_value(ctx_field->priv, lttng_probe_ctx, &v);
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax_v = bytecode_cmp_accept(insn->accept, v.u.s64, insn->imm);
+			estack_ax_t = REG_S64;
+			dbg_printk("cmp context s64 %lld imm %lld: %lld\n",
+				(long long) v.u.s64, (long long) insn->imm,
+				(long long) estack_ax_v);
+			next_pc += insn->len;
+			PO;
+		}
+
+		OP(BYTECODE_OP_RANGE_FIELD_REF_S64):
+		{
+			struct range_op *insn = (struct range_op *) pc;
+			int64_t v;
+
+			v = ((struct literal_numeric *) &interpreter_stack_data[insn->index])->v;
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax_v = bytecode_cmp_accept(insn->accept[0], v, insn->imm[0])
+				&& bytecode_cmp_accept(insn->accept[1], v, insn->imm[1]);
+			estack_ax_t = REG_S64;
+			next_pc += insn->len;
+			PO;
+		}
+
+		OP(BYTECODE_OP_RANGE_CONTEXT_REF_S64):
+		{
+			struct range_op *insn = (struct range_op *) pc;
+			struct lttng_kernel_ctx_field *ctx_field;
+			struct lttng_ctx_value v;
+
+			ctx_field = &lttng_static_ctx->fields[insn->index];
+			ctx_field->get_value(ctx_field->priv, lttng_probe_ctx, &v);
+			estack_push(stack, top, ax, bx, ax_t, bx_t);
+			estack_ax_v = bytecode_cmp_accept(insn->accept[0], v.u.s64, insn->imm[0])
+				&& bytecode_cmp_accept(insn->accept[1], v.u.s64, insn->imm[1]);
+			estack_ax_t = REG_S64;
+			next_pc += insn->len;
+			PO;
+		}
+
 	END_OP
 end:
 	/* No need to prepare output if an error occurred. */
@@ -1948,20 +2107,37 @@ end:
 LTTNG_STACK_FRAME_NON_STANDARD(lttng_bytecode_interpret);
 
 /*
- * Return LTTNG_KERNEL_EVENT_FILTER_ACCEPT or LTTNG_KERNEL_EVENT_FILTER_REJECT.
+ * Return LTTNG_KERNEL_EVENT_FILTER_ACCEPT or LTTNG_KERNEL_EVENT_FILTER_REJECT,
+ * or LTTNG_KERNEL_EVENT_FILTER_PREPARE if a filter reads fields which are not
+ * in the stack data. The caller then prepares all the fields and runs the
+ * filters again.
  */
 int lttng_kernel_interpret_event_filter(const struct lttng_kernel_event_common *event,
 		const char *interpreter_stack_data,
 		struct lttng_kernel_probe_ctx *probe_ctx,
-		void *event_filter_ctx __attribute__((unused)))
+		void *event_filter_ctx)
 {
+	struct lttng_kernel_event_filter_ctx *filter_ctx =
+		(struct lttng_kernel_event_filter_ctx *) event_filter_ctx;
 	struct lttng_kernel_bytecode_runtime *filter_bc_runtime;
 	struct list_head *filter_bytecode_runtime_head = &event->priv->filter_bytecode_runtime_head;
 	struct lttng_kernel_bytecode_filter_ctx bytecode_filter_ctx;
 	bool filter_record = false;
 
 	list_for_each_entry_rcu(filter_bc_runtime, filter_bytecode_runtime_head, node) {
-		if (likely(filter_bc_runtime->interpreter_func(filter_bc_runtime,
+		int (*interpreter_func)(struct lttng_kernel_bytecode_runtime *,
+				const char *, struct lttng_kernel_probe_ctx *, void *);
+
+		/*
+		 * The fields of a runtime are set before it is published, while
+		 * the event mask of prepared fields is only a hint: it can be
+		 * stale when filters are linked or enabled.
+		 */
+		interpreter_func = READ_ONCE(filter_bc_runtime->interpreter_func);
+		if (unlikely(filter_bc_runtime->fields & ~filter_ctx->fields)
+				&& interpreter_func != lttng_bytecode_interpret_error)
+			return LTTNG_KERNEL_EVENT_FILTER_PREPARE;
+		if (likely(interpreter_func(filter_bc_runtime,
 				interpreter_stack_data, probe_ctx, &bytecode_filter_ctx) == LTTNG_KERNEL_BYTECODE_INTERPRETER_OK)) {
 			if (unlikely(bytecode_filter_ctx.result == LTTNG_KERNEL_BYTECODE_FILTER_ACCEPT)) {
 				filter_record = true;
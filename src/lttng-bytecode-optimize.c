@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-bytecode-optimize.c
+ *
+ * LTTng modules bytecode optimizer.
+ *
+ * Runs on validated filter bytecode, before specialization. A single pass
+ * copies the instructions, folding operators whose operands are integer
+ * literals into a literal, dropping the casts which are known to be no-ops,
+ * and dropping the logical operators whose outcome is known, along with the
+ * branch they skip. Branch targets are then remapped to the shrunk code.
+ */
+
+#include <linux/slab.h>
+#include <linux/bitops.h>
+
+#include <lttng/lttng-bytecode.h>
+#include <lttng/events-internal.h>
+
+struct optimize_state {
+	const char *code;		/* Input code */
+	char *out;			/* Output code */
+	uint16_t out_len;
+	uint16_t *out_insns;		/* Offsets of the output instructions */
+	unsigned int nr_out_insns;
+	/* Output instructions before this one cannot be folded. */
+	unsigned int barrier;
+};
+
+/*
+ * Length of a validated instruction.
+ */
+static
+size_t insn_len(const char *pc)
+{
+	switch (*(bytecode_opcode_t *) pc) {
+	case BYTECODE_OP_LOAD_FIELD_REF:
+	case BYTECODE_OP_GET_CONTEXT_REF:
+	case BYTECODE_OP_LOAD_FIELD_REF_STRING:
+	case BYTECODE_OP_LOAD_FIELD_REF_SEQUENCE:
+	case BYTECODE_OP_LOAD_FIELD_REF_USER_STRING:
+	case BYTECODE_OP_LOAD_FIELD_REF_USER_SEQUENCE:
+	case BYTECODE_OP_LOAD_FIELD_REF_S64:
+	case BYTECODE_OP_GET_CONTEXT_REF_STRING:
+	case BYTECODE_OP_GET_CONTEXT_REF_S64:
+		return sizeof(struct load_op) + sizeof(struct field_ref);
+	case BYTECODE_OP_LOAD_STRING:
+	case BYTECODE_OP_LOAD_STAR_GLOB_STRING:
+		return sizeof(struct load_op)
+			+ strlen(((const struct load_op *) pc)->data) + 1;
+	case BYTECODE_OP_LOAD_S64:
+		return sizeof(struct load_op) + sizeof(struct literal_numeric);
+	case BYTECODE_OP_GET_SYMBOL:
+		return sizeof(struct load_op) + sizeof(struct get_symbol);
+	case BYTECODE_OP_GET_INDEX_U16:
+		return sizeof(struct load_op) + sizeof(struct get_index_u16);
+	case BYTECODE_OP_GET_INDEX_U64:
+		return sizeof(struct load_op) + sizeof(struct get_index_u64);
+	case BYTECODE_OP_AND:
+	case BYTECODE_OP_OR:
+		return sizeof(struct logical_op);
+	default:
+		/*
+		 * Return, binary, unary, cast and composed type traversal
+		 * instructions are a single opcode.
+		 */
+		return sizeof(bytecode_opcode_t);
+	}
+}
+
+static
+void emit(struct optimize_state *state, const void *insn, size_t len)
+{
+	state->out_insns[state->nr_out_insns++] = state->out_len;
+	memcpy(&state->out[state->out_len], insn, len);
+	state->out_len += len;
+}
+
+/*
+ * Get the value of the literal loaded by the output instruction @nr from the
+ * end, if it can be folded.
+ */
+static
+bool last_literal(const struct optimize_state *state, unsigned int nr,
+		int64_t *v)
+{
+	const struct load_op *insn;
+	unsigned int index;
+
+	if (state->nr_out_insns < nr + 1)
+		return false;
+	index = state->nr_out_insns - nr - 1;
+	if (index < state->barrier)
+		return false;
+	insn = (const struct load_op *) &state->out[state->out_insns[index]];
+	if (insn->op != BYTECODE_OP_LOAD_S64)
+		return false;
+	*v = ((const struct literal_numeric *) insn->data)->v;
+	return true;
+}
+
+/*
+ * Replace the last @nr output instructions, which are literals, by a literal
+ * holding @v.
+ */
+static
+void replace_literals(struct optimize_state *state, unsigned int nr, int64_t v)
+{
+	char buf[sizeof(struct load_op) + sizeof(struct literal_numeric)];
+	struct load_op *insn = (struct load_op *) buf;
+
+	state->nr_out_insns -= nr;
+	state->out_len = state->out_insns[state->nr_out_insns];
+	insn->op = BYTECODE_OP_LOAD_S64;
+	((struct literal_numeric *) insn->data)->v = v;
+	emit(state, buf, sizeof(buf));
+}
+
+static
+bool fold_unary(bytecode_opcode_t op, int64_t ax, int64_t *res)
+{
+	switch (op) {
+	case BYTECODE_OP_UNARY_PLUS:
+	case BYTECODE_OP_UNARY_PLUS_S64:
+	case BYTECODE_OP_CAST_TO_S64:
+		*res = ax;
+		return true;
+	case BYTECODE_OP_UNARY_MINUS:
+	case BYTECODE_OP_UNARY_MINUS_S64:
+		*res = -(uint64_t) ax;
+		return true;
+	case BYTECODE_OP_UNARY_NOT:
+	case BYTECODE_OP_UNARY_NOT_S64:
+		*res = !ax;
+		return true;
+	case BYTECODE_OP_UNARY_BIT_NOT:
+		*res = ~(uint64_t) ax;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Same results as the interpreter. Shifts out of range fail at runtime, so
+ * they are not folded.
+ */
+static
+bool fold_binary(bytecode_opcode_t op, int64_t bx, int64_t ax, int64_t *res)
+{
+	switch (op) {
+	case BYTECODE_OP_EQ:
+	case BYTECODE_OP_EQ_S64:
+		*res = (bx == ax);
+		return true;
+	case BYTECODE_OP_NE:
+	case BYTECODE_OP_NE_S64:
+		*res = (bx != ax);
+		return true;
+	case BYTECODE_OP_GT:
+	case BYTECODE_OP_GT_S64:
+		*res = (bx > ax);
+		return true;
+	case BYTECODE_OP_LT:
+	case BYTECODE_OP_LT_S64:
+		*res = (bx < ax);
+		return true;
+	case BYTECODE_OP_GE:
+	case BYTECODE_OP_GE_S64:
+		*res = (bx >= ax);
+		return true;
+	case BYTECODE_OP_LE:
+	case BYTECODE_OP_LE_S64:
+		*res = (bx <= ax);
+		return true;
+	case BYTECODE_OP_BIT_AND:
+		*res = (uint64_t) bx & (uint64_t) ax;
+		return true;
+	case BYTECODE_OP_BIT_OR:
+		*res = (uint64_t) bx | (uint64_t) ax;
+		return true;
+	case BYTECODE_OP_BIT_XOR:
+		*res = (uint64_t) bx ^ (uint64_t) ax;
+		return true;
+	case BYTECODE_OP_BIT_RSHIFT:
+		if (ax < 0 || ax >= 64)
+			return false;
+		*res = (uint64_t) bx >> (uint32_t) ax;
+		return true;
+	case BYTECODE_OP_BIT_LSHIFT:
+		if (ax < 0 || ax >= 64)
+			return false;
+		*res = (uint64_t) bx << (uint32_t) ax;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Optimize the code of @bytecode in place. On error, the code is left
+ * unchanged. Returns 0 on success, -EINVAL on invalid branch, -ENOMEM if
+ * out of memory.
+ *
+ * Only filters are optimized: folded literals are signed, while the
+ * interpreter types bitwise results as unsigned, which captures expose.
+ */
+int lttng_bytecode_optimize(struct bytecode_runtime *bytecode)
+{
+	struct optimize_state state = { .code = bytecode->code };
+	unsigned long *targets = NULL;
+	uint16_t *map = NULL, len = bytecode->len;
+	uint16_t pc, next_pc;
+	int ret = -ENOMEM;
+
+	if (bytecode->p.type != LTTNG_KERNEL_BYTECODE_TYPE_FILTER)
+		return 0;
+
+	state.out = kmalloc(len, GFP_KERNEL);
+	state.out_insns = kmalloc_array(len, sizeof(*state.out_insns), GFP_KERNEL);
+	map = kmalloc_array(len, sizeof(*map), GFP_KERNEL);
+	/*
+	 * Targets of the branches copied so far. Branches only go forward, so
+	 * all the branches to an instruction are known when reaching it.
+	 */
+	targets = kcalloc(BITS_TO_LONGS(len), sizeof(long), GFP_KERNEL);
+	if (!state.out || !state.out_insns || !map || !targets)
+		goto end;
+
+	for (pc = 0; pc < len; pc = next_pc) {
+		const char *insn = &state.code[pc];
+		bytecode_opcode_t op = *(bytecode_opcode_t *) insn;
+		int64_t ax, bx, res;
+
+		next_pc = pc + insn_len(insn);
+		map[pc] = state.out_len;
+		if (test_bit(pc, targets))
+			state.barrier = state.nr_out_insns;
+
+		switch (op) {
+		case BYTECODE_OP_CAST_NOP:
+			continue;
+		case BYTECODE_OP_AND:
+		case BYTECODE_OP_OR:
+		{
+			uint16_t skip_offset = ((const struct logical_op *) insn)->skip_offset;
+			bool taken;
+
+			if (skip_offset >= len) {
+				ret = -EINVAL;
+				goto end;
+			}
+			/* The skipped code must not be reachable otherwise. */
+			if (!last_literal(&state, 0, &ax)
+					|| find_next_bit(targets, skip_offset, pc + 1) < skip_offset)
+				break;
+			if (op == BYTECODE_OP_AND)
+				taken = (ax == 0);
+			else
+				taken = (ax != 0);
+			if (taken) {
+				/* Evaluates to the literal, or 1 for "||". */
+				if (op == BYTECODE_OP_OR)
+					replace_literals(&state, 1, 1);
+				next_pc = skip_offset;
+			} else {
+				/* Evaluates to its right operand. */
+				state.nr_out_insns--;
+				state.out_len = state.out_insns[state.nr_out_insns];
+			}
+			continue;
+		}
+		default:
+			if (last_literal(&state, 0, &ax) && fold_unary(op, ax, &res)) {
+				replace_literals(&state, 1, res);
+				continue;
+			}
+			if (last_literal(&state, 0, &ax) && last_literal(&state, 1, &bx)
+					&& fold_binary(op, bx, ax, &res)) {
+				replace_literals(&state, 2, res);
+				continue;
+			}
+			break;
+		}
+		if (op == BYTECODE_OP_AND || op == BYTECODE_OP_OR)
+			__set_bit(((const struct logical_op *) insn)->skip_offset, targets);
+		emit(&state, insn, next_pc - pc);
+		/* As the validator, ignore what follows the return. */
+		if (op == BYTECODE_OP_RETURN || op == BYTECODE_OP_RETURN_S64)
+			break;
+	}
+
+	/* Remap the branch targets. */
+	for (pc = 0; pc < state.out_len; pc += insn_len(&state.out[pc])) {
+		struct logical_op *insn = (struct logical_op *) &state.out[pc];
+
+		if (insn->op == BYTECODE_OP_AND || insn->op == BYTECODE_OP_OR)
+			insn->skip_offset = map[insn->skip_offset];
+	}
+	dbg_printk("Optimized bytecode from %u to %u bytes\n",
+		(unsigned int) len, (unsigned int) state.out_len);
+	memcpy(bytecode->code, state.out, state.out_len);
+	bytecode->len = state.out_len;
+	ret = 0;
+end:
+	kfree(targets);
+	kfree(map);
+	kfree(state.out_insns);
+	kfree(state.out);
+	return ret;
+}
+
+/*
+ * Whether an optimized filter always evaluates to true.
+ */
+bool lttng_bytecode_is_always_true(const struct bytecode_runtime *bytecode)
+{
+	const struct load_op *insn = (const struct load_op *) bytecode->code;
+
+	if (bytecode->p.type != LTTNG_KERNEL_BYTECODE_TYPE_FILTER)
+		return false;
+	if (bytecode->len != sizeof(struct load_op) + sizeof(struct literal_numeric)
+			+ sizeof(struct return_op))
+		return false;
+	return insn->op == BYTECODE_OP_LOAD_S64
+		&& ((const struct literal_numeric *) insn->data)->v != 0
+		&& *(bytecode_opcode_t *) &bytecode->code[bytecode->len - 1]
+			== BYTECODE_OP_RETURN;
+}
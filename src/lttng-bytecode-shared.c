@@ -0,0 +1,326 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-bytecode-shared.c
+ *
+ * LTTng modules shared filter bytecode.
+ *
+ * Sessions, counters and event notifiers enabling the same tracepoint with
+ * the same filter each link their own bytecode runtime, and each of their
+ * probes runs it on every hit. Runtimes linked from identical bytecode for
+ * the same event description are grouped by content hash. When the filter
+ * is a function of integer event fields only, the group keeps the last
+ * verdict of each CPU along with the values of those fields, so the
+ * subscribers called after the first one for a hit reuse its verdict
+ * instead of evaluating the filter again.
+ *
+ * Filters reading strings, sequences or contexts are still grouped but
+ * always evaluated: the probes of a tracepoint are called one after the
+ * other with nothing identifying the hit, and their verdict can change
+ * between hits with the same stack data.
+ */
+
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/preempt.h>
+
+#include <lttng/lttng-bytecode.h>
+#include <lttng/events-internal.h>
+#include <wrapper/list.h>
+#include <wrapper/limits.h>
+
+/* Protects the shared filter table and the reference counts. */
+static
+DEFINE_MUTEX(bytecode_shared_mutex);
+
+#define BYTECODE_SHARED_HASH_BITS 6
+#define BYTECODE_SHARED_TABLE_SIZE (1 << BYTECODE_SHARED_HASH_BITS)
+static
+struct hlist_head bytecode_shared_table[BYTECODE_SHARED_TABLE_SIZE];
+
+static
+int shared_add_field(struct bytecode_shared *shared, uint16_t offset)
+{
+	unsigned int i;
+
+	for (i = 0; i < shared->nr_fields; i++) {
+		if (shared->field_offsets[i] == offset)
+			return 0;
+	}
+	if (shared->nr_fields == BYTECODE_SHARED_MAX_FIELDS)
+		return -EINVAL;
+	shared->field_offsets[shared->nr_fields++] = offset;
+	return 0;
+}
+
+/*
+ * Find the event fields read by a specialized filter. Returns -EINVAL if the
+ * filter reads anything else than integer event fields, or too many of them.
+ */
+static
+int shared_find_fields(struct bytecode_shared *shared,
+		const struct bytecode_runtime *bytecode)
+{
+	const char *start_pc = bytecode->code;
+	uint16_t pc = 0, len = bytecode->len;
+
+	while (pc + sizeof(bytecode_opcode_t) <= len) {
+		const char *insn = &start_pc[pc];
+		int ret;
+
+		switch (*(bytecode_opcode_t *) insn) {
+		case BYTECODE_OP_RETURN:
+		case BYTECODE_OP_RETURN_S64:
+			return 0;
+
+		case BYTECODE_OP_LOAD_FIELD_REF_S64:
+		{
+			const struct field_ref *ref = (const struct field_ref *)
+				((const struct load_op *) insn)->data;
+
+			ret = shared_add_field(shared, ref->offset);
+			if (ret)
+				return ret;
+			pc += sizeof(struct load_op) + sizeof(struct field_ref);
+			break;
+		}
+		case BYTECODE_OP_CMP_FIELD_REF_S64_IMM:
+			ret = shared_add_field(shared, ((const struct cmp_imm_op *) insn)->index);
+			if (ret)
+				return ret;
+			pc += ((const struct cmp_imm_op *) insn)->len;
+			break;
+		case BYTECODE_OP_RANGE_FIELD_REF_S64:
+			ret = shared_add_field(shared, ((const struct range_op *) insn)->index);
+			if (ret)
+				return ret;
+			pc += ((const struct range_op *) insn)->len;
+			break;
+		case BYTECODE_OP_GET_PAYLOAD_ROOT:
+		{
+			const struct load_op *get_index;
+			const struct get_index_u16 *index;
+			const struct bytecode_get_index_data *gid;
+			uint16_t next_pc;
+
+			/* Only direct loads of integer fields. */
+			next_pc = pc + sizeof(struct load_op)
+				+ sizeof(struct load_op) + sizeof(struct get_index_u16);
+			if (next_pc + sizeof(bytecode_opcode_t) > len)
+				return -EINVAL;
+			get_index = (const struct load_op *) &start_pc[pc + sizeof(struct load_op)];
+			if (get_index->op != BYTECODE_OP_GET_INDEX_U16)
+				return -EINVAL;
+			switch (*(bytecode_opcode_t *) &start_pc[next_pc]) {
+			case BYTECODE_OP_LOAD_FIELD_S8:
+			case BYTECODE_OP_LOAD_FIELD_S16:
+			case BYTECODE_OP_LOAD_FIELD_S32:
+			case BYTECODE_OP_LOAD_FIELD_S64:
+			case BYTECODE_OP_LOAD_FIELD_U8:
+			case BYTECODE_OP_LOAD_FIELD_U16:
+			case BYTECODE_OP_LOAD_FIELD_U32:
+			case BYTECODE_OP_LOAD_FIELD_U64:
+				break;
+			default:
+				return -EINVAL;
+			}
+			index = (const struct get_index_u16 *) get_index->data;
+			gid = (const struct bytecode_get_index_data *) &bytecode->data[index->index];
+			if (gid->offset > U16_MAX)
+				return -EINVAL;
+			ret = shared_add_field(shared, gid->offset);
+			if (ret)
+				return ret;
+			pc = next_pc + sizeof(struct load_op);
+			break;
+		}
+
+		case BYTECODE_OP_LOAD_S64:
+			pc += sizeof(struct load_op) + sizeof(struct literal_numeric);
+			break;
+		case BYTECODE_OP_AND:
+		case BYTECODE_OP_OR:
+			pc += sizeof(struct logical_op);
+			break;
+
+		case BYTECODE_OP_EQ_S64:
+		case BYTECODE_OP_NE_S64:
+		case BYTECODE_OP_GT_S64:
+		case BYTECODE_OP_LT_S64:
+		case BYTECODE_OP_GE_S64:
+		case BYTECODE_OP_LE_S64:
+		case BYTECODE_OP_BIT_RSHIFT:
+		case BYTECODE_OP_BIT_LSHIFT:
+		case BYTECODE_OP_BIT_AND:
+		case BYTECODE_OP_BIT_OR:
+		case BYTECODE_OP_BIT_XOR:
+		case BYTECODE_OP_UNARY_PLUS_S64:
+		case BYTECODE_OP_UNARY_MINUS_S64:
+		case BYTECODE_OP_UNARY_NOT_S64:
+		case BYTECODE_OP_UNARY_BIT_NOT:
+		case BYTECODE_OP_CAST_TO_S64:
+		case BYTECODE_OP_CAST_NOP:
+			pc += sizeof(bytecode_opcode_t);
+			break;
+
+		default:
+			return -EINVAL;
+		}
+	}
+	return -EINVAL;
+}
+
+static
+struct bytecode_shared *shared_create(const struct lttng_kernel_event_desc *event_desc,
+		const struct bytecode_runtime *bytecode)
+{
+	const struct lttng_kernel_bytecode_node *bc = bytecode->p.bc;
+	struct bytecode_shared *shared;
+
+	shared = kzalloc(sizeof(*shared) + bc->bc.len, GFP_KERNEL);
+	if (!shared)
+		return NULL;
+	shared->event_desc = event_desc;
+	shared->len = bc->bc.len;
+	shared->reloc_offset = bc->bc.reloc_offset;
+	memcpy(shared->data, bc->bc.data, bc->bc.len);
+	if (!shared_find_fields(shared, bytecode)) {
+		/* Without memory for the verdicts, the filter is only grouped. */
+		shared->verdict = alloc_percpu(struct bytecode_shared_verdict);
+		shared->memoize = !!shared->verdict;
+	}
+	dbg_printk("Shared filter reading %u fields, memoize: %d\n",
+		shared->nr_fields, shared->memoize);
+	return shared;
+}
+
+/*
+ * Attach a linked filter to the filters linked from identical bytecode for
+ * the same event description, creating the group if needed. Returns 0 on
+ * success, -EINVAL if the bytecode is not a filter, -ENOMEM if out of
+ * memory.
+ */
+int lttng_bytecode_share(const struct lttng_kernel_event_desc *event_desc,
+		struct bytecode_runtime *bytecode)
+{
+	const struct lttng_kernel_bytecode_node *bc = bytecode->p.bc;
+	struct bytecode_shared *shared;
+	struct hlist_head *head;
+	u32 hash;
+	int ret = 0;
+
+	if (bytecode->p.type != LTTNG_KERNEL_BYTECODE_TYPE_FILTER)
+		return -EINVAL;
+	hash = jhash(bc->bc.data, bc->bc.len, jhash(&event_desc, sizeof(event_desc), 0));
+	head = &bytecode_shared_table[hash & (BYTECODE_SHARED_TABLE_SIZE - 1)];
+
+	mutex_lock(&bytecode_shared_mutex);
+	lttng_hlist_for_each_entry(shared, head, hlist) {
+		if (shared->event_desc == event_desc
+				&& shared->len == bc->bc.len
+				&& shared->reloc_offset == bc->bc.reloc_offset
+				&& !memcmp(shared->data, bc->bc.data, bc->bc.len))
+			goto found;
+	}
+	shared = shared_create(event_desc, bytecode);
+	if (!shared) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	hlist_add_head(&shared->hlist, head);
+found:
+	shared->refcount++;
+	bytecode->shared = shared;
+end:
+	mutex_unlock(&bytecode_shared_mutex);
+	return ret;
+}
+
+/*
+ * Detach a filter from its group. The caller guarantees that no probe
+ * still runs the filter.
+ */
+void lttng_bytecode_unshare(struct bytecode_runtime *bytecode)
+{
+	struct bytecode_shared *shared = bytecode->shared;
+
+	if (!shared)
+		return;
+	mutex_lock(&bytecode_shared_mutex);
+	if (!--shared->refcount) {
+		hlist_del(&shared->hlist);
+		free_percpu(shared->verdict);
+		kfree(shared);
+	}
+	mutex_unlock(&bytecode_shared_mutex);
+	bytecode->shared = NULL;
+}
+
+/*
+ * Evaluate a shared filter which only reads integer event fields, reusing
+ * the last verdict of the CPU when the fields hold the same values. Same
+ * calling convention as lttng_bytecode_interpret(), for FILTER bytecode
+ * only.
+ */
+int lttng_bytecode_interpret_shared(struct lttng_kernel_bytecode_runtime *kernel_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_kernel_probe_ctx *lttng_probe_ctx,
+		void *caller_ctx)
+{
+	struct bytecode_runtime *bytecode = container_of(kernel_bytecode, struct bytecode_runtime, p);
+	const struct bytecode_shared *shared = bytecode->shared;
+	struct lttng_kernel_bytecode_filter_ctx *filter_ctx =
+		(struct lttng_kernel_bytecode_filter_ctx *) caller_ctx;
+	struct bytecode_shared_verdict *verdict;
+	int64_t fields[BYTECODE_SHARED_MAX_FIELDS];
+	unsigned int i, seq;
+	int ret, result;
+
+	for (i = 0; i < shared->nr_fields; i++)
+		fields[i] = ((const struct literal_numeric *)
+			&interpreter_stack_data[shared->field_offsets[i]])->v;
+
+	/*
+	 * The verdict of the CPU is only updated by probes running on it,
+	 * which can nest on interrupts: the sequence count detects readers
+	 * interrupted by an update, and updates are not started while
+	 * another one is in progress.
+	 */
+	preempt_disable_notrace();
+	verdict = this_cpu_ptr(shared->verdict);
+	seq = READ_ONCE(verdict->seq);
+	if (seq && !(seq & 1)) {
+		barrier();
+		result = verdict->result;
+		if (!memcmp(verdict->fields, fields, shared->nr_fields * sizeof(fields[0]))) {
+			barrier();
+			if (READ_ONCE(verdict->seq) == seq) {
+				filter_ctx->result = result;
+				ret = LTTNG_KERNEL_BYTECODE_INTERPRETER_OK;
+				goto end;
+			}
+		}
+	}
+
+	if (bytecode->pred)
+		ret = lttng_bytecode_interpret_pred(kernel_bytecode, interpreter_stack_data,
+				lttng_probe_ctx, caller_ctx);
+	else
+		ret = lttng_bytecode_interpret(kernel_bytecode, interpreter_stack_data,
+				lttng_probe_ctx, caller_ctx);
+	if (ret != LTTNG_KERNEL_BYTECODE_INTERPRETER_OK)
+		goto end;
+	seq = READ_ONCE(verdict->seq);
+	if (seq & 1)
+		goto end;
+	WRITE_ONCE(verdict->seq, seq + 1);
+	barrier();
+	verdict->result = filter_ctx->result;
+	memcpy(verdict->fields, fields, shared->nr_fields * sizeof(fields[0]));
+	barrier();
+	WRITE_ONCE(verdict->seq, seq + 2);
+end:
+	preempt_enable_notrace();
+	return ret;
+}
@@ -8,7 +8,9 @@
  */
 
 #include <linux/slab.h>
+#include <linux/bitops.h>
 #include <wrapper/compiler_attributes.h>
+#include <wrapper/limits.h>
 
 #include <lttng/lttng-bytecode.h>
 #include <lttng/align.h>
@@ -473,6 +475,80 @@ static int specialize_context_lookup(struct lttng_kernel_ctx *ctx,
 	return 0;
 }
 
+/*
+ * Compile a star globbing pattern into its segments, and rewrite its load
+ * instruction to load the compiled pattern. Patterns with consecutive stars
+ * or ending with an escape character, which the generic matcher handles
+ * specially, are left to it.
+ */
+static int specialize_star_glob(struct bytecode_runtime *runtime,
+		struct load_op *insn)
+{
+	const char *pattern = insn->data;
+	size_t pattern_len = strlen(pattern), text_len = 0, size, i;
+	unsigned int nr_segments = 1, segment = 0;
+	struct bytecode_star_glob *glob;
+	ssize_t data_offset;
+	char *text;
+
+	/* The compiled load must fit within the original one. */
+	if (pattern_len + 1 < sizeof(struct get_index_u16))
+		return -EINVAL;
+	for (i = 0; i < pattern_len; i++) {
+		switch (pattern[i]) {
+		case '*':
+			if (pattern[i + 1] == '*')
+				return -EINVAL;
+			nr_segments++;
+			break;
+		case '\\':
+			if (pattern[++i] == '\0')
+				return -EINVAL;
+			text_len++;
+			break;
+		default:
+			text_len++;
+			break;
+		}
+	}
+	size = sizeof(*glob) + nr_segments * sizeof(glob->segments[0])
+		+ text_len + pattern_len + 1;
+	if (size > U16_MAX)
+		return -EINVAL;
+	glob = kzalloc(size, GFP_KERNEL);
+	if (!glob)
+		return -ENOMEM;
+	glob->insn_len = sizeof(struct load_op) + pattern_len + 1;
+	glob->pattern_offset = size - pattern_len - 1;
+	glob->nr_segments = nr_segments;
+	memcpy((char *) glob + glob->pattern_offset, pattern, pattern_len + 1);
+	text = (char *) &glob->segments[nr_segments];
+	glob->segments[0].offset = text - (char *) glob;
+	for (i = 0; i < pattern_len; i++) {
+		switch (pattern[i]) {
+		case '*':
+			segment++;
+			glob->segments[segment].offset = text - (char *) glob;
+			break;
+		case '\\':
+			i++;
+			lttng_fallthrough;
+		default:
+			*text++ = pattern[i];
+			glob->segments[segment].len++;
+			break;
+		}
+	}
+	data_offset = bytecode_push_data(runtime, glob,
+		__alignof__(*glob), size);
+	kfree(glob);
+	if (data_offset < 0)
+		return data_offset;
+	insn->op = BYTECODE_OP_LOAD_STAR_GLOB_COMPILED;
+	((struct get_index_u16 *) insn->data)->index = data_offset;
+	return 0;
+}
+
 static int specialize_payload_lookup(const struct lttng_kernel_event_desc *event_desc,
 		struct bytecode_runtime *runtime,
 		struct load_op *insn,
@@ -480,7 +556,7 @@ static int specialize_payload_lookup(const struct lttng_kernel_event_desc *event
 {
 	const char *name;
 	uint16_t offset;
-	unsigned int i, nr_fields;
+	unsigned int i, nr_fields, field_idx = 0;
 	bool found = false;
 	uint32_t field_offset = 0;
 	const struct lttng_kernel_event_field *field;
@@ -500,6 +576,7 @@ static int specialize_payload_lookup(const struct lttng_kernel_event_desc *event
 			found = true;
 			break;
 		}
+		field_idx++;
 		/* compute field offset on stack */
 		switch (field->type->type) {
 		case lttng_kernel_type_integer:
@@ -543,11 +620,253 @@ static int specialize_payload_lookup(const struct lttng_kernel_event_desc *event
 		goto end;
 	}
 	((struct get_index_u16 *) insn->data)->index = data_offset;
+	runtime->p.fields |= LTTNG_KERNEL_FILTER_FIELD(field_idx);
 	ret = 0;
 end:
 	return ret;
 }
 
+/* Integer operand of a fusable comparison. */
+struct fuse_operand {
+	enum {
+		FUSE_OPERAND_IMM,
+		FUSE_OPERAND_FIELD_REF,
+		FUSE_OPERAND_CONTEXT_REF,
+	} type;
+	uint16_t index;		/* field offset or context index */
+	int64_t imm;
+};
+
+/*
+ * Match the integer operand loaded by the instructions starting at
+ * insns[i]. Returns the number of instructions loading it, 0 if there is
+ * no match.
+ */
+static
+unsigned int fuse_match_load(struct bytecode_runtime *bytecode,
+		const uint16_t *insns, unsigned int nr_insns, unsigned int i,
+		struct fuse_operand *operand)
+{
+	char *start_pc = &bytecode->code[0];
+	struct load_op *insn = (struct load_op *) &start_pc[insns[i]];
+
+	switch (insn->op) {
+	case BYTECODE_OP_LOAD_S64:
+		operand->type = FUSE_OPERAND_IMM;
+		operand->imm = ((struct literal_numeric *) insn->data)->v;
+		return 1;
+	case BYTECODE_OP_LOAD_FIELD_REF_S64:
+		operand->type = FUSE_OPERAND_FIELD_REF;
+		operand->index = ((struct field_ref *) insn->data)->offset;
+		return 1;
+	case BYTECODE_OP_GET_CONTEXT_REF_S64:
+		operand->type = FUSE_OPERAND_CONTEXT_REF;
+		operand->index = ((struct field_ref *) insn->data)->offset;
+		return 1;
+	case BYTECODE_OP_GET_CONTEXT_ROOT:
+	{
+		const struct bytecode_get_index_data *gid;
+		struct load_op *get_index, *load;
+
+		/* Integer context lookup: skip context_get_index(). */
+		if (i + 2 >= nr_insns)
+			return 0;
+		get_index = (struct load_op *) &start_pc[insns[i + 1]];
+		load = (struct load_op *) &start_pc[insns[i + 2]];
+		if (get_index->op != BYTECODE_OP_GET_INDEX_U16
+				|| (load->op != BYTECODE_OP_LOAD_FIELD_S64
+					&& load->op != BYTECODE_OP_LOAD_FIELD_U64))
+			return 0;
+		gid = (const struct bytecode_get_index_data *)
+			&bytecode->data[((struct get_index_u16 *) get_index->data)->index];
+		switch (gid->elem.type) {
+		case OBJECT_TYPE_S64:
+		case OBJECT_TYPE_U64:
+		case OBJECT_TYPE_SIGNED_ENUM:
+		case OBJECT_TYPE_UNSIGNED_ENUM:
+			break;
+		default:
+			return 0;
+		}
+		if (gid->ctx_index > U16_MAX)
+			return 0;
+		operand->type = FUSE_OPERAND_CONTEXT_REF;
+		operand->index = gid->ctx_index;
+		return 3;
+	}
+	default:
+		return 0;
+	}
+}
+
+/* Same as fuse_match_load(), also covering the casts which became no-ops. */
+static
+unsigned int fuse_match_operand(struct bytecode_runtime *bytecode,
+		const uint16_t *insns, unsigned int nr_insns, unsigned int i,
+		struct fuse_operand *operand)
+{
+	unsigned int nr;
+
+	nr = fuse_match_load(bytecode, insns, nr_insns, i, operand);
+	if (!nr)
+		return 0;
+	while (i + nr < nr_insns
+			&& *(bytecode_opcode_t *) &bytecode->code[insns[i + nr]]
+				== BYTECODE_OP_CAST_NOP)
+		nr++;
+	return nr;
+}
+
+static
+unsigned int fuse_cmp_accept(bytecode_opcode_t op)
+{
+	switch (op) {
+	case BYTECODE_OP_EQ_S64:
+		return BYTECODE_CMP_EQ;
+	case BYTECODE_OP_NE_S64:
+		return BYTECODE_CMP_LT | BYTECODE_CMP_GT;
+	case BYTECODE_OP_GT_S64:
+		return BYTECODE_CMP_GT;
+	case BYTECODE_OP_LT_S64:
+		return BYTECODE_CMP_LT;
+	case BYTECODE_OP_GE_S64:
+		return BYTECODE_CMP_GT | BYTECODE_CMP_EQ;
+	case BYTECODE_OP_LE_S64:
+		return BYTECODE_CMP_LT | BYTECODE_CMP_EQ;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Instructions can only be fused if no branch lands within them.
+ */
+static
+bool fuse_span_ok(const unsigned long *targets, uint16_t start, uint16_t end,
+		size_t fused_len)
+{
+	if (end - start < fused_len || end - start > U8_MAX)
+		return false;
+	return find_next_bit(targets, end, start + 1) >= end;
+}
+
+/*
+ * Fuse "operand operand comparator" sequences comparing an integer field
+ * against a constant into a cmp_imm_op, then "cmp && cmp" on the same field
+ * into a range_op. @insns holds the offsets of the @nr_insns instructions
+ * of the specialized bytecode, up to its return instruction included, and
+ * is updated as instructions are fused.
+ */
+static
+void specialize_fuse(struct bytecode_runtime *bytecode, uint16_t *insns,
+		unsigned int nr_insns)
+{
+	char *start_pc = &bytecode->code[0];
+	unsigned long *targets;
+	unsigned int i, nr;
+
+	targets = kcalloc(BITS_TO_LONGS(bytecode->len + 1), sizeof(long), GFP_KERNEL);
+	if (!targets)
+		return;
+	for (i = 0; i < nr_insns; i++) {
+		struct logical_op *insn = (struct logical_op *) &start_pc[insns[i]];
+
+		if (insn->op == BYTECODE_OP_AND || insn->op == BYTECODE_OP_OR)
+			__set_bit(insn->skip_offset, targets);
+	}
+
+	/* Comparisons against an immediate. */
+	for (i = 0, nr = 0; i < nr_insns; nr++) {
+		struct fuse_operand bx, ax;
+		struct cmp_imm_op fused;
+		unsigned int nr_bx, nr_ax, accept;
+		uint16_t start = insns[i];
+
+		insns[nr] = start;
+		nr_bx = fuse_match_operand(bytecode, insns, nr_insns, i, &bx);
+		if (!nr_bx || i + nr_bx >= nr_insns)
+			goto next;
+		nr_ax = fuse_match_operand(bytecode, insns, nr_insns, i + nr_bx, &ax);
+		/* The comparator is followed by at least the return. */
+		if (!nr_ax || i + nr_bx + nr_ax + 1 >= nr_insns)
+			goto next;
+		accept = fuse_cmp_accept(*(bytecode_opcode_t *)
+				&start_pc[insns[i + nr_bx + nr_ax]]);
+		if (!accept)
+			goto next;
+		if (bx.type != FUSE_OPERAND_IMM && ax.type == FUSE_OPERAND_IMM) {
+			fused.index = bx.index;
+			fused.imm = ax.imm;
+			fused.op = bx.type == FUSE_OPERAND_FIELD_REF ?
+				BYTECODE_OP_CMP_FIELD_REF_S64_IMM :
+				BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM;
+		} else if (bx.type == FUSE_OPERAND_IMM && ax.type != FUSE_OPERAND_IMM) {
+			/* Constant on the left: mirror the comparison. */
+			fused.index = ax.index;
+			fused.imm = bx.imm;
+			fused.op = ax.type == FUSE_OPERAND_FIELD_REF ?
+				BYTECODE_OP_CMP_FIELD_REF_S64_IMM :
+				BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM;
+			accept = (accept & BYTECODE_CMP_EQ)
+				| ((accept & BYTECODE_CMP_LT) ? BYTECODE_CMP_GT : 0)
+				| ((accept & BYTECODE_CMP_GT) ? BYTECODE_CMP_LT : 0);
+		} else {
+			goto next;
+		}
+		if (!fuse_span_ok(targets, start, insns[i + nr_bx + nr_ax + 1],
+				sizeof(fused)))
+			goto next;
+		fused.len = insns[i + nr_bx + nr_ax + 1] - start;
+		fused.accept = accept;
+		memcpy(&start_pc[start], &fused, sizeof(fused));
+		dbg_printk("Fused %u instructions at offset %u\n",
+			nr_bx + nr_ax + 1, (unsigned int) start);
+		i += nr_bx + nr_ax + 1;
+		continue;
+	next:
+		i++;
+	}
+	nr_insns = nr;
+
+	/* Range checks: "cmp && cmp" on the same field. */
+	for (i = 0, nr = 0; i < nr_insns; nr++) {
+		struct cmp_imm_op *lo, *hi;
+		struct logical_op *and;
+		struct range_op fused;
+		uint16_t start = insns[i];
+
+		insns[nr] = start;
+		if (i + 3 >= nr_insns)
+			goto next_range;
+		lo = (struct cmp_imm_op *) &start_pc[start];
+		and = (struct logical_op *) &start_pc[insns[i + 1]];
+		hi = (struct cmp_imm_op *) &start_pc[insns[i + 2]];
+		if ((lo->op != BYTECODE_OP_CMP_FIELD_REF_S64_IMM
+				&& lo->op != BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM)
+				|| and->op != BYTECODE_OP_AND
+				|| and->skip_offset != insns[i + 3]
+				|| hi->op != lo->op || hi->index != lo->index)
+			goto next_range;
+		if (!fuse_span_ok(targets, start, insns[i + 3], sizeof(fused)))
+			goto next_range;
+		fused.op = lo->op == BYTECODE_OP_CMP_FIELD_REF_S64_IMM ?
+			BYTECODE_OP_RANGE_FIELD_REF_S64 :
+			BYTECODE_OP_RANGE_CONTEXT_REF_S64;
+		fused.len = insns[i + 3] - start;
+		fused.index = lo->index;
+		fused.accept[0] = lo->accept;
+		fused.imm[0] = lo->imm;
+		fused.accept[1] = hi->accept;
+		fused.imm[1] = hi->imm;
+		memcpy(&start_pc[start], &fused, sizeof(fused));
+		i += 3;
+		continue;
+	next_range:
+		i++;
+	}
+	kfree(targets);
+}
+
 int lttng_bytecode_specialize(const struct lttng_kernel_event_desc *event_desc,
 		struct bytecode_runtime *bytecode)
 {
@@ -556,12 +875,19 @@ int lttng_bytecode_specialize(const struct lttng_kernel_event_desc *event_desc,
 	struct vstack _stack;
 	struct vstack *stack = &_stack;
 	struct lttng_kernel_ctx *ctx = bytecode->p.ctx;
+	uint16_t *insns;
+	unsigned int nr_insns = 0;
 
 	vstack_init(stack);
 
+	/* Instruction offsets, for fusion. Fusion is skipped if NULL. */
+	insns = kmalloc_array(bytecode->len, sizeof(*insns), GFP_KERNEL);
+
 	start_pc = &bytecode->code[0];
 	for (pc = next_pc = start_pc; pc - start_pc < bytecode->len;
 			pc = next_pc) {
+		if (insns)
+			insns[nr_insns++] = pc - start_pc;
 		switch (*(bytecode_opcode_t *) pc) {
 		case BYTECODE_OP_UNKNOWN:
 		default:
@@ -1040,13 +1366,16 @@ int lttng_bytecode_specialize(const struct lttng_kernel_event_desc *event_desc,
 		case BYTECODE_OP_LOAD_STAR_GLOB_STRING:
 		{
 			struct load_op *insn = (struct load_op *) pc;
+			size_t insn_len = sizeof(struct load_op) + strlen(insn->data) + 1;
 
 			if (vstack_push(stack)) {
 				ret = -EINVAL;
 				goto end;
 			}
 			vstack_ax(stack)->type = REG_STAR_GLOB_STRING;
-			next_pc += sizeof(struct load_op) + strlen(insn->data) + 1;
+			/* Keep the generic matcher if the pattern cannot be compiled. */
+			(void) specialize_star_glob(bytecode, insn);
+			next_pc += insn_len;
 			break;
 		}
 
@@ -1271,5 +1600,8 @@ int lttng_bytecode_specialize(const struct lttng_kernel_event_desc *event_desc,
 		}
 	}
 end:
+	if (!ret && insns)
+		specialize_fuse(bytecode, insns, nr_insns);
+	kfree(insns);
 	return ret;
 }
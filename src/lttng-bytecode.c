@@ -157,6 +157,12 @@ static const char *opnames[] = {
 	[ BYTECODE_OP_UNARY_BIT_NOT ] = "UNARY_BIT_NOT",
 
 	[ BYTECODE_OP_RETURN_S64 ] = "RETURN_S64",
+
+	[ BYTECODE_OP_CMP_FIELD_REF_S64_IMM ] = "CMP_FIELD_REF_S64_IMM",
+	[ BYTECODE_OP_CMP_CONTEXT_REF_S64_IMM ] = "CMP_CONTEXT_REF_S64_IMM",
+	[ BYTECODE_OP_RANGE_FIELD_REF_S64 ] = "RANGE_FIELD_REF_S64",
+	[ BYTECODE_OP_RANGE_CONTEXT_REF_S64 ] = "RANGE_CONTEXT_REF_S64",
+	[ BYTECODE_OP_LOAD_STAR_GLOB_COMPILED ] = "LOAD_STAR_GLOB_COMPILED",
 };
 
 const char *lttng_bytecode_print_op(enum bytecode_op op)
@@ -176,7 +182,7 @@ int apply_field_reloc(const struct lttng_kernel_event_desc *event_desc,
 		enum bytecode_op bytecode_op)
 {
 	const struct lttng_kernel_event_field * const *fields, *field = NULL;
-	unsigned int nr_fields, i;
+	unsigned int nr_fields, i, field_idx = 0;
 	struct load_op *op;
 	uint32_t field_offset = 0;
 
@@ -196,6 +202,7 @@ int apply_field_reloc(const struct lttng_kernel_event_desc *event_desc,
 			field = fields[i];
 			break;
 		}
+		field_idx++;
 		/* compute field offset */
 		switch (fields[i]->type->type) {
 		case lttng_kernel_type_integer:
@@ -291,6 +298,7 @@ int apply_field_reloc(const struct lttng_kernel_event_desc *event_desc,
 		}
 		/* set offset */
 		field_ref->offset = (uint16_t) field_offset;
+		runtime->p.fields |= LTTNG_KERNEL_FILTER_FIELD(field_idx);
 		break;
 	}
 	default:
@@ -436,6 +444,17 @@ int bytecode_is_linked(struct lttng_kernel_bytecode_node *bytecode,
 	return 0;
 }
 
+static
+void bytecode_runtime_set_interpreter(struct bytecode_runtime *runtime)
+{
+	if (runtime->shared && runtime->shared->memoize)
+		runtime->p.interpreter_func = lttng_bytecode_interpret_shared;
+	else if (runtime->pred)
+		runtime->p.interpreter_func = lttng_bytecode_interpret_pred;
+	else
+		runtime->p.interpreter_func = lttng_bytecode_interpret;
+}
+
 /*
  * Take a bytecode with reloc table and link it to an event to create a
  * bytecode runtime.
@@ -500,12 +519,20 @@ int link_bytecode(const struct lttng_kernel_event_desc *event_desc,
 	if (ret) {
 		goto link_error;
 	}
+	/* Fold constants and dead branches, keeping the bytecode on error. */
+	(void) lttng_bytecode_optimize(runtime);
+	runtime->p.always_true = lttng_bytecode_is_always_true(runtime);
 	/* Specialize bytecode */
 	ret = lttng_bytecode_specialize(event_desc, runtime);
 	if (ret) {
 		goto link_error;
 	}
-	runtime->p.interpreter_func = lttng_bytecode_interpret;
+	/* Compile simple filters, others stay interpreted. */
+	(void) lttng_bytecode_compile(runtime);
+	/* Share the verdicts with identical filters of the tracepoint. */
+	if (!runtime->p.always_true)
+		(void) lttng_bytecode_share(event_desc, runtime);
+	bytecode_runtime_set_interpreter(runtime);
 	runtime->p.link_failed = 0;
 	list_add_rcu(&runtime->p.node, insert_loc);
 	dbg_printk("Linking successful.\n");
@@ -528,7 +555,8 @@ void lttng_bytecode_sync_state(struct lttng_kernel_bytecode_runtime *runtime)
 	if (!bc->enabler->enabled || runtime->link_failed)
 		runtime->interpreter_func = lttng_bytecode_interpret_error;
 	else
-		runtime->interpreter_func = lttng_bytecode_interpret;
+		bytecode_runtime_set_interpreter(container_of(runtime,
+				struct bytecode_runtime, p));
 }
 
 /*
@@ -602,7 +630,9 @@ void lttng_free_event_filter_runtime(struct lttng_kernel_event_common *event)
 
 	list_for_each_entry_safe(runtime, tmp,
 			&event->priv->filter_bytecode_runtime_head, p.node) {
+		lttng_bytecode_unshare(runtime);
 		kfree(runtime->data);
+		kfree(runtime->pred);
 		kfree(runtime);
 	}
 }
@@ -14,6 +14,7 @@
 #include <lttng/event-notifier-notification.h>
 #include <lttng/events-internal.h>
 #include <lttng/probe-user.h>
+#include <ringbuffer/frontend.h>
 
 /*
  * The capture buffer size needs to be below 1024 bytes to avoid the
@@ -459,7 +460,13 @@ void notification_send(struct lttng_event_notifier_notification *notif,
 			capture_buffer_content_len, 1);
 
 	event_notifier_group->ops->event_commit(&ctx);
-	irq_work_queue(&event_notifier_group->wakeup_pending);
+	/*
+	 * Below the wakeup watermark, the group wakeup timer bounds the
+	 * latency of the notification.
+	 */
+	if (lib_ring_buffer_wakeup_watermark_due(&event_notifier_group->chan->backend.config,
+						 event_notifier_group->buf))
+		irq_work_queue(&event_notifier_group->wakeup_pending);
 }
 
 /*
@@ -26,6 +26,7 @@
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
 #include <linux/dmi.h>
+#include <linux/sort.h>
 
 #include <wrapper/compiler_attributes.h>
 #include <wrapper/uuid.h>
@@ -323,7 +324,7 @@ struct lttng_event_notifier_group *lttng_event_notifier_group_create(void)
 	event_notifier_group->chan = transport->ops.priv->channel_create(
 			transport_name, event_notifier_group, NULL,
 			subbuf_size, num_subbuf, switch_timer_interval,
-			read_timer_interval);
+			read_timer_interval, 0);
 	if (!event_notifier_group->chan)
 		goto create_error;
 
@@ -425,6 +426,7 @@ void lttng_event_notifier_group_destroy(
 	/* Wait for in-flight event notifier to complete */
 	synchronize_trace();
 
+	del_timer_sync(&event_notifier_group->wakeup_timer);
 	irq_work_sync(&event_notifier_group->wakeup_pending);
 
 	ret = lttng_syscalls_destroy_syscall_table(&event_notifier_group->syscall_table);
@@ -459,6 +461,78 @@ int lttng_session_statedump(struct lttng_kernel_session *session)
 	return ret;
 }
 
+static
+int lttng_event_recorder_priority_cmp(const void *a, const void *b)
+{
+	const struct lttng_kernel_event_recorder *ea =
+		*(const struct lttng_kernel_event_recorder * const *) a;
+	const struct lttng_kernel_event_recorder *eb =
+		*(const struct lttng_kernel_event_recorder * const *) b;
+
+	/* Decreasing priority, then creation order. */
+	if (ea->priv->priority != eb->priv->priority)
+		return ea->priv->priority > eb->priv->priority ? -1 : 1;
+	if (ea->priv->parent.id != eb->priv->parent.id)
+		return ea->priv->parent.id < eb->priv->parent.id ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Hand out the channel event IDs by decreasing event priority so the
+ * events flagged as most frequent get the IDs which fit the compact event
+ * header. Only done before the channel metadata is first dumped, when no
+ * event has been recorded yet. Channels without prioritized event keep
+ * their creation order. Returns the number of prioritized events.
+ * Should be called with sessions mutex held.
+ */
+static
+unsigned int lttng_channel_rank_event_ids(struct lttng_kernel_session *session,
+		struct lttng_kernel_channel_buffer_private *chan_buf_priv)
+{
+	struct lttng_kernel_event_recorder **events;
+	struct lttng_kernel_event_common_private *event_priv;
+	unsigned int nr_events = 0, nr_ranked = 0, i;
+
+	if (WARN_ON_ONCE(chan_buf_priv->metadata_dumped))
+		return 0;
+	list_for_each_entry(event_priv, &session->priv->events_head, node) {
+		struct lttng_kernel_event_recorder *event_recorder;
+
+		if (event_priv->pub->type != LTTNG_KERNEL_EVENT_TYPE_RECORDER)
+			continue;
+		event_recorder = container_of(event_priv->pub, struct lttng_kernel_event_recorder, parent);
+		if (event_recorder->chan != chan_buf_priv->pub)
+			continue;
+		nr_events++;
+		if (event_recorder->priv->priority)
+			nr_ranked++;
+	}
+	if (!nr_ranked)
+		return 0;
+
+	/* Keep creation order if we cannot allocate the ranking table. */
+	events = lttng_kvmalloc(nr_events * sizeof(*events), GFP_KERNEL);
+	if (!events)
+		return 0;
+	i = 0;
+	list_for_each_entry(event_priv, &session->priv->events_head, node) {
+		struct lttng_kernel_event_recorder *event_recorder;
+
+		if (event_priv->pub->type != LTTNG_KERNEL_EVENT_TYPE_RECORDER)
+			continue;
+		event_recorder = container_of(event_priv->pub, struct lttng_kernel_event_recorder, parent);
+		if (event_recorder->chan != chan_buf_priv->pub)
+			continue;
+		events[i++] = event_recorder;
+	}
+	sort(events, nr_events, sizeof(*events), lttng_event_recorder_priority_cmp, NULL);
+	for (i = 0; i < nr_events; i++)
+		events[i]->priv->parent.id = i;
+	chan_buf_priv->free_event_id = nr_events;
+	lttng_kvfree(events);
+	return nr_ranked;
+}
+
 int lttng_session_enable(struct lttng_kernel_session *session)
 {
 	int ret = 0;
@@ -482,13 +556,18 @@ int lttng_session_enable(struct lttng_kernel_session *session)
 	 */
 	list_for_each_entry(chan_priv, &session->priv->chan_head, node) {
 		struct lttng_kernel_channel_buffer_private *chan_buf_priv;
+		unsigned int nr_ranked;
 
 		if (chan_priv->pub->type != LTTNG_KERNEL_CHANNEL_TYPE_BUFFER)
 			continue;
 		chan_buf_priv = container_of(chan_priv, struct lttng_kernel_channel_buffer_private, parent);
 		if (chan_buf_priv->header_type)
 			continue;			/* don't change it if session stop/restart */
-		if (chan_buf_priv->free_event_id < 31)
+		nr_ranked = lttng_channel_rank_event_ids(session, chan_buf_priv);
+		if (chan_buf_priv->tiny_header)
+			chan_buf_priv->header_type = 3;	/* tiny */
+		else if (chan_buf_priv->free_event_id < 31
+		    || (nr_ranked && nr_ranked <= 31))
 			chan_buf_priv->header_type = 1;	/* compact */
 		else
 			chan_buf_priv->header_type = 2;	/* large */
@@ -777,6 +856,7 @@ struct lttng_kernel_channel_buffer *lttng_channel_buffer_create(struct lttng_ker
 				       size_t subbuf_size, size_t num_subbuf,
 				       unsigned int switch_timer_interval,
 				       unsigned int read_timer_interval,
+				       unsigned int flags,
 				       enum channel_type channel_type)
 {
 	struct lttng_kernel_channel_buffer *chan;
@@ -808,7 +888,7 @@ struct lttng_kernel_channel_buffer *lttng_channel_buffer_create(struct lttng_ker
 	 */
 	chan->priv->rb_chan = transport->ops.priv->channel_create(transport_name,
 			chan, buf_addr, subbuf_size, num_subbuf,
-			switch_timer_interval, read_timer_interval);
+			switch_timer_interval, read_timer_interval, flags);
 	if (!chan->priv->rb_chan)
 		goto create_error;
 	chan->priv->parent.tstate = 1;
@@ -1005,6 +1085,7 @@ struct lttng_kernel_event_common *lttng_kernel_event_alloc(struct lttng_event_en
 		event_recorder->chan = chan;
 		event_recorder->priv->parent.chan = &chan->parent;
 		event_recorder->priv->parent.id = chan->priv->free_event_id++;
+		event_recorder->priv->priority = event_recorder_enabler->priority;
 		return &event_recorder->parent;
 	}
 	case LTTNG_EVENT_ENABLER_TYPE_NOTIFIER:
@@ -2470,11 +2551,31 @@ void lttng_event_enabler_create_events_if_missing(struct lttng_event_enabler_com
 	}
 }
 
+static
+void lttng_event_enabler_init_event_priority(struct lttng_event_enabler_common *event_enabler,
+		struct lttng_kernel_event_common *event)
+{
+	struct lttng_event_recorder_enabler *event_recorder_enabler;
+	struct lttng_kernel_event_recorder *event_recorder;
+
+	if (event_enabler->enabler_type != LTTNG_EVENT_ENABLER_TYPE_RECORDER)
+		return;
+	event_recorder_enabler = container_of(event_enabler,
+			struct lttng_event_recorder_enabler, parent.parent);
+	event_recorder = container_of(event, struct lttng_kernel_event_recorder, parent);
+	/* An event takes the highest priority of the enablers matching it. */
+	event_recorder->priv->priority = max(event_recorder->priv->priority,
+			event_recorder_enabler->priority);
+}
+
 static
 void lttng_event_enabler_init_event_filter(struct lttng_event_enabler_common *event_enabler,
 		struct lttng_kernel_event_common *event)
 {
-	/* Link filter bytecodes if not linked yet. */
+	/*
+	 * Link filter bytecodes if not linked yet. Probes prepare the
+	 * fields of a new filter missing from the event mask on their own.
+	 */
 	lttng_enabler_link_bytecode(event->priv->desc, lttng_static_ctx,
 		&event->priv->filter_bytecode_runtime_head, &event_enabler->filter_bytecode_head);
 }
@@ -2558,6 +2659,7 @@ int lttng_event_enabler_ref_events(struct lttng_event_enabler_common *event_enab
 			WARN_ON_ONCE(ret);
 		}
 
+		lttng_event_enabler_init_event_priority(event_enabler, event);
 		lttng_event_enabler_init_event_filter(event_enabler, event);
 		lttng_event_enabler_init_event_capture(event_enabler, event);
 	}
@@ -2882,7 +2984,9 @@ end:
 static
 void lttng_event_sync_filter_state(struct lttng_kernel_event_common *event)
 {
-	int has_enablers_without_filter_bytecode = 0, nr_filters = 0;
+	int has_enablers_without_filter_bytecode = 0, has_always_true_filter = 0,
+		nr_filters = 0;
+	unsigned long filter_fields = 0;
 	struct lttng_kernel_bytecode_runtime *runtime;
 	struct lttng_enabler_ref *enabler_ref;
 
@@ -2899,9 +3003,22 @@ void lttng_event_sync_filter_state(struct lttng_kernel_event_common *event)
 	/* Enable filters */
 	list_for_each_entry(runtime, &event->priv->filter_bytecode_runtime_head, node) {
 		lttng_bytecode_sync_state(runtime);
+		if (runtime->bc->enabler->enabled && !runtime->link_failed)
+			filter_fields |= runtime->fields;
+		/* An enabled filter accepting all events makes the others moot. */
+		if (runtime->always_true && runtime->bc->enabler->enabled
+				&& !runtime->link_failed)
+			has_always_true_filter = 1;
 		nr_filters++;
 	}
-	WRITE_ONCE(event->eval_filter, !(has_enablers_without_filter_bytecode || !nr_filters));
+	/*
+	 * Fields prepared first by the probes. A probe which still sees a
+	 * stale mask prepares the fields missing for its filters when it
+	 * reaches them, see lttng_kernel_interpret_event_filter().
+	 */
+	WRITE_ONCE(event->filter_fields, filter_fields);
+	WRITE_ONCE(event->eval_filter, !(has_enablers_without_filter_bytecode
+			|| has_always_true_filter || !nr_filters));
 }
 
 static
@@ -3938,6 +4055,7 @@ static
 int _lttng_channel_metadata_statedump(struct lttng_kernel_session *session,
 				    struct lttng_kernel_channel_buffer *chan)
 {
+	const char *header;
 	int ret = 0;
 
 	if (chan->priv->metadata_dumped || !LTTNG_READ_ONCE(session->active))
@@ -3949,14 +4067,24 @@ int _lttng_channel_metadata_statedump(struct lttng_kernel_session *session,
 	lttng_metadata_begin(session);
 
 	WARN_ON_ONCE(!chan->priv->header_type);
+	switch (chan->priv->header_type) {
+	case 1:
+		header = "struct event_header_compact";
+		break;
+	case 3:
+		header = "struct event_header_tiny";
+		break;
+	default:
+		header = "struct event_header_large";
+		break;
+	}
 	ret = lttng_metadata_printf(session,
 		"stream {\n"
 		"	id = %u;\n"
 		"	event.header := %s;\n"
 		"	packet.context := struct packet_context;\n",
 		chan->priv->id,
-		chan->priv->header_type == 1 ? "struct event_header_compact" :
-			"struct event_header_large");
+		header);
 	if (ret)
 		goto end;
 
@@ -4013,6 +4141,11 @@ int _lttng_stream_packet_context_declare(struct lttng_kernel_session *session)
  * id: range: 0 - 65534.
  * id 65535 is reserved to indicate an extended header.
  *
+ * Tiny header:
+ * id: range: 0 - 13.
+ * id 14 is reserved to indicate a wide header, with id range 0 - 4095.
+ * id 15 is reserved to indicate an extended header.
+ *
  * Must be called with sessions_mutex held.
  */
 static
@@ -4043,9 +4176,27 @@ int _lttng_event_header_declare(struct lttng_kernel_session *session)
 	"			uint64_clock_monotonic_t timestamp;\n"
 	"		} extended;\n"
 	"	} v;\n"
+	"} align(%u);\n"
+	"\n"
+	"struct event_header_tiny {\n"
+	"	enum : uint4_t { compact = 0 ... 13, wide = 14, extended = 15 } id;\n"
+	"	variant <id> {\n"
+	"		struct {\n"
+	"			uint12_clock_monotonic_t timestamp;\n"
+	"		} compact;\n"
+	"		struct {\n"
+	"			uint12_t id;\n"
+	"			uint16_clock_monotonic_t timestamp;\n"
+	"		} wide;\n"
+	"		struct {\n"
+	"			uint32_t id;\n"
+	"			uint64_clock_monotonic_t timestamp;\n"
+	"		} extended;\n"
+	"	} v;\n"
 	"} align(%u);\n\n",
 	lttng_alignof(uint32_t) * CHAR_BIT,
-	lttng_alignof(uint16_t) * CHAR_BIT
+	lttng_alignof(uint16_t) * CHAR_BIT,
+	lttng_alignof(uint8_t) * CHAR_BIT
 	);
 }
 
@@ -4180,7 +4331,9 @@ int _lttng_session_metadata_statedump(struct lttng_kernel_session *session)
 		"typealias integer { size = 32; align = %u; signed = false; } := uint32_t;\n"
 		"typealias integer { size = 64; align = %u; signed = false; } := uint64_t;\n"
 		"typealias integer { size = %u; align = %u; signed = false; } := unsigned long;\n"
+		"typealias integer { size = 4; align = 1; signed = false; } := uint4_t;\n"
 		"typealias integer { size = 5; align = 1; signed = false; } := uint5_t;\n"
+		"typealias integer { size = 12; align = 1; signed = false; } := uint12_t;\n"
 		"typealias integer { size = 27; align = 1; signed = false; } := uint27_t;\n"
 		"\n"
 		"trace {\n"
@@ -4291,6 +4444,16 @@ int _lttng_session_metadata_statedump(struct lttng_kernel_session *session)
 		goto end;
 
 	ret = lttng_metadata_printf(session,
+		"typealias integer {\n"
+		"	size = 12; align = 1; signed = false;\n"
+		"	map = clock.%s.value;\n"
+		"} := uint12_clock_monotonic_t;\n"
+		"\n"
+		"typealias integer {\n"
+		"	size = 16; align = 1; signed = false;\n"
+		"	map = clock.%s.value;\n"
+		"} := uint16_clock_monotonic_t;\n"
+		"\n"
 		"typealias integer {\n"
 		"	size = 27; align = 1; signed = false;\n"
 		"	map = clock.%s.value;\n"
@@ -4306,6 +4469,8 @@ int _lttng_session_metadata_statedump(struct lttng_kernel_session *session)
 		"	map = clock.%s.value;\n"
 		"} := uint64_clock_monotonic_t;\n\n",
 		trace_clock_name(),
+		trace_clock_name(),
+		trace_clock_name(),
 		lttng_alignof(uint32_t) * CHAR_BIT,
 		trace_clock_name(),
 		lttng_alignof(uint64_t) * CHAR_BIT,
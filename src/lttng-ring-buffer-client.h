@@ -16,10 +16,30 @@
 #include <lttng/events-internal.h>
 #include <lttng/tracer.h>
 #include <ringbuffer/frontend_types.h>
+#include <ringbuffer/frontend_internal.h>
 
 #define LTTNG_COMPACT_EVENT_BITS	5
 #define LTTNG_COMPACT_TIMESTAMP_BITS	27
 
+/*
+ * Tiny header: 4-bit id and 12-bit timestamp for ids 0 to 13, id 14 escapes
+ * to a 12-bit id and 16-bit timestamp (wide), id 15 to the extended header.
+ */
+#define LTTNG_TINY_EVENT_BITS		4
+#define LTTNG_TINY_TIMESTAMP_BITS	12
+#define LTTNG_TINY_WIDE_EVENT_BITS	12
+#define LTTNG_TINY_WIDE_TIMESTAMP_BITS	16
+
+/*
+ * Map sub-buffers contiguously where vmalloc address space is plentiful,
+ * so event payloads are always written with a single copy.
+ */
+#if (BITS_PER_LONG == 64)
+#define RING_BUFFER_BACKEND_TEMPLATE	RING_BUFFER_VMAP
+#else
+#define RING_BUFFER_BACKEND_TEMPLATE	RING_BUFFER_PAGE
+#endif
+
 static struct lttng_transport lttng_relay_transport;
 
 /*
@@ -176,6 +196,33 @@ size_t record_header_size(const struct lttng_kernel_ring_buffer_config *config,
 			offset += sizeof(uint64_t);	/* timestamp */
 		}
 		break;
+	case 3:	/* tiny */
+		padding = 0;
+		/*
+		 * Reservation flags are only ever set, so that the header
+		 * size stays consistent across reservation retries.
+		 */
+		if (last_timestamp_overflow_bits(config, ctx->priv.buf, ctx->priv.timestamp,
+				LTTNG_TINY_WIDE_TIMESTAMP_BITS))
+			ctx->priv.rflags |= LTTNG_RFLAG_EXTENDED;
+		else if (last_timestamp_overflow_bits(config, ctx->priv.buf, ctx->priv.timestamp,
+				LTTNG_TINY_TIMESTAMP_BITS))
+			ctx->priv.rflags |= LTTNG_RFLAG_WIDE;
+		if (!(ctx->priv.rflags & (RING_BUFFER_RFLAG_FULL_TIMESTAMP | LTTNG_RFLAG_EXTENDED))) {
+			if (!(ctx->priv.rflags & LTTNG_RFLAG_WIDE))
+				offset += sizeof(uint16_t);	/* id and timestamp */
+			else
+				offset += sizeof(uint32_t);	/* escape, id and timestamp */
+		} else {
+			/* Minimum space taken by LTTNG_TINY_EVENT_BITS id */
+			offset += (LTTNG_TINY_EVENT_BITS + CHAR_BIT - 1) / CHAR_BIT;
+			/* Align extended struct on largest member */
+			offset += lib_ring_buffer_align(offset, lttng_alignof(uint64_t));
+			offset += sizeof(uint32_t);	/* id */
+			offset += lib_ring_buffer_align(offset, lttng_alignof(uint64_t));
+			offset += sizeof(uint64_t);	/* timestamp */
+		}
+		break;
 	default:
 		padding = 0;
 		WARN_ON_ONCE(1);
@@ -238,6 +285,21 @@ void lttng_write_event_header(const struct lttng_kernel_ring_buffer_config *conf
 		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
 		break;
 	}
+	case 3:	/* tiny */
+	{
+		uint16_t id_time = 0;
+
+		bt_bitfield_write(&id_time, uint16_t,
+				0,
+				LTTNG_TINY_EVENT_BITS,
+				event_id);
+		bt_bitfield_write(&id_time, uint16_t,
+				LTTNG_TINY_EVENT_BITS,
+				LTTNG_TINY_TIMESTAMP_BITS,
+				ctx->priv.timestamp);
+		lib_ring_buffer_write(config, ctx, &id_time, sizeof(id_time));
+		break;
+	}
 	default:
 		WARN_ON_ONCE(1);
 	}
@@ -309,6 +371,51 @@ void lttng_write_event_header_slow(const struct lttng_kernel_ring_buffer_config
 		}
 		break;
 	}
+	case 3:	/* tiny */
+		if (!(ctx->priv.rflags & (RING_BUFFER_RFLAG_FULL_TIMESTAMP | LTTNG_RFLAG_EXTENDED))) {
+			if (!(ctx->priv.rflags & LTTNG_RFLAG_WIDE)) {
+				uint16_t id_time = 0;
+
+				bt_bitfield_write(&id_time, uint16_t,
+						0,
+						LTTNG_TINY_EVENT_BITS,
+						event_id);
+				bt_bitfield_write(&id_time, uint16_t,
+						LTTNG_TINY_EVENT_BITS,
+						LTTNG_TINY_TIMESTAMP_BITS, ctx->priv.timestamp);
+				lib_ring_buffer_write(config, ctx, &id_time, sizeof(id_time));
+			} else {
+				uint32_t id_time = 0;
+
+				bt_bitfield_write(&id_time, uint32_t,
+						0,
+						LTTNG_TINY_EVENT_BITS,
+						14);
+				bt_bitfield_write(&id_time, uint32_t,
+						LTTNG_TINY_EVENT_BITS,
+						LTTNG_TINY_WIDE_EVENT_BITS,
+						event_id);
+				bt_bitfield_write(&id_time, uint32_t,
+						LTTNG_TINY_EVENT_BITS + LTTNG_TINY_WIDE_EVENT_BITS,
+						LTTNG_TINY_WIDE_TIMESTAMP_BITS, ctx->priv.timestamp);
+				lib_ring_buffer_write(config, ctx, &id_time, sizeof(id_time));
+			}
+		} else {
+			uint8_t id = 0;
+			uint64_t timestamp = ctx->priv.timestamp;
+
+			bt_bitfield_write(&id, uint8_t,
+					0,
+					LTTNG_TINY_EVENT_BITS,
+					15);
+			lib_ring_buffer_write(config, ctx, &id, sizeof(id));
+			/* Align extended struct on largest member */
+			lib_ring_buffer_align_ctx(ctx, lttng_alignof(uint64_t));
+			lib_ring_buffer_write(config, ctx, &event_id, sizeof(event_id));
+			lib_ring_buffer_align_ctx(ctx, lttng_alignof(uint64_t));
+			lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
+		}
+		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
@@ -365,7 +472,7 @@ static void client_buffer_begin(struct lttng_kernel_ring_buffer *buf, u64 timest
 	header->ctx.timestamp_end = 0;
 	header->ctx.content_size = ~0ULL; /* for debugging */
 	header->ctx.packet_size = ~0ULL;
-	header->ctx.packet_seq_num = chan->backend.num_subbuf * \
+	header->ctx.packet_seq_num = buf->backend.num_subbuf * \
 				     buf->backend.buf_cnt[subbuf_idx].seq_cnt + \
 				     subbuf_idx;
 	header->ctx.events_discarded = 0;
@@ -385,6 +492,7 @@ static void client_buffer_end(struct lttng_kernel_ring_buffer *buf, u64 timestam
 		(struct packet_header *)
 			lib_ring_buffer_offset_address(&buf->backend,
 				subbuf_idx * chan->backend.subbuf_size);
+	struct lttng_kernel_abi_ring_buffer_packet_index *index;
 	unsigned long records_lost = 0;
 
 	header->ctx.timestamp_end = timestamp;
@@ -395,7 +503,25 @@ static void client_buffer_end(struct lttng_kernel_ring_buffer *buf, u64 timestam
 	records_lost += lib_ring_buffer_get_records_lost_full(&client_config, ctx);
 	records_lost += lib_ring_buffer_get_records_lost_wrap(&client_config, ctx);
 	records_lost += lib_ring_buffer_get_records_lost_big(&client_config, ctx);
+	records_lost += lib_ring_buffer_get_records_lost_unavailable(&client_config, ctx);
 	header->ctx.events_discarded = records_lost;
+
+	index = lib_ring_buffer_packet_index(&client_config, buf, subbuf_idx);
+	if (index) {
+		WRITE_ONCE(index->packet_seq_num, ~0ULL);
+		/* Invalidate the record before updating it. */
+		smp_wmb();
+		index->packet_size = header->ctx.packet_size;
+		index->content_size = header->ctx.content_size;
+		index->timestamp_begin = header->ctx.timestamp_begin;
+		index->timestamp_end = timestamp;
+		index->events_discarded = records_lost;
+		index->stream_id = header->stream_id;
+		index->stream_instance_id = header->stream_instance_id;
+		/* Order record fields before its sequence number. */
+		smp_wmb();
+		WRITE_ONCE(index->packet_seq_num, header->ctx.packet_seq_num);
+	}
 }
 
 static int client_buffer_create(struct lttng_kernel_ring_buffer *buf, void *priv,
@@ -412,7 +538,8 @@ static struct packet_header *client_packet_header(
 		const struct lttng_kernel_ring_buffer_config *config,
 		struct lttng_kernel_ring_buffer *buf)
 {
-	return lib_ring_buffer_read_offset_address(&buf->backend, 0);
+	return lib_ring_buffer_read_offset_address(&buf->backend,
+			buf->get_subbuf_consumed);
 }
 
 static int client_timestamp_begin(const struct lttng_kernel_ring_buffer_config *config,
@@ -506,6 +633,32 @@ int client_instance_id(const struct lttng_kernel_ring_buffer_config *config,
 	return 0;
 }
 
+static
+int client_packet_desc(const struct lttng_kernel_ring_buffer_config *config,
+		struct lttng_kernel_ring_buffer *buf,
+		unsigned long offset,
+		struct lttng_kernel_abi_ring_buffer_packet_desc *desc)
+{
+	struct packet_header *header =
+		lib_ring_buffer_read_offset_address(&buf->backend, offset);
+	unsigned long sb_bindex;
+
+	if (config->output == RING_BUFFER_MMAP) {
+		sb_bindex = subbuffer_id_get_index(config,
+				subbuffer_read_id(config, &buf->backend, offset));
+		desc->mmap_offset = buf->backend.array[sb_bindex]->mmap_offset;
+	}
+	desc->padded_size = header->ctx.packet_size / CHAR_BIT;
+	desc->content_size = header->ctx.content_size;
+	desc->packet_size = header->ctx.packet_size;
+	desc->timestamp_begin = header->ctx.timestamp_begin;
+	desc->timestamp_end = header->ctx.timestamp_end;
+	desc->events_discarded = header->ctx.events_discarded;
+	desc->seq_num = header->ctx.packet_seq_num;
+
+	return 0;
+}
+
 static const struct lttng_kernel_ring_buffer_config client_config = {
 	.cb.ring_buffer_clock_read = client_ring_buffer_clock_read,
 	.cb.record_header_size = client_record_header_size,
@@ -516,10 +669,11 @@ static const struct lttng_kernel_ring_buffer_config client_config = {
 	.cb.buffer_finalize = client_buffer_finalize,
 
 	.timestamp_bits = LTTNG_COMPACT_TIMESTAMP_BITS,
+	.packet_index_size = sizeof(struct lttng_kernel_abi_ring_buffer_packet_index),
 	.alloc = RING_BUFFER_ALLOC_PER_CPU,
 	.sync = RING_BUFFER_SYNC_PER_CPU,
 	.mode = RING_BUFFER_MODE_TEMPLATE,
-	.backend = RING_BUFFER_PAGE,
+	.backend = RING_BUFFER_BACKEND_TEMPLATE,
 	.output = RING_BUFFER_OUTPUT_TEMPLATE,
 	.oops = RING_BUFFER_OOPS_CONSISTENCY,
 	.ipi = RING_BUFFER_IPI_BARRIER,
@@ -543,14 +697,15 @@ struct lttng_kernel_ring_buffer_channel *_channel_create(const char *name,
 				void *priv, void *buf_addr,
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
-				unsigned int read_timer_interval)
+				unsigned int read_timer_interval,
+				unsigned int flags)
 {
 	struct lttng_kernel_channel_buffer *lttng_chan = priv;
 	struct lttng_kernel_ring_buffer_channel *chan;
 
 	chan = channel_create(&client_config, name, lttng_chan, buf_addr,
 			      subbuf_size, num_subbuf, switch_timer_interval,
-			      read_timer_interval);
+			      read_timer_interval, flags);
 	if (chan) {
 		/*
 		 * Ensure this module is not unloaded before we finish
@@ -633,6 +788,12 @@ int lttng_event_reserve(struct lttng_kernel_ring_buffer_ctx *ctx)
 		if (event_id > 65534)
 			ctx->priv.rflags |= LTTNG_RFLAG_EXTENDED;
 		break;
+	case 3:	/* tiny */
+		if (event_id > 4095)
+			ctx->priv.rflags |= LTTNG_RFLAG_EXTENDED;
+		else if (event_id > 13)
+			ctx->priv.rflags |= LTTNG_RFLAG_WIDE;
+		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
@@ -766,6 +927,7 @@ static struct lttng_transport lttng_relay_transport = {
 			.current_timestamp = client_current_timestamp,
 			.sequence_number = client_sequence_number,
 			.instance_id = client_instance_id,
+			.packet_desc = client_packet_desc,
 		}),
 		.event_reserve = lttng_event_reserve,
 		.event_commit = lttng_event_commit,
@@ -242,7 +242,8 @@ struct lttng_kernel_ring_buffer_channel *_channel_create(const char *name,
 				void *priv, void *buf_addr,
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
-				unsigned int read_timer_interval)
+				unsigned int read_timer_interval,
+				unsigned int flags)
 {
 	struct lttng_kernel_channel_buffer *lttng_chan = priv;
 	struct lttng_kernel_ring_buffer_channel *chan;
@@ -250,7 +251,7 @@ struct lttng_kernel_ring_buffer_channel *_channel_create(const char *name,
 	chan = channel_create(&client_config, name,
 			      lttng_chan->parent.session->priv->metadata_cache, buf_addr,
 			      subbuf_size, num_subbuf, switch_timer_interval,
-			      read_timer_interval);
+			      read_timer_interval, flags);
 	if (chan) {
 		/*
 		 * Ensure this module is not unloaded before we finish
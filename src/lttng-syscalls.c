@@ -577,6 +577,7 @@ void lttng_syscall_event_enabler_create_event(struct lttng_event_enabler_common
 		WARN_ON_ONCE(!event_recorder_enabler);
 		if (!event_recorder_enabler)
 			return;
+		event_recorder_enabler->priority = syscall_event_recorder_enabler->priority;
 		event = _lttng_kernel_event_create(&event_recorder_enabler->parent.parent, desc, NULL);
 		WARN_ON_ONCE(IS_ERR(event));
 		lttng_event_enabler_destroy(&event_recorder_enabler->parent.parent);